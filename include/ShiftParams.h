@@ -1,6 +1,6 @@
 #ifndef SHIFT_PARAMS_DOT_H
 #define SHIFT_PARAMS_DOT_H
-#include <Arduino.h>
+#include "platform.h"
 
 // Forward declaration so we can declare a function that takes a ptr to one of these
 class TransportParams;
@@ -1,30 +1,38 @@
 #ifndef TRANSPORT_PARAMS_DOT_H
 #define TRANSPORT_PARAMS_DOT_H
-#include <Arduino.h>
+#include "platform.h"
 #include "stoch.h"
 #include "ShiftParams.h"
+#include "scene.h"
+#include "seqState.h"
 
-const uint8_t NUM_STEP_LENGTHS(13);
 
-class TransportParams
+// Where the step counter lands after [steps] in-place moves from [offset].
+// One step at a time is (offset +/- 1) % len, which (thanks to how %
+// treats negatives) counts down through zero to -(len - 1) going
+// backwards; doing it all at once comes out the same (test/test_transport
+// checks the two against each other).
+constexpr int8_t offsetAfter(int8_t offset, int16_t steps, uint8_t len)
 {
-  bool        wasReset_;
-  bool        readyToLoad_;
-  bool        resetPending_;
-  bool        newLoadPending_;
-  bool        newPatternLoaded_;
-
-  ShiftParams shifter_;
+  return (offset + steps) % len;
+}
 
-  int8_t      offset_;
-  uint8_t     nextPattern_;
-  uint8_t     currentBankIdx_;
+// [steps] one-bit rotations of [reg], left for positive
+constexpr uint16_t rotateBy(uint16_t reg, int16_t steps)
+{
+  uint8_t amt(((steps % 16) + 16) % 16);
+  return amt ? (uint16_t)((reg << amt) | (reg >> (16 - amt))) : reg;
+}
 
-  std::array<const uint8_t, NUM_STEP_LENGTHS>::iterator workingLength;
+// The clock/step/length/scene-switching half of the sequencer. It doesn't
+// own any state: everything lives in the SeqState it's handed.
+class TransportParams
+{
+  SeqState&   st_;
 
 public:
 
-  TransportParams();
+  TransportParams(SeqState& state);
   ~TransportParams() = default;
 
   bool        wasReset() const;
@@ -36,7 +44,9 @@ public:
   int8_t      getStep() const;
   uint8_t     getSlot() const;
   uint8_t     getLength() const;
+  uint8_t     getLengthIdx() const;
   uint8_t     currentBankIdx() const;
+  uint8_t     nextPattern() const;
 
   void        reset();
   void        reAnchor();
@@ -44,13 +54,24 @@ public:
   void        lengthMINUS();
   void        flagForReset();
   void        setNextPattern(const uint8_t slot);
+  void        setLengthIdx(const uint8_t idx);
+  void        restoreState(const int8_t  offset,
+                           const uint8_t lengthIdx,
+                           const uint8_t bank,
+                           const uint8_t nextBank,
+                           const bool    loadPending,
+                           const bool    resetPending);
 
   void        pre_iterate(const int8_t steps, const bool inPlace);
-  uint16_t    loadPattern(const std::array<uint16_t, 8> &bank);
-  uint16_t    iterate(uint16_t reg, Stochasticizer stoch);
+
+  // These work on the state's register
+  void        loadPattern(const Scene& scene);
+  void        iterate(const Stochasticizer& stoch);
   uint16_t    rotateToZero(const uint16_t reg);
 
-  int8_t      drunkStep_;
+  // [steps] in-place steps (nothing written) in one go; same result as
+  // pre_iterate() + iterate() that many times
+  void        moveInPlace(const int8_t steps);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -7,16 +7,21 @@
 #ifndef TURING_REGISTER_DOT_AITCH
 #define TURING_REGISTER_DOT_AITCH
 
-#include <Arduino.h>
-#include <memory>
-#include <bitHelpers.h>
-#include <MagicButton.h>
-#include <vector>
+#include "platform.h"
 #include "stoch.h"
 #include "hw_constants.h"
 #include "ShiftParams.h"
 #include "TransportParams.h"
+#include "seqState.h"
+#include "seqlock.h"
+#include "warmStart.h"
+#include "stepHistory.h"
+#include "scene.h"
+#include "modMatrix.h"
 
+// Scrambles the low byte of the register into something the trigger
+// outputs can use (see pulseIt())
+uint8_t markov(uint8_t seed);
 
 class TuringRegister
 {
@@ -40,6 +45,16 @@ public:
 
   void      setNextPattern(uint8_t loadSlot);
   void      savePattern(uint8_t bankIdx);
+  void      restoreBanks();
+  void      warmRestore(const WarmSnapshot& snap);
+
+  // Moves back (or forward again) through the step history without
+  // changing anything; the next live step carries on from there
+  void      scrub(int8_t steps);
+
+  // While this is on, clocks play the history backwards
+  void      toggleRetrograde();
+  bool      retrograde() const;
 
   uint8_t   getDrunkenIndex();
 
@@ -48,19 +63,76 @@ public:
 
   uint16_t  getPattern() const;
   uint16_t  getReg(uint8_t slot) const;
+  const Scene& activeScene() const;
+
+  // Consistent copy of the live state, from any task on either core
+  SeqSnapshot  snapshot() const;
+
+  uint8_t   activeSceneIdx() const;
   uint8_t   getOutput() const;
   uint8_t   getLength() const;
 
 protected:
 
-  const uint8_t   NUM_PATTERNS;
+  // Mirrors the live state into RTC memory for warm restarts, and out to
+  // snapshot() readers
+  void      syncWarmStart();
+  void      publish();
+
+  HistState currentState() const;
+  void      applyState(const HistState& state);
+  void      recordStep(int8_t steps, bool inPlace);
+
+  // Points at scene [idx]; everything else just reads through the pointer
+  void      selectScene(uint8_t idx);
+
+  // Copies scene [idx] aside as the one to switch to. Done when it gets
+  // picked (or changes), so the downbeat doesn't have to.
+  void      stageScene(uint8_t idx);
 
-  std::array<uint16_t, NUM_BANKS>  registersBank;
+  // Switches to the staged scene: register, length, bank and settings all
+  // at once, before anything gets output
+  void      commitStaged();
 
-  Stochasticizer  stoch_;
-  ShiftParams     shifter_;
+  // Switches the faders over and tells the scan it's starting over
+  void      selectFaderBank(uint8_t bank);
+
+  // Sends the step out to the CVs, triggers, mod outs and LEDs, with the
+  // fader values straight from the bank if it only just got switched (the
+  // scan won't have caught up yet)
+  void      outputStep(bool reset);
+
+  // Pushes the active scene's fader bank, range and trigger length out to
+  // the hardware
+  void      applySceneSettings();
+
+  // Offsets the active scene's settings by whatever the mod matrix came up
+  // with this step. Anything a route was just taken off goes back to the
+  // scene's value.
+  void      applyModulation(const ModValues& mods, bool withLength);
+
+  const uint8_t   NUM_PATTERNS;
+
+  SeqState        state_;           // Everything a step touches
   TransportParams transport_;
-  uint16_t        workingRegister;
+  Stochasticizer& stoch_;
+  const Scene*    activeScene_;
+  Scene           staged_;          // Copy of the scene the downbeat switches to
+  uint8_t         stagedIdx_;
+  bool            freshBank_;       // Fader bank switched since the last output
+  bool            retrograde_;
+
+  std::array<Scene, NUM_SCENES>  scenes_;
+  StepHistory     history_;
+  Seqlock<SeqSnapshot> published_;
+
+#ifdef RATDEBUG
+  uint32_t        steps_;
+  uint32_t        stepCycles_;      // Summed since the last report
+  uint32_t        maxStepCycles_;
+
+  void            logStepStats(uint32_t cycles);
+#endif
 };
 
 
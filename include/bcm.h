@@ -0,0 +1,67 @@
+// ------------------------------------------------------------------------
+// bcm.h
+//
+// Per-LED brightness for the 16 panel LEDs, using binary code modulation.
+// Each LED gets a 4-bit level. Those get sliced into 4 bit-planes, and a
+// hardware timer shows plane n for 2^n time units, so the time each LED
+// spends lit adds up to its level. That's 4 frames per cycle no matter how
+// many levels there are.
+//
+// The planes are worked out (and run through the LED bit map) whenever the
+// display changes, so all the timer ISR does is hand a ready-made frame to
+// srBus and set up the next alarm.
+//
+// Each plane still has to get through srBus: the task waking up, maybe a
+// trigger frame ahead of it, then an SPI transaction. That's tens of us,
+// so the shortest plane is kept a few times longer than that. If one
+// doesn't make it out before the next is due, it shows up in srBus's LED
+// "dropped" count.
+// ------------------------------------------------------------------------
+#ifndef BCM_DOT_H
+#define BCM_DOT_H
+
+#include <Arduino.h>
+#include "srBus.h"
+
+const uint8_t  NUM_PANEL_LEDS   (16);
+const uint8_t  BCM_BITS         (4);
+const uint8_t  BCM_LEVELS       (1 << BCM_BITS);
+
+const uint8_t  LED_OFF          (0);
+const uint8_t  LED_DIM          (2);
+const uint8_t  LED_FULL         (BCM_LEVELS - 1);
+
+// Shortest plane; a full cycle is (BCM_LEVELS - 1) of these, so ~330 Hz
+const uint16_t BCM_BASE_MICROS  (200);
+const uint8_t  BCM_TIMER        (2);    // Timer 1 is the 1 kHz master clock
+
+
+class BcmLeds
+{
+  uint16_t          planes_[2][BCM_BITS];   // Already in output bit order
+  volatile uint8_t  front_;
+  volatile bool     swapPending_;
+  uint8_t           plane_;
+  uint16_t          lastFrame_;
+  hw_timer_t       *timer_;
+  portMUX_TYPE      mux_;
+
+public:
+  BcmLeds();
+  ~BcmLeds() = default;
+
+  // Starts the timer; srBus needs to be up first
+  void begin();
+
+  // New brightness for every LED: [levels] is indexed by register bit, so
+  // 0-7 are the fader LEDs and 8-15 are the main row. Takes effect at the
+  // start of the next cycle.
+  void show(const uint8_t levels[NUM_PANEL_LEDS]);
+
+  // Timer ISR
+  void IRAM_ATTR tick();
+};
+
+extern BcmLeds bcmLeds;
+
+#endif
@@ -0,0 +1,46 @@
+// ------------------------------------------------------------------------
+// bench.h
+//
+// Microbenchmarks for the code that runs every step: the shift, the coin
+// toss, the trigger patterns, and turning the register into voltages
+// (the arithmetic on both, the whole of expandVoltages() on the board
+// only). Also what a fast spin of the encoder costs to process.
+// Only built with -DTMOC_BENCH ([env:bench] on the host, [env:bench_esp32]
+// on the board).
+//
+// Each one prints a line like
+//
+//   bench,norm,ns,3.2,200000
+//
+// i.e. bench,<name>,<unit>,<per call>,<calls per batch>. The unit's ns on
+// the host and CPU cycles on the board (the cycle counter), and the figure
+// is the best of BENCH_BATCHES batches, which keeps whatever else was
+// going on at the time out of it as far as possible. Leave RATDEBUG off
+// for these: markov() and pulseIt() print every call under it.
+//
+// The host build also compares against a stored baseline (see
+// bench/baseline_native.csv) and exits non-zero if anything got slower by
+// more than the threshold. It'll do the same for a log captured off the
+// board's serial port; anything not starting with "bench," is ignored.
+//
+//   tmoc_bench [-b baseline.csv] [-t percent] [-n calls]
+//   tmoc_bench -c baseline.csv results.csv [-t percent]
+// ------------------------------------------------------------------------
+#ifndef BENCH_DOT_H
+#define BENCH_DOT_H
+
+#include "platform.h"
+
+const uint8_t  BENCH_BATCHES      (25);
+const uint8_t  BENCH_THRESHOLD_PCT(20);   // Slower than the baseline by more than this: regression
+const uint8_t  BENCH_MIN_DELTA    (2);    // ...and by at least this many ns/cycles (timer noise)
+#ifdef ARDUINO
+const uint32_t BENCH_CALLS        (10000);
+#else
+const uint32_t BENCH_CALLS        (20000);
+#endif
+
+// Runs them all and prints the results
+void runBenchmarks(uint32_t calls = BENCH_CALLS);
+
+#endif
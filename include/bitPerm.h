@@ -0,0 +1,115 @@
+// ------------------------------------------------------------------------
+// bitPerm.h
+//
+// The shift register outputs aren't wired in bit order, so every frame
+// has to be shuffled before it goes out. The wiring never changes, so the
+// shuffling gets worked out at compile time: one 256-entry table per byte
+// of the register, and remapping a frame is one lookup per byte (OR'd
+// together) instead of a loop over every bit.
+//
+// Output bit [map[n]] gets register bit [n]. That's the order
+// OutputRegister used the maps in: regMap is the old fdrLeds (low byte)
+// and bitLeds (high byte, +8) tables from hw_constants.h, which are
+// indexed by LED and give the 595 output each one is wired to.
+// ------------------------------------------------------------------------
+#ifndef BIT_PERM_DOT_H
+#define BIT_PERM_DOT_H
+
+#include <Arduino.h>
+#include <array>
+#include "hw_constants.h"
+
+using ByteLut = std::array<uint16_t, 256>;
+
+template <size_t BYTES>
+using PermTables = std::array<ByteLut, BYTES>;
+
+
+// Builds the tables for a register [BYTES] bytes wide from its map
+template <size_t BYTES>
+constexpr PermTables<BYTES> makePermTables(const uint8_t (&map)[BYTES * 8])
+{
+  PermTables<BYTES> tables{};
+  for (size_t byteIdx(0); byteIdx < BYTES; ++byteIdx)
+  {
+    for (uint16_t val(0); val < 256; ++val)
+    {
+      uint16_t out(0);
+      for (uint8_t bit(0); bit < 8; ++bit)
+      {
+        if ((val >> bit) & 0x01)
+        {
+          out |= (1 << map[byteIdx * 8 + bit]);
+        }
+      }
+      tables[byteIdx][val] = out;
+    }
+  }
+  return tables;
+}
+
+
+// The slow way, straight off the map. It's only here to benchmark the
+// tables against.
+template <size_t BYTES>
+constexpr uint16_t permuteBits(uint16_t reg, const uint8_t (&map)[BYTES * 8])
+{
+  uint16_t out(0);
+  for (uint8_t n(0); n < BYTES * 8; ++n)
+  {
+    if ((reg >> n) & 0x01)
+    {
+      out |= (1 << map[n]);
+    }
+  }
+  return out;
+}
+
+
+// Every output bit has to come from exactly one register bit
+template <size_t BYTES>
+constexpr bool isPermutation(const uint8_t (&map)[BYTES * 8])
+{
+  uint32_t seen(0);
+  for (uint8_t n(0); n < BYTES * 8; ++n)
+  {
+    if (map[n] >= BYTES * 8 || (seen & (1UL << map[n])))
+    {
+      return false;
+    }
+    seen |= (1UL << map[n]);
+  }
+  return true;
+}
+
+
+inline constexpr PermTables<2> LED_PERM (makePermTables<2>(regMap));
+inline constexpr PermTables<1> TRIG_PERM(makePermTables<1>(trgMap));
+
+static_assert(isPermutation<2>(regMap),               "regMap isn't a permutation");
+static_assert(isPermutation<1>(trgMap),               "trgMap isn't a permutation");
+static_assert(isPermutation<1>(sliderMap),            "sliderMap isn't a permutation");
+
+// A few frames worked out by hand from the maps, so the tables get checked
+// against something other than the code that built them
+constexpr uint16_t ledFrame(uint16_t reg)
+{
+  return LED_PERM[0][reg & 0xFF] | LED_PERM[1][reg >> 8];
+}
+
+static_assert(ledFrame(0x0001) == 0x0008, "LED register bit 0 should be output 3");
+static_assert(ledFrame(0x0080) == 0x0004, "LED register bit 7 should be output 2");
+static_assert(ledFrame(0x0100) == 0x0200, "LED register bit 8 should be output 9");
+static_assert(ledFrame(0x8000) == 0x4000, "LED register bit 15 should be output 14");
+static_assert(ledFrame(0x0055) == 0x002B, "LED frame for 0x0055 is off");
+static_assert(ledFrame(0x5500) == 0xAA00, "LED frame for 0x5500 is off");
+static_assert(ledFrame(0xA5C3) == 0x5A8D, "LED frame for 0xA5C3 is off");
+static_assert(ledFrame(0xFFFF) == 0xFFFF, "LED frame for 0xFFFF is off");
+
+static_assert(TRIG_PERM[0][0x01] == 0x80, "Trigger 0 should be output 7");
+static_assert(TRIG_PERM[0][0x40] == 0x01, "Trigger 6 should be output 0");
+static_assert(TRIG_PERM[0][0x80] == 0x02, "Trigger 7 should be output 1");
+static_assert(TRIG_PERM[0][0x0F] == 0xF0, "Trigger frame for 0x0F is off");
+static_assert(TRIG_PERM[0][0x30] == 0x0C, "Trigger frame for 0x30 is off");
+
+#endif
@@ -0,0 +1,78 @@
+// ------------------------------------------------------------------------
+// calibration.h
+//
+// Per-channel pitch calibration for the four external DAC outputs.
+//
+// Calibration is done by ear/meter one octave at a time: dial in the DAC
+// code that gives exactly 0V, 1V, 2V... on a channel and store it. Those
+// points get turned into a note->DAC code lookup table (straight line if
+// you only set two points, piecewise-linear if you set more), so all the
+// step path has to do is index into it.
+//
+// A channel with no points gets the nominal DAC_NOMINAL_CODES_PER_OCTAVE
+// line from code 0 (five octaves across the DAC's full scale), which is what every
+// unit plays through until it's been calibrated.
+// ------------------------------------------------------------------------
+#ifndef CALIBRATION_DOT_H
+#define CALIBRATION_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+
+// What actually gets persisted for each channel
+struct CalPoints
+{
+  uint8_t   version;
+  uint8_t   validMask;              // Bit n set if code[n] was measured
+  uint16_t  code[NUM_CAL_POINTS];   // DAC code for n volts
+};
+
+
+class DacCalibration
+{
+  CalPoints points_[NUM_DAC_CHANNELS];
+  uint16_t  table_ [NUM_DAC_CHANNELS][CAL_NUM_NOTES];
+
+  uint16_t  interpolate(uint8_t note, uint8_t lo, uint8_t hi,
+                        uint16_t loCode, uint16_t hiCode) const;
+
+public:
+  DacCalibration();
+
+  // Pull calibration data out of NVS (if there is any) and build tables
+  void      load();
+
+  // Write calibration data to NVS. Returns false if any channel failed
+  bool      save();
+
+  // Recompute the lookup table for a channel from its measured points
+  void      rebuild(uint8_t ch);
+
+  void      setPoint(uint8_t ch, uint8_t point, uint16_t code);
+  void      clearPoint(uint8_t ch, uint8_t point);
+  bool      hasPoint(uint8_t ch, uint8_t point) const;
+  uint8_t   validMask(uint8_t ch) const;
+
+  // DAC code to write for [note] on channel [ch]. Notes past the end of
+  // the table stick at the top of the table.
+  inline uint16_t code(uint8_t ch, uint16_t note) const
+  {
+    return table_[ch][note < CAL_NUM_NOTES ? note : CAL_NUM_NOTES - 1];
+  }
+};
+
+extern DacCalibration dacCal;
+
+// Interactive calibration mode (hold the encoder button at power-up; board
+// only):
+//   - Raise a fader to pick the octave point to tune (highest raised fader
+//     wins; fader LEDs show the point, lit if it's already stored)
+//   - Turn the encoder to trim the DAC code; hold it down while turning
+//     for bigger steps
+//   - Double-click to move on to the next output channel (main LEDs)
+//   - Flick the toggle up to store the point, down to forget it
+//   - Long-press the encoder to save everything and start playing
+void calibrate();
+
+#endif
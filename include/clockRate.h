@@ -0,0 +1,24 @@
+// ------------------------------------------------------------------------
+// clockRate.h
+//
+// Running estimate of the incoming clock's period, and when the last edge
+// came in. onClockRise() feeds it; anything that wants to fit in between
+// clock edges (the LED/trigger timing, the pattern store's flash erases)
+// reads it.
+// ------------------------------------------------------------------------
+#ifndef CLOCK_RATE_DOT_H
+#define CLOCK_RATE_DOT_H
+
+#include "platform.h"
+
+// Anything slower than this counts as the clock having stopped, not
+// slowed down
+const uint32_t CLOCK_TIMEOUT_MICROS(2000000UL);
+
+// Every rising clock edge, with when it happened
+void     clockEdge(uint32_t now);
+
+uint32_t clockPeriodMicros();
+uint32_t lastClockEdgeMicros();
+
+#endif
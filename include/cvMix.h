@@ -0,0 +1,36 @@
+// ------------------------------------------------------------------------
+// cvMix.h
+//
+// The arithmetic half of expandVoltages(): the register and the fader
+// values in, a note value for each external DAC out.
+//
+//   CV A: faders whose register bit is set
+//   CV B: faders whose register bit is clear
+//   CV C: abs(CV A - CV B)
+//   CV D: CV A, but only picked up on steps where bit 0 is set
+//
+// (the scene's outFlags can swap A and B). Nothing in here touches the
+// hardware, so the host builds it as well: the stand-in board and the
+// benchmarks go through the same code as the real outputs.
+// ------------------------------------------------------------------------
+#ifndef CV_MIX_DOT_H
+#define CV_MIX_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+class CvMixer
+{
+  uint16_t heldD_;      // CV D's sample & hold
+  bool     primed_;     // heldD_ has been picked up at least once
+
+public:
+  CvMixer();
+
+  void mix(uint8_t        shiftReg,
+           const uint16_t faderVals[NUM_FADERS],
+           uint8_t        outFlags,
+           uint16_t       noteVals[NUM_DAC_CHANNELS]);
+};
+
+#endif
@@ -0,0 +1,77 @@
+// ------------------------------------------------------------------------
+// dacBatch.h
+//
+// Writes all four external DAC channels as one batch, so they change at
+// the same instant instead of one after another.
+//
+// The four codes go out in a single MCP4728 Fast Write, which only loads
+// the input registers, then a General Call Software Update moves all four
+// to the outputs at once. Fast Write leaves the reference, gain and power
+// settings alone, so whatever MultiChannelDac::init() set up still holds.
+//
+// Once the slew task is running, only SlewEngine::write() should commit
+// (it holds a lock around it; the step and the slew task both call it).
+//
+// NB: this relies on LDAC being held high. If it's tied low, the outputs
+// follow the input registers and we're back to one-at-a-time.
+//
+// begin() looks for the MCP4728 at MCP4728_ADDR. If it doesn't answer,
+// commits go out one channel at a time through MultiChannelDac, the way
+// they did before batching, and the stats time how far apart the first
+// and last channel landed. Latched, there's nothing to time from in here:
+// the chip moves all four at once on the update.
+// ------------------------------------------------------------------------
+#ifndef DAC_BATCH_DOT_H
+#define DAC_BATCH_DOT_H
+
+#include <Arduino.h>
+#include "hw_constants.h"
+
+const uint8_t MCP4728_ADDR          (0x60);
+const uint8_t I2C_GENERAL_CALL      (0x00);
+const uint8_t GC_SOFTWARE_UPDATE    (0x08);
+
+struct DacBatchStats
+{
+  uint32_t commits;
+  uint32_t skipped;         // Nothing had changed
+  uint32_t loadMicros;      // Fast Write (input registers only), or all the channel writes
+  uint32_t latchMicros;     // Software update
+  uint32_t maxTotalMicros;
+  uint32_t skewMicros;      // Unlatched only: first channel's write done to the last one's
+  uint32_t maxSkewMicros;
+};
+
+
+class DacBatch
+{
+  uint16_t      staged_[NUM_DAC_CHANNELS];
+  uint16_t      committed_[NUM_DAC_CHANNELS];
+  bool          dirty_;
+  bool          present_;       // MCP4728 answered at begin()
+  DacBatchStats stats_;
+
+  bool  commitLatched();
+  bool  commitUnlatched();
+
+public:
+  DacBatch();
+  ~DacBatch() = default;
+
+  // Looks for the MCP4728; call once the DAC's been set up
+  void  begin();
+
+  // Nothing goes out until commit()
+  void  stage(uint8_t ch, uint16_t code);
+
+  // Sends everything that's staged and latches it. Returns false if the
+  // DAC didn't answer.
+  bool  commit();
+
+  const DacBatchStats& stats() const;
+  void  logStats() const;
+};
+
+extern DacBatch dacBatch;
+
+#endif
@@ -0,0 +1,113 @@
+// ------------------------------------------------------------------------
+// events.h
+//
+// Instead of loop() spinning around asking every input whether anything
+// happened (it usually hadn't), the 1 kHz timer ISR checks them right
+// after servicing them and posts an event for anything that did. loop()
+// sleeps on the queue and hands each event to its handler.
+//
+// The events wait in a FreeRTOS queue, unless begin() is handed an
+// EventStore to keep them in instead; the simulator (sim.cpp) does that,
+// so what it runs is this dispatcher and the real handlers.
+//
+// Build with POLLED_INPUTS to get the old spinning loop back, for
+// comparison. DEBUG_CLOCK drives the clock off the toggle switch by
+// polling, so it implies POLLED_INPUTS.
+// ------------------------------------------------------------------------
+#ifndef EVENTS_DOT_H
+#define EVENTS_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+#if defined(DEBUG_CLOCK) && !defined(POLLED_INPUTS)
+#define POLLED_INPUTS
+#endif
+
+enum class evt_type : uint8_t {
+  ENCODER,        // a: encEvnts
+  TOGGLE,         // a: ButtonState (low switch), b: ButtonState (high switch)
+  CLOCK_RISE,
+  CLOCK_FALL,
+  RESET,
+  LED_FRAME,      // Time for panelLeds to have a look
+  NUM_EVENTS
+};
+
+const uint8_t NUM_EVT_TYPES (static_cast<uint8_t>(evt_type::NUM_EVENTS));
+const uint8_t EVT_QUEUE_LEN (32);
+
+struct InputEvent
+{
+  evt_type  type;
+  uint8_t   a;
+  uint8_t   b;
+  uint32_t  micros;   // When it was posted
+};
+
+
+// Somewhere other than a FreeRTOS queue to keep them. push() is called
+// from the timer ISR, and says false if it's full.
+class EventStore
+{
+public:
+  virtual ~EventStore() = default;
+
+  virtual bool push(const InputEvent& ev) = 0;
+  virtual bool pop (InputEvent& ev, TickType_t timeout) = 0;
+  virtual bool peek(InputEvent& ev) = 0;
+};
+
+
+class EventQueue
+{
+  QueueHandle_t     queue_;
+  EventStore*       store_;
+  volatile bool     ledFramePending_;
+  uint8_t           ledTicks_;
+  volatile uint32_t dropped_;
+
+#ifdef RATDEBUG
+  uint32_t          count_  [NUM_EVT_TYPES];
+  uint32_t          latency_[NUM_EVT_TYPES];    // Summed, post to handler
+  uint32_t          maxLatency_[NUM_EVT_TYPES];
+  uint32_t          handlerMicros_[NUM_EVT_TYPES];
+  uint32_t          merged_;        // Encoder events folded into the one before
+  uint32_t          busyMicros_;
+  uint32_t          windowStart_;
+#endif
+
+  void IRAM_ATTR    post(evt_type type, uint8_t a = 0, uint8_t b = 0);
+
+  // To [store_] if there is one, the queue if not
+  bool IRAM_ATTR    push(const InputEvent& ev);
+  bool              pop (InputEvent& ev, TickType_t timeout);
+  bool              peek(InputEvent& ev);
+
+  // Takes any more of the same knob event off the front of the queue.
+  // Returns how many there were, counting [ev].
+  uint8_t           takeRepeats(const InputEvent& ev);
+
+public:
+  EventQueue();
+  ~EventQueue() = default;
+
+  // Nothing gets posted until this is called, so call it once setup's done
+  // with the encoder (calibration polls it directly). No [store] means a
+  // FreeRTOS queue.
+  void      begin(EventStore* store = nullptr);
+
+  // Called from the timer ISR, right after the inputs get serviced
+  void IRAM_ATTR pollSources();
+
+  // Sleeps until there's an event (or [timeout] is up) and handles it.
+  // Returns false if nothing came.
+  bool      dispatchNext(TickType_t timeout);
+
+  // Once a second or so: events, time spent handling them, and latency
+  void      logStats();
+};
+
+extern EventQueue inputEvents;
+
+#endif
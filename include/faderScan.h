@@ -0,0 +1,91 @@
+// ------------------------------------------------------------------------
+// faderScan.h
+//
+// Keeps an eye on the faders so nobody else has to. A background task
+// services the ADC at a steady rate (instead of the 1 kHz timer ISR doing
+// it), averages a few passes together, and reports a fader as moved when
+// that average changes. faders.read() is already a note number (the
+// ControllerBank has done its own smoothing and scaled it to the range),
+// so any change is a real one: no dead-band on top.
+//
+// Anybody who cares can hang on to version() and skip their work if it
+// hasn't changed; changedSince() says which faders it was.
+//
+// What's published goes out through a seqlock, so the scan task never
+// waits on a reader and readers never see half of one pass and half of
+// the next.
+// ------------------------------------------------------------------------
+#ifndef FADER_SCAN_DOT_H
+#define FADER_SCAN_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+#include "seqlock.h"
+
+const uint16_t FADER_SCAN_HZ     (1000);  // Default; tops out at the RTOS tick rate
+const uint8_t  FADER_OVERSAMPLE  (4);     // Passes averaged into each published value
+
+
+// One published set of fader values
+struct FaderFrame
+{
+  uint32_t      version;
+  uint16_t      values[NUM_FADERS];
+  uint32_t      changedAt[NUM_FADERS];    // Version each fader last moved in
+};
+
+
+class FaderScanner
+{
+  uint32_t      sums_[NUM_FADERS];
+  FaderFrame    frame_;                   // The scan task's copy
+  Seqlock<FaderFrame> published_;         // Everybody else's
+  uint8_t       samples_;
+  volatile bool restart_;
+  TickType_t    periodTicks_;
+  TaskHandle_t  taskHandle_;
+
+#ifdef RATDEBUG
+  uint32_t      passes_;
+  uint32_t      serviceMicros_;       // What faders.service() used to cost the ISR
+  uint32_t      maxServiceMicros_;
+#endif
+
+  void          publish();
+  void          rebase();
+
+public:
+  FaderScanner();
+  ~FaderScanner() = default;
+
+  // Starts the scan task; call after faders.init()
+  void      begin();
+
+  // How often the ADC gets serviced. Published values come out at
+  // 1/FADER_OVERSAMPLE of this.
+  void      setRate(uint16_t hz);
+
+  // The scan task calls this every pass; there's no need to call it yourself
+  void      scan();
+
+  // The fader bank just got switched: throw away the average in progress
+  // and publish the new bank's values on the next pass
+  void      restart();
+  TickType_t period() const;
+
+  // Bumped every time any fader moves
+  uint32_t  version() const;
+
+  uint16_t  read(uint8_t ch) const;
+
+  // Copies out all of the faders at once, and returns the version they
+  // belong to
+  uint32_t  snapshot(uint16_t vals[NUM_FADERS]) const;
+
+  // Bit per fader that has moved since [version]
+  uint8_t   changedSince(uint32_t version) const;
+};
+
+extern FaderScanner faderScan;
+
+#endif
@@ -0,0 +1,89 @@
+// ------------------------------------------------------------------------
+// hal.h
+//
+// The thin layer between the sequencer and the board: time, GPIO, ADC,
+// DAC, the shift registers, the encoder's pulse counter, and tasks. hal.cpp has two builds of it:
+//
+//   ARDUINO  - the ESP32, forwarding to the same drivers everything else
+//              uses (GPIO registers, ESP32AnalogRead, dacBatch/DacESP32,
+//              srBus, FreeRTOS)
+//   host     - plain C++: pins and ADC inputs are values you set, DAC and
+//              shift register writes are remembered so you can look at
+//              them, time only moves when you move it, and tasks are
+//              threads
+//
+// Nothing here is meant for the hot ISR paths; those still talk to the
+// hardware directly. This is for the core, and for code that has to run
+// on a PC.
+// ------------------------------------------------------------------------
+#ifndef HAL_DOT_H
+#define HAL_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+// Shift register chains, in the same order as sr_device
+const uint8_t HAL_SR_LEDS     (0);
+const uint8_t HAL_SR_TRIGGERS (1);
+const uint8_t HAL_NUM_SR      (2);
+
+// DAC channels 0 to NUM_DAC_CHANNELS - 1 are the external DAC; this one's
+// the ESP32's own 8-bit DAC
+const uint8_t HAL_INT_DAC(NUM_DAC_CHANNELS);
+
+typedef void (*HalTaskFn)(void* param);
+
+
+// Time
+uint32_t  halMicros();
+uint32_t  halMillis();
+uint32_t  halCycles();          // CPU cycle counter on the board, ns on the host
+TickType_t halTicks();          // RTOS ticks (1 ms)
+
+// GPIO
+bool      halPinRead(uint8_t pin);
+void      halPinWrite(uint8_t pin, bool high);
+uint64_t  halReadPins();        // Every input at once, bit n = GPIO n
+
+// ADC, in millivolts
+uint16_t  halAdcMv(uint8_t pin);
+
+// DAC. External channels are staged until halDacLatch(), so they all
+// change together; the internal one goes straight out.
+void      halDacWrite(uint8_t ch, uint16_t code);
+void      halDacLatch();
+
+// Shift registers (one 16 bit frame per chain)
+void      halShiftOut(uint8_t chain, uint16_t frame);
+
+// Pulse counter unit [unit] decoding a quadrature pair, every edge of
+// both lines counted. [filter] is the glitch filter, in APB cycles.
+void      halPcntBegin(uint8_t unit, uint8_t pinA, uint8_t pinB, uint16_t filter);
+int16_t   halPcntCount(uint8_t unit);
+
+// Tasks
+bool      halTaskStart(HalTaskFn fn,
+                       const char* name,
+                       uint32_t stackBytes,
+                       void* param,
+                       uint8_t priority,
+                       TaskHandle_t* handle);
+void      halDelayUntil(TickType_t& lastWake, TickType_t period);
+
+
+#ifndef ARDUINO
+// Host side of the pins/ADC/DAC/shift registers, for whoever's driving
+// the simulation
+void      halHostSetPin(uint8_t pin, bool high);
+void      halHostSetAdcMv(uint8_t pin, uint16_t mv);
+uint16_t  halHostDac(uint8_t ch);
+uint16_t  halHostShiftReg(uint8_t chain);
+uint32_t  halHostShiftCount(uint8_t chain);   // Frames sent so far
+void      halHostTurnPcnt(uint8_t unit, int16_t counts);
+
+// Host time only moves when this says so
+void      halHostAdvance(uint32_t micros);
+void      halHostSetMicros(uint32_t micros);
+#endif
+
+#endif
@@ -0,0 +1,28 @@
+// ------------------------------------------------------------------------
+// handlers.h
+//
+// What the sequencer does once an input has done something: a clock
+// edge, a reset, the encoder, an LED frame coming due (the toggle's are in
+// toggle.h). The event dispatcher calls these, and so do the polled
+// loop's handleX() in hwio.cpp. Everything they do to the hardware goes
+// through seqIO.h, so the simulator runs them too.
+// ------------------------------------------------------------------------
+#ifndef HANDLERS_DOT_H
+#define HANDLERS_DOT_H
+
+#include "platform.h"
+#include "modeCtrl.h"
+#include "clockRate.h"
+
+void onReset();
+void onClockRise(uint32_t atMicros);
+void onClockFall();
+
+// [repeats] of the same knob event in a row; steps and scrubs get rolled
+// into one move
+void onEncoder(encEvnts evt, uint8_t repeats = 1);
+void onModeCommand(const ModeCommand& cmd);
+
+void onLedFrame();
+
+#endif
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <Arduino.h>
+#include "platform.h"
 
 
 // NOTE: GPIO34 doesn't have a pullup; I had to add a HW one
@@ -29,14 +29,16 @@ const uint8_t CV_IN_B           (39);
 const uint8_t NUM_CV_INS        (4);
 const uint8_t NUM_FADERS        (8);
 const uint8_t NUM_CHANNELS      (8);
+const uint8_t NUM_TRIGGERS      (8);
 const uint8_t SAMPLE_BUFFER_SIZE(16);
 
 // const uint8_t bitLeds[]   = {1, 0, 3, 2, 5, 4, 7, 6};
 // const uint8_t fdrLeds[]   = {3, 7, 5, 4, 1, 6, 0, 2};
 
-const uint8_t sliderMap[] = {7, 6, 5, 4, 3, 2, 1, 0};
-const uint8_t trgMap   [] = {7, 6, 5, 4, 3, 2, 0, 1};
-const uint8_t regMap   [] = {3, 7, 5, 4, 1, 6, 0, 2, 9, 8, 11, 10, 13, 12, 15, 14};
+// These are baked into lookup tables at compile time; see bitPerm.h
+constexpr uint8_t sliderMap[] = {7, 6, 5, 4, 3, 2, 1, 0};
+constexpr uint8_t trgMap   [] = {7, 6, 5, 4, 3, 2, 0, 1};
+constexpr uint8_t regMap   [] = {3, 7, 5, 4, 1, 6, 0, 2, 9, 8, 11, 10, 13, 12, 15, 14};
 
 const uint8_t ENC_SENSITIVITY       (1);
 const bool    ENC_ACTIVE_LOW        (1);
@@ -46,8 +48,25 @@ const uint8_t NUM_GATES_IN          (2);
 const uint8_t GATE_PIN[NUM_GATES_IN]{CLOCK_IN, RESET_IN};
 
 const uint8_t NUM_DAC_CHANNELS(4);
+const uint16_t DAC_MAX_CODE(4095);
+
+// DAC calibration: one measured point per octave (0V, 1V, 2V...), with
+// everything in between interpolated into a per-channel note->code table
+const uint8_t  NUM_CAL_POINTS(8);
+const uint8_t  CAL_NUM_NOTES(128);
+const uint8_t  CAL_NOTES_PER_POINT(12);
+const uint16_t DAC_NOMINAL_CODES_PER_OCTAVE(819);
 
 const int8_t LOW_NOTE(0);
 const int8_t HIGH_NOTE(12);
 
+// Scenes are arranged in pages of NUM_BANKS (one per LED)
 const uint8_t NUM_BANKS             (8);
+const uint8_t NUM_SCENE_PAGES       (4);
+const uint8_t NUM_SCENES            (NUM_BANKS * NUM_SCENE_PAGES);
+
+const uint8_t MIN_OCTAVES           (1);
+const uint8_t MAX_OCTAVES           (3);
+
+// Cap on how often the panel LEDs get looked at
+const uint16_t LED_MAX_FPS          (250);
@@ -1,6 +1,6 @@
 #ifndef H_W_I_O_DOT_H
 #define H_W_I_O_DOT_H
-#include <OutputRegister.h>
+#include "srBus.h"
 #include <ESP32AnalogRead.h>
 #include <MagicButton.h>
 #include <DacESP32.h>
@@ -8,32 +8,89 @@
 #include <SharedCtrl.h>
 #include "leds.h"
 #include "hw_constants.h"
+#include "scene.h"
+#include "outConfig.h"
+#include "toggle.h"
+#include "handlers.h"
 #include <memory>
 #include "OutputDac.h"
 
 
 extern ControllerBank faders;
 
+// Fader octave range; setting it nudges the faders up/down to match
+uint8_t octaveRange();
+void    setOctaveRange(uint8_t octaves);
+
+// Four external DAC channels
+extern MultiChannelDac output;
+
+// ESP32's own 8 bit DAC
+extern DacESP32 voltsExp;
+
 // Use the onboard ADCs for external control voltage & the main control
 extern ESP32AnalogRead cvA;        // "CV" input
 extern ESP32AnalogRead cvB;        // "NOISE" input
 extern ESP32AnalogRead cvLOOP;     // "LOOP" variable resistor
+extern ESP32AnalogRead cvAUX;      // UNUSED_ANALOG; only the mod matrix looks at it
 
 // Control object for all our leds
 extern LedController panelLeds;
 
+// Everything that changes at one moment during a step
+struct TrigEvent
+{
+  uint16_t  atMs;     // After the step started
+  uint8_t   on;
+  uint8_t   off;
+};
+
+const uint8_t MAX_RATCHETS   (8);
+const uint8_t MAX_TRIG_EVENTS(NUM_TRIGGERS * MAX_RATCHETS * 2);
+
+
+// Each step's edges, for all eight outputs, are merged into one list
+// sorted by time. Only the next one is ever on the timer list; when it
+// fires, it queues up the one after.
 class Triggers
 {
   uint8_t regVal;    // Gate/Trigger outputs + yellow LEDs
-  OutputRegister<uint8_t> hw_reg;
+  BusRegister<uint8_t> hw_reg;
   uint8_t triggerLength;
 
+  TrigConfig    config_[NUM_TRIGGERS];
+  TrigEvent     events_[MAX_TRIG_EVENTS];
+  uint8_t       numEvents_;
+  uint8_t       nextEvent_;
+  uint32_t      gen_;           // Bumped every step, so stale events know to quit
+  uint32_t      frameSeq_;      // Order the frames were built in (see srBus.h)
+  uint32_t      stepMicros_;
+  portMUX_TYPE  mux_;
+
+#ifdef RATDEBUG
+  uint32_t      steps_;
+  uint32_t      maxLate_[NUM_TRIGGERS];
+#endif
+
+  void addEdge(TrigEvent* list, uint8_t& count, uint16_t atMs, uint8_t mask, bool on) const;
+  void fire(uint32_t gen);
+
 public:
   Triggers();
   // Note: you're still gonna need to clock these before these update
   void setReg(uint8_t val);
   void clock();
   void reset();
+
+  // Drops any GATE outputs that are still high
+  void clockFell();
+
+  // How long the triggers stay high, in msec
+  void    setLength(uint8_t ms);
+  uint8_t length() const;
+
+  void              configure(uint8_t out, const TrigConfig& cfg);
+  const TrigConfig& config(uint8_t out) const;
 };
 
 extern Triggers triggers;
@@ -42,11 +99,17 @@ extern Triggers triggers;
 // DAC 1: Faders & ~register
 // DAC 2: abs(DAC 1 - DAC 0)
 // DAC 3: DAC 0 if reg & BIT0 else no change from last value
-void expandVoltages(uint8_t shiftReg);
-bool newReset();
-bool newClock();
-bool clockDown();
+// (the active scene's outFlags can swap DAC 0/1 and flip the internal DAC)
+// [freshVals] skips the fader scan, for when it's behind (i.e. the bank
+// just got switched)
+void expandVoltages(uint8_t shiftReg, const uint16_t* freshVals = nullptr);
 void serviceIO();
+#ifdef RATDEBUG
+// Once a second or so: what servicing the inputs costs the timer ISR
+void logInputStats();
+#endif
+
+// Poll their inputs, and act on anything new
 void handleToggle();
 void handleReset();
 void handleClock();
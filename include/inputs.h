@@ -0,0 +1,117 @@
+// ------------------------------------------------------------------------
+// inputs.h
+//
+// Every digital input we poll, read in one go. Once per timer tick,
+// sample() grabs both GPIO input registers, packs the bits we care about
+// into one byte (active = 1), and debounces all of them at once with a
+// vertical counter: a bit only changes after INPUT_DEBOUNCE_TICKS samples
+// in a row disagree with it. Gates skip the debounce (a clock can't wait
+// 4 ms) and just get edge-detected.
+//
+// SwitchButton then does for each switch what MagicButton did, from the
+// debounced bits instead of its own digitalRead().
+//
+// Build with INPUTS_PER_PIN to go back to every library reading its own
+// pins, for comparison.
+//
+// The pins come in through halReadPins(), so this builds on the host too
+// (the simulator runs it against simulated pins).
+// ------------------------------------------------------------------------
+#ifndef INPUTS_DOT_H
+#define INPUTS_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+enum class input_bit : uint8_t {
+  CLOCK,
+  RESET,
+  TOGGLE_UP,
+  TOGGLE_DOWN,
+  ENC_SW,
+  NUM_INPUTS
+};
+
+const uint8_t NUM_INPUTS(static_cast<uint8_t>(input_bit::NUM_INPUTS));
+const uint8_t INPUT_PIN[NUM_INPUTS]{CLOCK_IN, RESET_IN, TOGGLE_UP, TOGGLE_DOWN, ENC_SW};
+
+constexpr uint8_t inputMask(input_bit bit)
+{
+  return 0x01 << static_cast<uint8_t>(bit);
+}
+
+// Gate inputs are inverted by their front end; the switches pull down
+const uint8_t INPUTS_ACTIVE_LOW(0x1F);
+const uint8_t INPUTS_DEBOUNCED (inputMask(input_bit::TOGGLE_UP)
+                              | inputMask(input_bit::TOGGLE_DOWN)
+                              | inputMask(input_bit::ENC_SW));
+const uint8_t INPUT_DEBOUNCE_TICKS(4);    // What a 2 bit vertical counter gives you
+
+const uint16_t SWITCH_DOUBLECLICK_MS(400);
+const uint16_t SWITCH_HOLD_MS       (1000);
+
+
+class InputSampler
+{
+  uint8_t           state_;     // Debounced, active = 1
+  uint8_t           cnt0_;      // Vertical counter, one bit of it per input
+  uint8_t           cnt1_;
+  uint8_t           rose_;
+  uint8_t           fell_;
+  portMUX_TYPE      mux_;
+
+  uint8_t           read() const;
+
+public:
+  InputSampler();
+  ~InputSampler() = default;
+
+  // Sets up the pins and takes the first reading (so there's no edge
+  // just for starting up)
+  void      begin();
+
+  // Once per timer tick, before anybody asks about anything
+  void IRAM_ATTR sample();
+
+  uint8_t   state() const;
+  bool      active(input_bit bit) const;
+
+  // Edges since the last time somebody asked
+  bool      takeRise(input_bit bit);
+  bool      takeFall(input_bit bit);
+};
+
+extern InputSampler inputs;
+
+// New edges on the clock and reset inputs, each taken once. These ask
+// [inputs]; with INPUTS_PER_PIN, hwio.cpp has its own that read the pins.
+bool newReset();
+bool newClock();
+bool clockDown();
+
+
+// Click/double-click/hold for a switch, off its debounced bit. Same
+// readAndFree() as MagicButton.
+class SwitchButton
+{
+  input_bit         bit_;
+  bool              down_;
+  bool              holdSent_;
+  bool              clickPending_;
+  uint16_t          downMs_;
+  uint16_t          upMs_;
+  ButtonState       pending_;
+
+  void        post(ButtonState state);
+
+public:
+  SwitchButton(input_bit bit);
+
+  // Every timer tick
+  void        service();
+
+  // Last thing that happened (or Open), and forgets it
+  ButtonState readAndFree();
+};
+
+#endif
@@ -0,0 +1,115 @@
+// ------------------------------------------------------------------------
+// journal.h
+//
+// Append-only, wear-levelled key/record log living in raw flash.
+//
+// Every write goes into the next free fixed-size slot, tagged with a
+// sequence number and CRC, so the flash gets worn evenly and a write that's
+// interrupted by a power cut just leaves a slot that fails its CRC. At
+// mount time the newest valid record for each key wins.
+//
+// Before the head runs into the oldest sector, any records there that are
+// still current get copied forward, so erasing it never loses anything.
+//
+// Erasing a sector is the slow part (tens of ms, with the flash cache
+// stalled on both cores the whole time), so the owner gets to do it ahead
+// of time with prepareSpare(), when it suits. append() only erases for
+// itself if the head fills up before anybody did.
+// ------------------------------------------------------------------------
+#ifndef JOURNAL_DOT_H
+#define JOURNAL_DOT_H
+
+#include <cstdint>
+#include <cstddef>
+
+const uint16_t JOURNAL_SECTOR_SIZE(4096);
+const uint8_t  JOURNAL_NUM_SECTORS(8);
+const uint8_t  JOURNAL_SLOT_SIZE  (64);
+const uint8_t  JOURNAL_MAX_KEYS   (48);
+const uint16_t JOURNAL_SLOTS_PER_SECTOR(JOURNAL_SECTOR_SIZE / JOURNAL_SLOT_SIZE);
+
+struct JournalHeader
+{
+  uint32_t seq;
+  uint16_t magic;
+  uint8_t  key;
+  uint8_t  len;
+  uint32_t crc;     // Covers everything above plus [len] bytes of payload
+};
+
+const uint8_t JOURNAL_MAX_PAYLOAD(JOURNAL_SLOT_SIZE - sizeof(JournalHeader));
+
+
+class FlashJournal
+{
+  struct IndexEntry
+  {
+    bool      valid;
+    uint16_t  slot;   // Absolute slot number (sector * slots per sector + n)
+    uint32_t  seq;
+  };
+
+  IndexEntry  index_[JOURNAL_MAX_KEYS];
+
+  const void* partition_;
+  bool        mounted_;
+  uint8_t     headSector_;
+  uint16_t    headSlot_;    // Next free slot within headSector_
+  uint32_t    nextSeq_;
+
+  bool        spareReady_; // The sector after the head is erased and empty
+
+  uint32_t    lastCommitMicros_;
+  uint32_t    maxCommitMicros_;
+  uint32_t    lastEraseMicros_;
+
+  bool        readSlot (uint16_t slot, uint8_t* buf) const;
+  bool        writeSlot(uint16_t slot, const uint8_t* buf);
+  bool        eraseSector(uint8_t sector);
+
+  bool        slotIsValid(const uint8_t* buf) const;
+  bool        sectorIsErased(uint8_t sector) const;
+  uint8_t     liveIn(uint8_t sector) const;
+  bool        writeRecord(uint8_t key, const void* buf, uint8_t len);
+  void        relocate(uint8_t sector);
+  void        advance();
+
+public:
+  FlashJournal();
+  ~FlashJournal() = default;
+
+  // Scans the journal and rebuilds the in-RAM index. If there's nothing
+  // recognizable in there, the whole area gets erased.
+  bool        mount();
+
+  // Copies the newest record for [key] into [buf]. Returns false if there
+  // isn't one or its length doesn't match
+  bool        read(uint8_t key, void* buf, uint8_t len) const;
+
+  // Writes a new record for [key]; this touches flash, so don't call it
+  // from anywhere time-critical
+  bool        append(uint8_t key, const void* buf, uint8_t len);
+
+  // Gets the sector after the head erased (moving anything live out of it
+  // first), so the head can move on into it without waiting. Returns true
+  // if there's one ready.
+  bool        prepareSpare();
+  bool        spareReady() const;
+
+  uint32_t    lastCommitMicros() const;
+  uint32_t    maxCommitMicros()  const;
+  uint32_t    lastEraseMicros()  const;
+};
+
+#ifndef ARDUINO
+// Host only: pulls the plug [ops] flash writes/erases from now (0 never).
+// That one only gets partway, and everything after it fails, until the
+// next mount() (which is the power coming back).
+void journalHostCutPower(uint32_t ops, uint32_t seed);
+
+// Host only: the next [writes] slot writes fail without touching the
+// flash at all, like a write the driver turned down. The power stays on.
+void journalHostFailWrites(uint32_t writes);
+#endif
+
+#endif
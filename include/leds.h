@@ -3,27 +3,66 @@
 #include <Arduino.h>
 #include "setup.h"
 #include <functional>
-#include "OutputRegister.h"
+#include "bcm.h"
+
+
+// Everything a frame depends on. If none of it has changed, neither has
+// the frame.
+struct LedInputs
+{
+  uint8_t   output;
+  uint8_t   lockByte;
+  uint8_t   len;
+  uint8_t   scene;
+  int8_t    slot;
+  mode_type mode;
+  bool      enabled;
+};
 
 
 // Updates main horizontal LED array to display current pattern (in
 // performance mode) or status (in one of the editing modes)
 class LedController
 {
-  void setFaderReg();
-  void setMainReg();
+  void setFaderReg(const LedInputs& in);
+  void setMainReg(const LedInputs& in);
+  void gather(LedInputs& in) const;
+  void render();
+
+  // Sets the 8 LEDs in byte [idx] (0 = faders, 1 = main row): set bits in
+  // [bits] get [on], the rest get [off]
+  void setByte(uint8_t idx, uint8_t bits, uint8_t on = LED_FULL, uint8_t off = LED_OFF);
 
   long long resetBlankTime;
-  // Hardware interfaces for 74HC595
-  OutputRegister<uint16_t> hw_reg;
+  // Brightness of each LED, by register bit; bcmLeds does the rest
+  uint8_t levels_[NUM_PANEL_LEDS];
   bool enabled;
 
+  LedInputs last_;
+  bool      dirty_;       // Force the next render, whatever the inputs say
+  uint32_t  lastFrameMicros_;
+
+#ifdef RATDEBUG
+  uint32_t  renders_;
+  uint32_t  busyMicros_;
+#endif
+
 public:
   LedController();
+
+  // Cheap enough to call every pass through loop(); only redraws if it's
+  // been long enough and something changed
   void updateAll();
   void blinkOut();
+
+  // Every step: redraws right away (if anything changed)
   void clock(bool reset = false);
 
+#ifdef RATDEBUG
+  // Renders and time spent rendering since the last call
+  void takeStats(uint32_t& renders, uint32_t& busyMicros);
+#endif
+
   // TODO...
   void setMain_1(uint8_t bit, bool on = true);
   void setFader_1(uint8_t bit, bool on = true);
@@ -0,0 +1,34 @@
+// ------------------------------------------------------------------------
+// modDuty.h
+//
+// The arithmetic behind the PWM mod outputs (modOuts.h): turning a value
+// into a duty cycle, and the step into a position in the loop. Nothing
+// here touches the LEDC, so it builds on the host too.
+// ------------------------------------------------------------------------
+#ifndef MOD_DUTY_DOT_H
+#define MOD_DUTY_DOT_H
+
+#include "platform.h"
+
+const uint8_t  MOD_PWM_BITS     (12);
+const uint16_t MOD_DUTY_MAX     ((1 << MOD_PWM_BITS) - 1);
+
+
+// [val] out of [fullScale] as a duty cycle, rounded to nearest
+constexpr uint16_t modDuty(uint32_t val, uint32_t fullScale)
+{
+  return (fullScale == 0) ? 0
+       : (val >= fullScale) ? MOD_DUTY_MAX
+       : (uint16_t)((val * MOD_DUTY_MAX + fullScale / 2) / fullScale);
+}
+
+
+// Going backwards the step counts down through negative numbers (-1 is
+// the last step); this brings it round to 0..length - 1. A zero length
+// leaves it be.
+constexpr int8_t modLoopStep(int8_t offset, uint8_t length)
+{
+  return length ? (int8_t)((offset % length + length) % length) : offset;
+}
+
+#endif
@@ -0,0 +1,111 @@
+// ------------------------------------------------------------------------
+// modMatrix.h
+//
+// Routes the CV inputs to things that are otherwise only on the panel. A
+// background task keeps a fresh reading of every input, so working out
+// the routes on a step is a handful of multiplies, no matter how slow the
+// ADCs are.
+//
+// Each route adds (level * amount) + offset to its destination, where
+// level runs 0-1 (Q12) across the input's range and amount/offset are in
+// the destination's own units:
+//   LOOP_LENGTH   - length index (see STEP_LENGTH_VALS)
+//   FADER_BANK    - fader banks
+//   FLIP_PROB     - mV, added to the LOOP knob
+//   TRIG_LENGTH   - msec
+//   OCTAVE_RANGE  - octaves
+// Everything is relative to what the active scene says.
+// ------------------------------------------------------------------------
+#ifndef MOD_MATRIX_DOT_H
+#define MOD_MATRIX_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+
+enum class mod_src {
+  CV_A,           // "CV" input
+  CV_B,           // "NOISE" input
+  AUX,            // UNUSED_ANALOG
+  LOOP,           // The LOOP knob; sampled for the stochasticizer, not routable
+  NUM_SOURCES
+};
+
+enum class mod_dest {
+  LOOP_LENGTH,
+  FADER_BANK,
+  FLIP_PROB,
+  TRIG_LENGTH,
+  OCTAVE_RANGE,
+  NUM_DESTS
+};
+
+const uint8_t  NUM_MOD_SOURCES   (static_cast<uint8_t>(mod_src::NUM_SOURCES));
+const uint8_t  MOD_SRC_PIN[NUM_MOD_SOURCES]{CV_IN_A, CV_IN_B, UNUSED_ANALOG, LOOP_CTRL};
+const uint8_t  NUM_MOD_DESTS     (static_cast<uint8_t>(mod_dest::NUM_DESTS));
+const uint8_t  MAX_MOD_ROUTES    (8);
+const uint16_t MOD_SAMPLE_HZ     (500);
+const uint16_t MOD_FULL_SCALE_MV (3300);
+const uint16_t MOD_LEVEL_ONE     (4096);    // Q12
+
+struct ModRoute
+{
+  mod_src   src;
+  mod_dest  dest;
+  int16_t   amount;
+  int16_t   offset;
+};
+
+// What a step's worth of routes adds up to
+struct ModValues
+{
+  int16_t   amount[NUM_MOD_DESTS];
+  uint8_t   touched;    // Bit per mod_dest that has at least one route
+};
+
+
+class ModMatrix
+{
+  ModRoute      routes_[MAX_MOD_ROUTES];
+  uint8_t       numRoutes_;
+  uint16_t      mv_   [NUM_MOD_SOURCES];
+  uint16_t      level_[NUM_MOD_SOURCES];    // Q12
+  uint16_t      edgeMv_[NUM_MOD_SOURCES];   // Read on the clock edge (CV A & B only)
+  bool          atEdge_;
+  TaskHandle_t  taskHandle_;
+  mutable portMUX_TYPE mux_;
+
+public:
+  ModMatrix();
+  ~ModMatrix() = default;
+
+  // Takes a first reading of everything, then starts the sampling task
+  void      begin();
+
+  // The sampling task calls this; there's no need to call it yourself
+  void      sample();
+
+  // Returns the new route's index, or -1 if they're all taken
+  int8_t    addRoute(const ModRoute& route);
+  void      removeRoute(uint8_t idx);
+  void      clearRoutes();
+  uint8_t   numRoutes() const;
+
+  // Latest readings; neither one waits on an ADC
+  uint16_t  millivolts(mod_src src) const;
+  uint16_t  level(mod_src src) const;
+
+  // A clock edge reads CV A (coin toss) and CV B (shift direction) straight
+  // off the pins, so the step it makes sees them as they were on the edge
+  // rather than up to a sample period earlier. Until endEdge(),
+  // stepMillivolts() gives those; the routes stay on the sampled readings.
+  void      sampleEdge();
+  void      endEdge();
+  uint16_t  stepMillivolts(mod_src src) const;
+
+  // Once per step. Only looks at the routes that exist.
+  void      evaluate(ModValues& vals) const;
+};
+
+extern ModMatrix modMatrix;
+
+#endif
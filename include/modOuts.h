@@ -0,0 +1,60 @@
+// ------------------------------------------------------------------------
+// modOuts.h
+//
+// The four PWM_OUT pins, driven by the LEDC peripheral as extra CV outputs
+// (after an RC filter). The hardware does the PWM; all we ever do is
+// write a new duty.
+//
+//  0: Density - how many bits of the register are set
+//  1: Phase   - ramps from 0 to full over one loop
+//  2: LFO     - triangle, once per loop, tracking the incoming clock
+//  3: High    - the top byte of the register, as a stepped voltage
+// ------------------------------------------------------------------------
+#ifndef MOD_OUTS_DOT_H
+#define MOD_OUTS_DOT_H
+
+#include <Arduino.h>
+#include "hw_constants.h"
+#include "modDuty.h"
+
+const uint8_t  NUM_MOD_OUTS     (4);
+const uint8_t  MOD_LEDC_CHANNEL (0);      // First of four
+const uint32_t MOD_PWM_HZ       (19531);  // 80 MHz / 4096
+
+enum mod_out {
+  MOD_DENSITY,
+  MOD_PHASE,
+  MOD_LFO,
+  MOD_HIGH
+};
+
+
+class ModOutputs
+{
+  volatile uint32_t phase_;       // LFO phase, full circle = 2^32
+  volatile uint32_t phaseInc_;    // Per slew tick
+  volatile bool     resync_;
+
+#ifdef RATDEBUG
+  uint32_t          steps_;
+  uint32_t          lastCycles_;
+  uint32_t          maxCycles_;
+#endif
+
+public:
+  ModOutputs();
+  ~ModOutputs() = default;
+
+  void begin();
+
+  // Every step: density, phase and high byte, plus the LFO's speed.
+  // [offset] is the step as the transport has it, negative or not.
+  void step(uint16_t reg, int8_t offset, uint8_t length, uint32_t clockMicros);
+
+  // Runs the LFO; called at SLEW_RATE_HZ
+  void tick();
+};
+
+extern ModOutputs modOuts;
+
+#endif
@@ -8,20 +8,28 @@ edit length + click -> return to performance
 
 performance mode + double click -> show pattern selection
 show selection + encoder -> selectActiveBank next pattern
+show selection + shift + encoder -> flip to the next/previous page of scenes
 show selection + double click -> change to next pattern and return to performance
 
 performance mode + hold -> show save slot
 show save slot + encoder -> select save slot
+show save slot + shift + encoder -> flip to the next/previous page of scenes
 show save slot + hold -> save current pattern/settings to selected slot and return to performance
 
 performance mode + encoder -> clock the sequencer fwd/rev
+performance mode + shift + encoder -> scrub back/forward through step history
+performance mode + click-hold -> toggle retrograde (clocks play history backwards)
 
 standard + shift + encoder -> rotate pattern register without advancing step counter
 */
 #ifndef MODE_CTRL_DOT_H
 #define MODE_CTRL_DOT_H
-#include <ClickEncoderInterface.h>
+#include "platform.h"
 #include "hw_constants.h"
+#include "pcntEncoder.h"
+#ifdef ENC_POLLED
+#include <ClickEncoderInterface.h>
+#endif
 
 
 enum class command_enum {
@@ -31,6 +39,12 @@ enum class command_enum {
   LENGTH,
   CHANGEMODE,
   LEDS,
+  SCRUB,
+  RETROGRADE,
+  CAL_TRIM,
+  CAL_COARSE,
+  CAL_CHANNEL,
+  CAL_DONE,
   NO_CMD
 };
 
@@ -40,6 +54,20 @@ struct ModeCommand
   int8_t val;
 };
 
+// Most detents that get rolled into one command
+const uint8_t MAX_ENC_BURST(32);
+
+// After the button's let go, long enough for its last events to come out
+// (a double-click can't still be pending after this)
+const uint16_t ENC_RELEASE_SETTLE_MS(ENC_DOUBLECLICK_MS + 50);
+
+// Knob events; a run of the same one can be handled as one bigger move
+inline bool isTurn(encEvnts evt)
+{
+  return evt == encEvnts::Right     || evt == encEvnts::Left
+      || evt == encEvnts::ShiftRight || evt == encEvnts::ShiftLeft;
+}
+
 
 // Different editing/playback modes for our rotary encoder
 enum class mode_type {
@@ -47,6 +75,7 @@ enum class mode_type {
   CHANGE_LENGTH_MODE,
   PATTERN_SAVE_MODE,
   PATTERN_LOAD_MODE,
+  CALIBRATION_MODE,
   CANCEL,
   NUM_MODES
 };
@@ -54,17 +83,36 @@ enum class mode_type {
 
 class ModeControl
 {
+#ifdef ENC_POLLED
   // This is the device driver for our rotary encoder
   ClickEncoder encoder_;
 
   // And this is the interface to the encoder's device driver
   ClickEncoderInterface encoderInterface_;
+#else
+  // Pulse counter does the knob, this does the button & the events
+  PcntEncoder encoder_;
+  uint8_t     serviceTicks_;
+#endif
+
+#ifdef RATDEBUG
+  uint32_t    serviceCycles_;
+  uint32_t    serviceCalls_;
+#endif
 
+  // Scene indices; slot within the page is (idx % NUM_BANKS)
   int8_t loadSlot_;
   int8_t saveSlot_;
 
+  // Moves [slot] around within its page, or to the same slot on another page
+  void stepSlot(int8_t& slot, int8_t amt);
+  void stepPage(int8_t& slot, int8_t amt);
+
   mode_type currentMode_;
 
+  // Straight off the pin (or the input sampler), not debounced
+  bool buttonDown() const;
+
   ModeCommand hold();
   ModeCommand left();
   ModeCommand click();
@@ -76,6 +124,7 @@ class ModeControl
   ModeCommand doubleclick();
 
 public:
+#ifdef ENC_POLLED
   ModeControl():
     encoder_(ClickEncoder(
       ENC_A,
@@ -86,14 +135,53 @@ public:
     encoderInterface_(ClickEncoderInterface(
       encoder_,
       ENC_SENSITIVITY))
+#else
+  ModeControl():
+    encoder_(
+      ENC_A,
+      ENC_B,
+      ENC_STEPS_PER_NOTCH),
+    serviceTicks_(0)
+#endif
+#ifdef RATDEBUG
+    , serviceCycles_(0)
+    , serviceCalls_(0)
+#endif
   {
     ;
   }
 
+  // Sets up the encoder hardware
+  void begin();
+
   void cancel();
+
+  // Every tick of the 1 kHz timer
   void service();
+
+#ifdef RATDEBUG
+  // Encoder servicing cost per timer tick, and how the knob's been treated
+  void logStats();
+#endif
+
+  // Waits for the button to be let go (it's how you get into calibration)
+  // and drops anything it left queued before switching to CALIBRATION_MODE
+  void startCalibration();
   int8_t activeSlot();
+  int8_t activePage();
+
+  // Polls the encoder and acts on whatever it had
   ModeCommand update();
+
+  // Same thing in two halves, for when something else does the polling:
+  // pollEncoder() just takes the event (and is fine to call from the timer
+  // ISR), handle() acts on it
+  encEvnts pollEncoder();
+  ModeCommand handle(encEvnts evt);
+
+  // What pollEncoder() would give you next, without taking it (always
+  // NUM_ENC_EVNTS with ENC_POLLED, which can't look ahead)
+  encEvnts peekEncoder();
   mode_type currentMode();
   bool performing();
 };
@@ -0,0 +1,32 @@
+// ------------------------------------------------------------------------
+// nvstore.h
+//
+// Tiny key/blob store for settings that need to survive a power cycle.
+// On the ESP32 this sits on top of NVS (via Preferences); on a host build
+// each key is just a file under TMOC_NVS_DIR (or ./nvs if that's not set),
+// which gets created on the first store() if it isn't there
+// ------------------------------------------------------------------------
+#ifndef NV_STORE_DOT_H
+#define NV_STORE_DOT_H
+
+#include <cstdint>
+#include <cstddef>
+
+
+class NvStore
+{
+  const char* namespace_;
+
+public:
+  explicit NvStore(const char* nameSpace);
+  ~NvStore() = default;
+
+  // Copies exactly [len] bytes stored under [key] into [buf]. Returns false
+  // (and leaves [buf] alone) if the key is missing or the size doesn't match
+  bool load(const char* key, void* buf, size_t len) const;
+
+  // Returns true if all [len] bytes made it into non-volatile storage
+  bool store(const char* key, const void* buf, size_t len);
+};
+
+#endif
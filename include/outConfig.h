@@ -0,0 +1,50 @@
+// ------------------------------------------------------------------------
+// outConfig.h
+//
+// How each output behaves, as saved with a scene: what each trigger
+// output does when its bit comes up (Triggers, in hwio.h), and whether
+// and how each external DAC channel glides (SlewEngine, in slew.h).
+// ------------------------------------------------------------------------
+#ifndef OUT_CONFIG_DOT_H
+#define OUT_CONFIG_DOT_H
+
+#include "platform.h"
+
+// What each trigger output does when its bit comes up
+enum class trig_mode : uint8_t {
+  TRIGGER,      // High for [param] msec (0 = the shared trigger length)
+  GATE,         // High until the clock input falls
+  TIE,          // High until the next step
+  CLOCK_PCT,    // High for [param] percent of the clock period
+  RATCHET       // [param] triggers spread evenly across the step
+};
+
+struct TrigConfig
+{
+  trig_mode mode;
+  uint8_t   param;
+};
+
+enum class slew_curve : uint8_t {
+  LINEAR,
+  EXPONENTIAL
+};
+
+enum class glide_mode : uint8_t {
+  OFF,
+  ALWAYS,
+  REGISTER      // Only when SlewConfig::bit of the register is set
+};
+
+struct SlewConfig
+{
+  uint16_t    glideMs;
+  slew_curve  curve;
+  glide_mode  mode;
+  uint8_t     bit;
+};
+
+const TrigConfig DEFAULT_TRIG_CONFIG {trig_mode::TRIGGER, 0};
+const SlewConfig DEFAULT_SLEW_CONFIG {50, slew_curve::LINEAR, glide_mode::OFF, 0};
+
+#endif
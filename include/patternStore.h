@@ -0,0 +1,85 @@
+// ------------------------------------------------------------------------
+// patternStore.h
+//
+// Keeps saved scenes in flash. Saving just updates a RAM copy and flags
+// the scene as dirty; a low-priority task does the actual flash write
+// later, so hitting SAVE never holds up the clock. A write that fails
+// leaves the scene dirty, and it gets another go the next time the task
+// wakes up.
+//
+// The fader positions aren't saved. ControllerBank has no way to have a
+// bank's values put back at boot, so a snapshot could only ever be
+// written, never restored; the faders come up wherever they physically
+// are.
+//
+// The same task erases the journal's next sector ahead of time, when a
+// clock edge can't land in the middle of it: straight after an edge, if
+// the clock's slower than STORE_ERASE_MICROS, or once it's stopped. That
+// erase stalls the flash cache (both cores) for tens of ms. With a clock
+// that's faster than that and never stops, there's no such window; the
+// sector gets erased when the head runs into it (one save in every
+// JOURNAL_SLOTS_PER_SECTOR or so), and edges arriving during it are late
+// by up to the erase time.
+// ------------------------------------------------------------------------
+#ifndef PATTERN_STORE_DOT_H
+#define PATTERN_STORE_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+#include "journal.h"
+#include "scene.h"
+
+
+// Pretty much allowing 50% over the typical 4 KB sector erase
+const uint32_t STORE_ERASE_MICROS   (70000UL);
+const uint16_t STORE_POLL_MS        (20);     // How often the task looks for an erase window
+
+struct SceneRecord
+{
+  Scene    scene;
+};
+
+static_assert(sizeof(SceneRecord) <= JOURNAL_MAX_PAYLOAD,
+              "SceneRecord won't fit in a journal slot");
+static_assert(NUM_SCENES <= JOURNAL_MAX_KEYS,
+              "Not enough journal keys for every scene");
+
+
+class PatternStore
+{
+  FlashJournal  journal_;
+  SceneRecord   records_[NUM_SCENES];
+  uint32_t      persisted_;   // Bit n set if scene n came out of flash
+  uint32_t      dirty_;       // Bit n set if scene n needs writing
+
+  TaskHandle_t  taskHandle_;
+  portMUX_TYPE  mux_;
+
+public:
+  PatternStore();
+  ~PatternStore() = default;
+
+  // Mounts the journal, pulls in whatever was saved and starts the writer
+  void begin();
+
+  // Copies the saved record for [scene] into [rec]. Returns false if that
+  // scene has never been saved
+  bool restore(uint8_t scene, SceneRecord& rec) const;
+
+  // Queues [rec] to be written to flash. Safe to call from anywhere but an ISR
+  void save(uint8_t scene, const SceneRecord& rec);
+
+  // Writes out everything that's been queued, and gets the next journal
+  // sector erased if now's a good time. The writer task calls these;
+  // there's no need to call them yourself (except on the host, where
+  // there's no writer task)
+  void commitPending();
+  void prepareSpare();
+
+  uint32_t lastCommitMicros() const;
+  uint32_t maxCommitMicros()  const;
+};
+
+extern PatternStore patternStore;
+
+#endif
@@ -0,0 +1,92 @@
+// ------------------------------------------------------------------------
+// pcntEncoder.h
+//
+// The encoder's A/B lines go to one of the ESP32's pulse counters, which
+// decodes the quadrature in hardware (with its glitch filter on), so no
+// edge gets missed no matter how fast the knob spins or how busy we are.
+// All that's left for software is the button, and turning counter deltas
+// into the same encEvnts that ClickEncoderInterface hands out; that runs
+// every ENC_SERVICE_MS instead of every millisecond. The counter's read
+// through hal.h, so this builds (and gets tested) on the host too.
+//
+//   Right/Left            - one per detent
+//   ShiftRight/ShiftLeft  - one per detent, turned with the button down
+//   Press                 - button went down
+//   Click                 - short press (once the double-click window's up)
+//   DblClick              - two short presses inside ENC_DOUBLECLICK_MS
+//   Hold                  - held for ENC_HOLD_MS without turning
+//   ClickHold             - a short press, then a hold
+//
+// Build with ENC_POLLED to go back to ClickEncoder polling the pins.
+// ------------------------------------------------------------------------
+#ifndef PCNT_ENCODER_DOT_H
+#define PCNT_ENCODER_DOT_H
+
+#include "platform.h"
+
+const uint8_t  ENC_SERVICE_MS       (5);
+const uint16_t ENC_DOUBLECLICK_MS   (400);
+const uint16_t ENC_HOLD_MS          (1000);
+const uint16_t ENC_GLITCH_FILTER    (1023);   // APB cycles (12.8 us), the most it'll take
+const uint8_t  ENC_EVENT_QUEUE      (16);
+
+
+struct EncoderStats
+{
+  uint32_t detents;
+  uint32_t torn;          // Knob came to rest between detents: an edge went missing
+  uint16_t maxPerService; // Most detents seen in one service (i.e. how fast it got spun)
+};
+
+
+class PcntEncoder
+{
+  uint8_t           unit_;
+  uint8_t           pinA_;
+  uint8_t           pinB_;
+  uint8_t           countsPerDetent_;
+
+  int16_t           lastCount_;
+  int16_t           partial_;       // Counts towards the next detent
+  uint16_t          idleMs_;
+
+  bool              down_;
+  bool              turned_;        // Knob moved since the button went down
+  bool              holdSent_;
+  bool              clickPending_;  // A short press that might become a double
+  uint16_t          downMs_;
+  uint16_t          upMs_;
+
+  encEvnts          queue_[ENC_EVENT_QUEUE];
+  volatile uint8_t  head_;
+  volatile uint8_t  tail_;
+
+  EncoderStats      stats_;
+
+  void              push(encEvnts evt);
+  void              serviceKnob();
+  void              serviceButton(bool down);
+
+public:
+  PcntEncoder(uint8_t pinA,
+              uint8_t pinB,
+              uint8_t countsPerDetent,
+              uint8_t unit = 0);
+
+  // Sets up the pulse counter; call once from setup
+  void      begin();
+
+  // Every ENC_SERVICE_MS, from the timer ISR. [buttonDown] comes from
+  // whoever's reading the switch.
+  void      service(bool buttonDown);
+
+  // Next event, or NUM_ENC_EVNTS if there isn't one
+  encEvnts  getEvent();
+
+  // Same, but leaves it there
+  encEvnts  peekEvent() const;
+
+  const EncoderStats& stats() const;
+};
+
+#endif
@@ -0,0 +1,136 @@
+// ------------------------------------------------------------------------
+// platform.h
+//
+// The bits of Arduino (and RatFuncs, the button/encoder event types, and
+// FreeRTOS types) that the sequencer core leans on. On the board it's just the real headers. On a
+// host build (no ARDUINO) it's plain C++ stand-ins, so the core compiles
+// and runs on a PC; anything that actually touches hardware goes through
+// hal.h instead.
+//
+// Only core code includes this. Drivers keep including <Arduino.h>; they
+// don't build on the host and aren't meant to.
+// ------------------------------------------------------------------------
+#ifndef PLATFORM_DOT_H
+#define PLATFORM_DOT_H
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <RatFuncs.h>
+#include <MagicButton.h>
+#include <ClickEncoderInterface.h>
+
+#else // Host build
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <atomic>
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#define bitRead(value, bit)             (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit)              ((value) |= (1UL << (bit)))
+#define bitClear(value, bit)            ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue)  ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define constrain(amt, low, high)       ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define BIT0 0x01
+#define BIT1 0x02
+#define BIT2 0x04
+#define BIT3 0x08
+#define BIT4 0x10
+#define BIT5 0x20
+#define BIT6 0x40
+#define BIT7 0x80
+
+// Same as Arduino's: [0, howbig) and [howsmall, howbig). Seeded with
+// randomSeed() like the real one, so host runs can be repeated.
+void randomSeed(unsigned long seed);
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+#ifdef RATDEBUG
+#define dbprintf(...)   printf(__VA_ARGS__)
+#define dbprintln(x)    puts(x)
+#else
+#define dbprintf(...)
+#define dbprintln(x)
+#endif
+
+void printBits(uint8_t bits);
+
+// MagicButton's and ClickEncoderInterface's, which aren't around either
+enum class ButtonState : uint8_t
+{
+  Open,
+  Closed,
+  Pressed,
+  Held,
+  Released,
+  Clicked,
+  DoubleClicked
+};
+
+enum class encEvnts : uint8_t
+{
+  Click,
+  DblClick,
+  Hold,
+  ClickHold,
+  Press,
+  Left,
+  Right,
+  ShiftLeft,
+  ShiftRight,
+  NUM_ENC_EVNTS
+};
+
+// FreeRTOS types that show up in core headers
+typedef void*     TaskHandle_t;
+typedef void*     QueueHandle_t;
+typedef uint32_t  TickType_t;
+
+// Ticks are 1 ms, same as the board's
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+// Critical sections are a spinlock; there's no interrupt masking to do
+struct portMUX_TYPE
+{
+  std::atomic_flag  locked = ATOMIC_FLAG_INIT;
+  portMUX_TYPE() = default;
+  portMUX_TYPE(const portMUX_TYPE&) { ; }
+  portMUX_TYPE& operator=(const portMUX_TYPE&) { return *this; }
+};
+
+#define portMUX_INITIALIZER_UNLOCKED    portMUX_TYPE{}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux)
+{
+  while (mux->locked.test_and_set(std::memory_order_acquire))
+  {
+    ;
+  }
+}
+
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux)
+{
+  mux->locked.clear(std::memory_order_release);
+}
+
+#define portENTER_CRITICAL_ISR    portENTER_CRITICAL
+#define portEXIT_CRITICAL_ISR     portEXIT_CRITICAL
+#define portENTER_CRITICAL_SAFE   portENTER_CRITICAL
+#define portEXIT_CRITICAL_SAFE    portEXIT_CRITICAL
+
+void vTaskDelay(TickType_t ticks);
+
+#endif
+
+#endif
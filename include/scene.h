@@ -0,0 +1,38 @@
+// ------------------------------------------------------------------------
+// scene.h
+//
+// Everything that makes a pattern sound the way it does, in one record:
+// the register, loop length, which fader bank goes with it, the fader
+// octave range, how the outputs are wired up, and what the triggers and
+// glides do. Switching scenes just points the sequencer at a different
+// one of these.
+// ------------------------------------------------------------------------
+#ifndef SCENE_DOT_H
+#define SCENE_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+#include "outConfig.h"
+
+// Scene::outFlags
+const uint8_t OUT_SWAP_AB       (0x01);   // Swap CV A and CV B
+const uint8_t OUT_INT_DAC_TRUE  (0x02);   // Internal DAC gets the register, not its inverse
+
+const uint8_t DEFAULT_TRIGGER_MS(10);
+
+struct Scene
+{
+  uint16_t reg;
+  uint8_t  lengthIdx;     // Index into STEP_LENGTH_VALS
+  uint8_t  faderBank;
+  uint8_t  range;         // Fader octave range
+  uint8_t  outFlags;
+  uint8_t  trigMs;        // Trigger length
+  uint8_t  spare;
+  TrigConfig trig[NUM_TRIGGERS];          // What each trigger output does
+  SlewConfig glide[NUM_DAC_CHANNELS];     // How each external DAC channel glides
+};
+
+static_assert(sizeof(Scene) == 48, "Keep scenes small");
+
+#endif
@@ -0,0 +1,74 @@
+// ------------------------------------------------------------------------
+// seqIO.h
+//
+// Everything TuringRegister asks of the rest of the module, in one list,
+// so the sequencer core doesn't have to know about faders, triggers, the
+// mod matrix, flash or RTC memory.
+//
+// seqIO.cpp has two builds: on the board these go straight to the real
+// things (faders, triggers, modMatrix, patternStore, warmStart...); on a
+// host build they go to a stand-in board made of HAL calls, which is
+// enough to run the sequencer headless.
+// ------------------------------------------------------------------------
+#ifndef SEQ_IO_DOT_H
+#define SEQ_IO_DOT_H
+
+#include "platform.h"
+#include "hw_constants.h"
+#include "modMatrix.h"
+#include "outConfig.h"
+#include "patternStore.h"
+#include "warmStart.h"
+
+// Everything that goes out once a step has happened
+struct StepOutputs
+{
+  uint16_t        reg;
+  int8_t          step;
+  uint8_t         length;
+  bool            reset;
+  const uint16_t* freshFaders;    // Straight from the bank (it just got switched), or nullptr
+};
+
+
+// Faders
+void      ioSelectFaderBank(uint8_t bank);
+void      ioReadFaders(uint16_t vals[NUM_FADERS]);
+void      ioSaveFaderBank(uint8_t bank);
+
+// Scene settings that live in hardware. The output config is what each
+// trigger output does and how each external DAC channel glides.
+void      ioSetRange(uint8_t octaves);
+uint8_t   ioRange();
+void      ioSetTrigLength(uint8_t ms);
+uint8_t   ioTrigLength();
+void      ioSetOutputConfig(const TrigConfig trig[NUM_TRIGGERS],
+                            const SlewConfig glide[NUM_DAC_CHANNELS]);
+
+// This step's modulation, plus the LOOP knob and CV A for the coin toss
+void      ioModulation(ModValues& mods, uint32_t& loopMv, uint32_t& cvMv);
+
+// CVs, triggers, mod outs and LEDs
+void      ioStep(const StepOutputs& out);
+
+// The clock input fell (GATE outputs end here), and the LEDs are due
+// another look
+void      ioClockFell();
+void      ioLedFrame();
+
+// Saved scenes and the warm start copy
+bool      ioRestoreScene(uint8_t idx, SceneRecord& rec);
+void      ioSaveScene(uint8_t idx, const SceneRecord& rec);
+void      ioWarmSync(const WarmSnapshot& snap);
+void      ioFirstStep();
+
+#ifndef ARDUINO
+// Host only: sets fader [ch] in [bank] on the stand-in board, and reads
+// back the fader values the last ioStep() used. [mask] picks the trigger
+// outputs that act as gates, i.e. stay high until the clock falls.
+void      ioHostSetFader(uint8_t bank, uint8_t ch, uint16_t val);
+void      ioHostStepFaders(uint16_t vals[NUM_FADERS]);
+void      ioHostSetGates(uint8_t mask);
+#endif
+
+#endif
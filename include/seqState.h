@@ -0,0 +1,86 @@
+// ------------------------------------------------------------------------
+// seqState.h
+//
+// Everything a step reads or writes, in one place. It used to be spread
+// over TuringRegister, TransportParams (five bools, a ShiftParams and an
+// iterator into STEP_LENGTH_VALS), and a Stochasticizer that got copied
+// into every step by value. Now it's one plain struct that fits in a
+// single 32-byte line, and everybody gets handed a reference to it.
+//
+// Keep it trivially copyable, so a snapshot of the whole sequencer is
+// just a copy.
+// ------------------------------------------------------------------------
+#ifndef SEQ_STATE_DOT_H
+#define SEQ_STATE_DOT_H
+
+#include "platform.h"
+#include <type_traits>
+#include "ShiftParams.h"
+
+const uint8_t NUM_STEP_LENGTHS(13);
+const uint8_t DEFAULT_LENGTH_IDX(6);   // 8 steps
+
+const uint8_t STEP_LENGTH_VALS[NUM_STEP_LENGTHS]{2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 15, 16};
+
+// SeqState::flags
+const uint8_t SEQ_WAS_RESET     (0x01);   // This step started over at 0
+const uint8_t SEQ_READY_TO_LOAD (0x02);   // Downbeat with a scene queued up
+const uint8_t SEQ_RESET_PENDING (0x04);   // Reset on the next clock
+const uint8_t SEQ_LOAD_PENDING  (0x08);   // Scene queued for the downbeat
+const uint8_t SEQ_LOADED        (0x10);   // A scene just got loaded
+const uint8_t SEQ_SET_PENDING   (0x20);   // Next written bit is a 1...
+const uint8_t SEQ_CLEAR_PENDING (0x40);   // ...or a 0, no coin toss
+const uint8_t SEQ_HISTORY_JUMP  (0x80);   // Changed between steps; next one's a keyframe
+
+const uint8_t SEQ_CACHE_LINE(32);
+
+
+struct alignas(SEQ_CACHE_LINE) SeqState
+{
+  uint16_t    reg       {0};                  // The working register
+  int8_t      offset    {0};                  // Step within the loop
+  uint8_t     lengthIdx {DEFAULT_LENGTH_IDX}; // Into STEP_LENGTH_VALS
+  uint8_t     bank      {0};                  // Scene that's playing
+  uint8_t     nextBank  {0};                  // Scene to load on the downbeat
+  uint8_t     faderBank {0};
+  int8_t      drunkStep {0};
+  uint8_t     flags     {0};
+  uint8_t     modTouched{0};                  // Destinations modulated last step
+  ShiftParams shift;                          // This step's shift
+  uint32_t    cursor    {0};                  // Where we are in the step history
+
+  uint8_t length() const
+  {
+    return STEP_LENGTH_VALS[lengthIdx];
+  }
+
+  bool flag(uint8_t mask) const
+  {
+    return flags & mask;
+  }
+
+  void setFlag(uint8_t mask, bool on = true)
+  {
+    flags = on ? (flags | mask) : (flags & ~mask);
+  }
+};
+
+static_assert(std::is_trivially_copyable<SeqState>::value, "SeqState has to stay plain data");
+static_assert(sizeof(SeqState) <= SEQ_CACHE_LINE,          "SeqState has outgrown a cache line");
+
+
+// The part of the state the LEDs and UI get to see. TuringRegister
+// publishes one after everything that changes it.
+struct SeqSnapshot
+{
+  uint16_t    reg;
+  int8_t      step;
+  uint8_t     length;
+  uint8_t     bank;
+  uint8_t     nextBank;
+  uint8_t     faderBank;
+  bool        loadPending;
+  bool        retrograde;
+};
+
+#endif
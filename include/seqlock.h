@@ -0,0 +1,132 @@
+// ------------------------------------------------------------------------
+// seqlock.h
+//
+// One writer publishes a small struct; any number of readers, on either
+// core, copy it out without taking a lock. The writer bumps the sequence
+// number to odd, writes, and bumps it back to even. A reader grabs the
+// number, copies, and checks the number again: if it was odd, or moved,
+// the copy might be half old/half new, so it goes round again.
+//
+// The writer never waits for anybody. A reader only ever spins while a
+// write is actually in progress, which is a handful of stores.
+//
+// The payload is kept as 32-bit atomics (relaxed) rather than a plain
+// struct, so a reader racing the writer is just a stale read instead of
+// undefined behaviour. T has to be trivially copyable.
+//
+// There's exactly ONE writer. Two tasks calling store() on the same lock
+// will wreck it.
+// ------------------------------------------------------------------------
+#ifndef SEQLOCK_DOT_H
+#define SEQLOCK_DOT_H
+
+#include "platform.h"
+#include <atomic>
+#include <type_traits>
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Seqlock needs 32-bit atomics that don't take a lock themselves");
+
+// Goes this many times round before sleeping a tick, in case the reader
+// is the one that interrupted the writer (same core, higher priority)
+const uint8_t SEQLOCK_SPINS(8);
+
+
+template <typename T>
+class Seqlock
+{
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock payload has to be plain data");
+
+  static constexpr uint8_t WORDS = (sizeof(T) + 3) / 4;
+
+  std::atomic<uint32_t> seq_;
+  std::atomic<uint32_t> words_[WORDS];
+
+#ifdef RATDEBUG
+  mutable std::atomic<uint32_t> retries_;
+#endif
+
+public:
+  Seqlock():
+    seq_(0)
+#ifdef RATDEBUG
+    , retries_(0)
+#endif
+  {
+    for (uint8_t idx(0); idx < WORDS; ++idx)
+    {
+      words_[idx].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // Writer only
+  void store(const T& val)
+  {
+    uint32_t buf[WORDS]{};
+    memcpy(buf, &val, sizeof(T));
+
+    uint32_t seq(seq_.load(std::memory_order_relaxed));
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (uint8_t idx(0); idx < WORDS; ++idx)
+    {
+      words_[idx].store(buf[idx], std::memory_order_relaxed);
+    }
+
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  // Anybody, anywhere except an ISR (it can spin, briefly, if it lands on
+  // top of a write)
+  T load() const
+  {
+    uint32_t buf[WORDS];
+    for (uint8_t tries(1); ; ++tries)
+    {
+      uint32_t before(seq_.load(std::memory_order_acquire));
+      if (!(before & 0x01))
+      {
+        for (uint8_t idx(0); idx < WORDS; ++idx)
+        {
+          buf[idx] = words_[idx].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == before)
+        {
+          break;
+        }
+      }
+#ifdef RATDEBUG
+      retries_.fetch_add(1, std::memory_order_relaxed);
+#endif
+      if (tries >= SEQLOCK_SPINS)
+      {
+        // Let the writer finish
+        vTaskDelay(1);
+        tries = 0;
+      }
+    }
+
+    T ret;
+    memcpy(&ret, buf, sizeof(T));
+    return ret;
+  }
+
+  // Goes up by 2 every store(); lets readers tell cheaply whether there's
+  // anything new
+  uint32_t sequence() const
+  {
+    return seq_.load(std::memory_order_acquire) & ~0x01UL;
+  }
+
+#ifdef RATDEBUG
+  // Times a reader had to go round again because it overlapped a write
+  uint32_t retries() const
+  {
+    return retries_.load(std::memory_order_relaxed);
+  }
+#endif
+};
+
+#endif
@@ -1,6 +1,6 @@
 #ifndef SET_UP_DOT_H
 #define SET_UP_DOT_H
-#include <Arduino.h>
+#include "platform.h"
 #include "TuringRegister.h"
 #include "modeCtrl.h"
 
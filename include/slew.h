@@ -0,0 +1,81 @@
+// ------------------------------------------------------------------------
+// slew.h
+//
+// Glide for the CV outputs. A step sets new targets, and any output that
+// isn't gliding this step gets written there and then; a task woken by a
+// hardware timer walks the ones that are towards their targets at
+// SLEW_RATE_HZ, all in 16.16 fixed point.
+//
+// Each channel can glide always, never, or only on steps where a chosen
+// bit of the shift register is set, so glides come and go with the
+// pattern.
+// ------------------------------------------------------------------------
+#ifndef SLEW_DOT_H
+#define SLEW_DOT_H
+
+#include <Arduino.h>
+#include "hw_constants.h"
+#include "outConfig.h"
+
+// Channels 0-3 are the external DACs, 4 is the internal one
+const uint8_t  NUM_SLEW_CHANNELS (NUM_DAC_CHANNELS + 1);
+const uint8_t  SLEW_INT_DAC      (NUM_DAC_CHANNELS);
+
+const uint16_t SLEW_RATE_HZ      (2000);
+const uint8_t  SLEW_TIMER        (3);
+
+
+class SlewEngine
+{
+  struct Channel
+  {
+    int32_t     pos;      // 16.16
+    int32_t     target;   // 16.16
+    int32_t     step;     // Per tick, linear only
+    int32_t     coeff;    // 16.16 fraction of the way to go per tick, exponential only
+    SlewConfig  cfg;
+  };
+
+  Channel       ch_[NUM_SLEW_CHANNELS];
+  uint16_t      out_[NUM_SLEW_CHANNELS];
+  bool          moving_;          // Something's gliding
+  int16_t       lastIntDac_;
+  hw_timer_t   *timer_;
+  TaskHandle_t  taskHandle_;
+  SemaphoreHandle_t writeLock_;   // The step and the slew task both write
+  portMUX_TYPE  mux_;
+
+#ifdef RATDEBUG
+  uint32_t      ticks_;
+  uint32_t      busyCycles_;
+  uint32_t      maxCycles_;
+#endif
+
+  void          write();
+
+public:
+  SlewEngine();
+  ~SlewEngine() = default;
+
+  // Starts the timer and the task. Until then, setTargets() writes every
+  // output itself.
+  void      begin();
+
+  void      configure(uint8_t ch, const SlewConfig& cfg);
+
+  // New step: [codes] for the external DACs, [intDac] for the internal
+  // one. Channels that aren't gliding go straight out from here (so from
+  // the step itself); the gliding ones are left to the slew task.
+  void      setTargets(const uint16_t codes[NUM_DAC_CHANNELS],
+                       uint8_t        intDac,
+                       uint8_t        shiftReg);
+
+  // The slew task calls this every tick; there's no need to call it yourself
+  void      tick();
+
+  TaskHandle_t task() const;
+};
+
+extern SlewEngine slew;
+
+#endif
@@ -0,0 +1,166 @@
+// ------------------------------------------------------------------------
+// srBus.h
+//
+// The LED and trigger 74HC595s hang off the same clock and data lines.
+// Rather than have whoever wants to update them bit-bang those lines (and
+// trip over each other doing it), everything goes through the VSPI
+// peripheral, and one task owns the bus.
+//
+// Callers just drop a frame in a one-deep mailbox and get on with their
+// lives; nobody ever waits. Each device has its own mailbox, and if a
+// newer frame shows up before the old one went out, the old one is
+// dropped: a frame is the whole state of the outputs, and nobody would
+// have seen it anyway.
+//  - Trigger frames always go out first. Several tasks post them, so each
+//    can carry a sequence number; an older one never replaces a newer one
+//    in the mailbox, and one that shows up after a newer one already went
+//    out is stale and gets dropped
+//  - LED frames go out whenever there's no trigger frame waiting
+//
+// Frames go through the bit tables in bitPerm.h on the way in (see there
+// for which way round the maps go).
+// ------------------------------------------------------------------------
+#ifndef SR_BUS_DOT_H
+#define SR_BUS_DOT_H
+
+#include <Arduino.h>
+#include <driver/spi_master.h>
+#include "hw_constants.h"
+#include "bitPerm.h"
+
+
+enum class sr_device {
+  LEDS,
+  TRIGGERS,
+  NUM_DEVICES
+};
+
+const uint8_t  NUM_SR_DEVICES(static_cast<uint8_t>(sr_device::NUM_DEVICES));
+const uint32_t SR_BUS_HZ     (10000000);
+
+
+struct SrFrame
+{
+  uint16_t bits;
+  uint32_t seq;             // 0: not sequenced, always goes out
+};
+
+
+struct SrBusStats
+{
+  uint32_t frames;
+  uint32_t dropped;         // Frames overwritten before they went out
+  uint32_t stale;           // Trigger frames older than one already sent
+  uint32_t lastBusMicros;   // Time the last frame spent on the bus
+  uint32_t maxBusMicros;
+  uint32_t postCycles;      // What the last post() cost the caller
+  uint32_t bitBangCycles;   // What the same frame costs bit-banged
+};
+
+
+class ShiftRegisterBus
+{
+  spi_device_handle_t devices_[NUM_SR_DEVICES];
+  SrFrame             trigMail_;
+  bool                trigFull_;
+  portMUX_TYPE        trigMux_;
+  QueueHandle_t       ledMailbox_;
+  TaskHandle_t        taskHandle_;
+  uint32_t            lastTrigSeq_;
+  SrBusStats          stats_[NUM_SR_DEVICES];
+
+  void      measureBitBang();
+  void      benchRemap();
+  void      send(sr_device device, uint16_t frame);
+
+  // The trigger mailbox; fine from a task or an ISR
+  void IRAM_ATTR putTrigger(const SrFrame& trig);
+  bool      takeTrigger(SrFrame& trig);
+
+public:
+  ShiftRegisterBus();
+  ~ShiftRegisterBus() = default;
+
+  // Sets up the SPI peripheral and starts the bus task. Call this before
+  // anything tries to post a frame.
+  void      begin();
+
+  // Leaves a frame for [device]. Doesn't wait for anything. Trigger frames
+  // with a [seq] never go out of [seq] order; see the top of the file.
+  void      post(sr_device device, uint16_t frame, uint32_t seq = 0);
+
+  // Same, from an ISR
+  void IRAM_ATTR postFromISR(sr_device device, uint16_t frame);
+
+  // The bus task calls this; there's no need to call it yourself
+  void      drain();
+
+  const SrBusStats& stats(sr_device device) const;
+  void      logStats() const;
+};
+
+extern ShiftRegisterBus srBus;
+
+
+// Drop-in for OutputRegister: same setReg()/clock()/pending()/reset(), but
+// clock() hands the frame to srBus instead of wiggling pins. [perm] is one
+// table per byte of T, out of bitPerm.h.
+template <typename T>
+class BusRegister
+{
+  sr_device       device_;
+  const ByteLut  *perm_;
+  T               reg_;
+  bool            pending_;
+
+public:
+  BusRegister(sr_device device, const ByteLut *perm):
+    device_ (device),
+    perm_   (perm),
+    reg_    (0),
+    pending_(false)
+  { ; }
+
+  // Sets byte [idx] of the register
+  void setReg(uint8_t val, uint8_t idx = 0)
+  {
+    T mask(static_cast<T>(0xFF) << (idx * 8));
+    T next((reg_ & ~mask) | (static_cast<T>(val) << (idx * 8)));
+    if (next != reg_)
+    {
+      reg_     = next;
+      pending_ = true;
+    }
+  }
+
+  void clock()
+  {
+    srBus.post(device_, frame(reg_));
+    pending_ = false;
+  }
+
+  // What [reg] looks like on the wire. Just table lookups, so it's fine
+  // inside a critical section.
+  uint16_t frame(T reg) const
+  {
+    uint16_t bits(perm_[0][reg & 0xFF]);
+    if (sizeof(T) > 1)
+    {
+      bits |= perm_[1][(reg >> 8) & 0xFF];
+    }
+    return bits;
+  }
+
+  bool pending() const
+  {
+    return pending_;
+  }
+
+  void reset()
+  {
+    reg_ = 0;
+    clock();
+  }
+};
+
+#endif
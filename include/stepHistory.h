@@ -0,0 +1,85 @@
+// ------------------------------------------------------------------------
+// stepHistory.h
+//
+// Remembers what the sequencer did over the last few thousand steps so you
+// can scrub back through it or play it backwards.
+//
+// Each step costs one nibble: what kind of step it was, which way it went
+// and the bit that got written. Anything that can't be replayed from that
+// (resets, pattern loads, length changes) is stored as a full keyframe
+// instead. Every HIST_CHECKPOINT_INTERVAL steps, the full state is dropped
+// into a checkpoint, so finding any step means jumping straight to the
+// checkpoint before it and replaying at most one interval's worth of
+// nibbles.
+// ------------------------------------------------------------------------
+#ifndef STEP_HISTORY_DOT_H
+#define STEP_HISTORY_DOT_H
+
+#include "platform.h"
+
+const uint16_t HIST_STEPS               (4096);
+const uint8_t  HIST_CHECKPOINT_INTERVAL (64);
+const uint8_t  HIST_NUM_CHECKPOINTS     (HIST_STEPS / HIST_CHECKPOINT_INTERVAL + 1);
+const uint16_t HIST_NUM_KEYFRAMES       (256);  // Enough for a reset every 16 steps
+
+// Step kinds (low two bits of each nibble)
+const uint8_t  HIST_WRITE (0);    // Shifted and wrote a bit
+const uint8_t  HIST_MOVE  (1);    // Shifted in place; nothing written
+const uint8_t  HIST_KEY   (2);    // Jumped somewhere; see keyframes
+
+// Everything needed to put the sequencer back at a given step
+struct HistState
+{
+  uint16_t reg;
+  int8_t   offset;
+  uint8_t  lengthIdx;
+  uint8_t  bank;
+};
+
+
+class StepHistory
+{
+  struct Checkpoint
+  {
+    HistState state;
+    uint32_t  keyIdx;   // Keyframes used before this point
+  };
+
+  uint8_t     steps_[HIST_STEPS / 2];
+  Checkpoint  checkpoints_[HIST_NUM_CHECKPOINTS];
+  HistState   keyframes_[HIST_NUM_KEYFRAMES];
+
+  uint32_t    head_;      // Number of steps recorded
+  uint32_t    keyCount_;  // Number of keyframes recorded
+
+  // High-water marks; these survive truncate(), since whatever got thrown
+  // away has still overwritten older entries
+  uint32_t    headHigh_;
+  uint32_t    keyHigh_;
+  HistState   last_;      // State after the most recent step
+
+  void        push(uint8_t nibble);
+  void        replay(HistState& state, uint8_t nibble, uint32_t& keyIdx) const;
+
+public:
+  StepHistory();
+
+  // Forget everything and start recording from [state]
+  void        begin(const HistState& state);
+
+  // Step-path recording; both are constant-time
+  void        record(uint8_t kind, bool forward, bool bit, const HistState& after);
+  void        recordKey(const HistState& after);
+
+  // Throws away everything after step [idx], so recording picks up from there
+  void        truncate(uint32_t idx);
+
+  // Rebuilds the state as it was right after step [idx]. Returns false if
+  // that's already fallen out of the buffer.
+  bool        seek(uint32_t idx, HistState& state) const;
+
+  uint32_t    head()   const;
+  uint32_t    oldest() const;
+};
+
+#endif
@@ -1,25 +1,26 @@
 #ifndef STOCH_DOT_H
 #define STOCH_DOT_H
 
-#include <Arduino.h>
-#include <ESP32AnalogRead.h>
+#include "platform.h"
 
 struct Stochasticizer
 {
   float THRESH_LOW;
   float THRESH_HIGH;
 
-  ESP32AnalogRead& loop;
-  ESP32AnalogRead& cv;
+  Stochasticizer();
 
-  Stochasticizer(
-    ESP32AnalogRead& extLoop,
-    ESP32AnalogRead& extCv);
+  // LOOP knob & CV input, as of the last latch(). The step uses these
+  // rather than waiting on the ADCs itself.
+  uint32_t loopMv_;
+  uint32_t cvMv_;
 
-  mutable bool bitSetPending_;
-  mutable bool bitClearPending_;
+  // Grabs this step's inputs; [bias] (mV) gets added to the knob
+  void latch(uint32_t loopMv, uint32_t cvMv, int32_t bias = 0);
 
+  // Coin toss for the bit being written. Forced set/clear is the
+  // sequencer's business (see SEQ_SET_PENDING), not ours.
   bool stochasticize(const bool startVal) const;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,11 +1,18 @@
 #ifndef TOGGLE_DOT_H
 #define TOGGLE_DOT_H
 
-#include <MagicButton.h>
+#include "platform.h"
+#include "inputs.h"
+
+#ifdef INPUTS_PER_PIN
+typedef MagicButton  ToggleButton;
+#else
+typedef SwitchButton ToggleButton;
+#endif
 
 // Bit 0 set/clear
-extern MagicButton writeHigh;
-extern MagicButton writeLow;
+extern ToggleButton writeHigh;
+extern ToggleButton writeLow;
 
 enum class toggle_cmd
 {
@@ -17,6 +24,14 @@ enum class toggle_cmd
   NO
 };
 
+// Reads both switches and works out what they meant
 toggle_cmd updateToggle();
 
+// Same, from states somebody else already read
+toggle_cmd toggleCommand(ButtonState low, ButtonState high);
+
+// ...and doing it
+void onToggle(ButtonState low, ButtonState high);
+void onToggleCommand(toggle_cmd cmd);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+// ------------------------------------------------------------------------
+// warmStart.h
+//
+// Keeps a copy of the live sequencer state in RTC slow memory, which
+// survives everything except losing power. If we come back up after a
+// brownout, watchdog or crash, we can pick up right where we left off
+// instead of starting over from the factory patterns.
+//
+// The snapshot's checksum is a weighted sum of its fields, so changing one
+// field only means patching the checksum rather than recomputing it.
+// ------------------------------------------------------------------------
+#ifndef WARM_START_DOT_H
+#define WARM_START_DOT_H
+
+#include "platform.h"
+
+// Bits in WarmSnapshot::flags
+const uint8_t WARM_LOAD_PENDING   (0x01);
+const uint8_t WARM_RESET_PENDING  (0x02);
+const uint8_t WARM_SET_PENDING    (0x04);
+const uint8_t WARM_CLEAR_PENDING  (0x08);
+
+struct WarmSnapshot
+{
+  uint32_t  magic;
+  uint16_t  reg;
+  int8_t    offset;
+  uint8_t   lengthIdx;
+  uint8_t   bank;
+  uint8_t   nextBank;
+  uint8_t   faderBank;
+  uint8_t   flags;
+  uint32_t  check;
+};
+
+
+class WarmStart
+{
+  bool      warm_;
+  bool      firstStepLogged_;
+  uint32_t  bootMicros_;
+
+  void      patch(uint32_t weight, uint32_t oldVal, uint32_t newVal);
+
+public:
+  WarmStart();
+
+  // Call first thing at boot. Returns true if the reset was one we should
+  // recover from and the snapshot checks out; if so, [snap] holds it.
+  // Otherwise the snapshot gets wiped for a fresh start.
+  bool      begin(WarmSnapshot& snap);
+  bool      isWarm() const;
+
+  // Each of these only touches RTC memory if the value actually changed
+  void      setReg(uint16_t reg);
+  void      setOffset(int8_t offset);
+  void      setLengthIdx(uint8_t idx);
+  void      setBank(uint8_t bank);
+  void      setNextBank(uint8_t bank);
+  void      setFaderBank(uint8_t bank);
+  void      setFlags(uint8_t flags);
+
+  // Boot timing: ready() when setup is done, firstStep() on every step
+  // (it only logs the first one)
+  void      ready();
+  void      firstStep();
+};
+
+extern WarmStart warmStart;
+
+#endif
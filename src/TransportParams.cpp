@@ -2,148 +2,192 @@
 #include "ShiftParams.h"
 
 
-std::array<const uint8_t, NUM_STEP_LENGTHS> STEP_LENGTH_VALS {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 15, 16};
-
-TransportParams::TransportParams():
-  readyToLoad_            (0),
-  offset_          (0),
-  wasReset_        (0),
-  drunkStep_       (0),
-  resetPending_    (0),
-  currentBankIdx_  (0),
-  newLoadPending_  (0),
-  newPatternLoaded_(0),
-  shifter_         (ShiftParams()),
-  nextPattern_     (currentBankIdx_),
-  workingLength    (STEP_LENGTH_VALS.begin() + 6)
+TransportParams::TransportParams(SeqState& state):
+  st_(state)
 {;}
 
 
 void TransportParams::reset()
 {
-  offset_       = 0;
-  wasReset_     = true;
-  resetPending_ = false;
+  st_.offset = 0;
+  st_.setFlag(SEQ_WAS_RESET);
+  st_.setFlag(SEQ_RESET_PENDING, false);
 }
 
 
 void TransportParams::lengthMINUS()
 {
-  if (workingLength == STEP_LENGTH_VALS.begin())
+  if (st_.lengthIdx == 0)
   {
     return;
   }
 
-  --workingLength;
-  offset_ %= *workingLength;
+  --st_.lengthIdx;
+  st_.offset %= st_.length();
 }
 
 
 void TransportParams::lengthPLUS()
 {
-  if (workingLength == (STEP_LENGTH_VALS.end() - 1))
+  if (st_.lengthIdx == NUM_STEP_LENGTHS - 1)
   {
     return;
   }
 
-  ++workingLength;
+  ++st_.lengthIdx;
+}
+
+
+// Index into STEP_LENGTH_VALS, which is what gets saved with a pattern
+uint8_t TransportParams::getLengthIdx() const
+{
+  return st_.lengthIdx;
+}
+
+
+void TransportParams::setLengthIdx(const uint8_t idx)
+{
+  if (idx >= NUM_STEP_LENGTHS)
+  {
+    return;
+  }
+
+  st_.lengthIdx = idx;
+  st_.offset   %= st_.length();
 }
 
 
 void TransportParams::reAnchor()
 {
-  offset_ = 0;
+  st_.offset = 0;
 }
 
 
 bool TransportParams::newLoadPending() const
 {
-  return newLoadPending_;
+  return st_.flag(SEQ_LOAD_PENDING);
 }
 
 
 bool TransportParams::newPatternLoaded() const
 {
-  return newPatternLoaded_;
+  return st_.flag(SEQ_LOADED);
 }
 
 
 bool TransportParams::wasReset() const
 {
-  return wasReset_;
+  return st_.flag(SEQ_WAS_RESET);
 }
 
 
 bool TransportParams::resetPending() const
 {
-  return resetPending_;
+  return st_.flag(SEQ_RESET_PENDING);
 }
 
 
 void TransportParams::flagForReset()
 {
-  resetPending_ = true;
+  st_.setFlag(SEQ_RESET_PENDING);
 }
 
 
 uint8_t TransportParams::getLength() const
 {
-  return *workingLength;
+  return st_.length();
 }
 
 
 int8_t TransportParams::getStep() const
 {
-  return offset_;
+  return st_.offset;
 }
 
 
 uint8_t TransportParams::getSlot() const
 {
-  return currentBankIdx_;
+  return st_.bank;
 }
 
 
 bool TransportParams::readyToLoad() const
 {
-  return readyToLoad_;
+  return st_.flag(SEQ_READY_TO_LOAD);
 }
 
 
 uint8_t TransportParams::currentBankIdx() const
 {
-  return currentBankIdx_;
+  return st_.bank;
+}
+
+
+uint8_t TransportParams::nextPattern() const
+{
+  return st_.nextBank;
+}
+
+
+// Puts the transport back the way it was before a warm reset
+void TransportParams::restoreState(const int8_t  offset,
+                                   const uint8_t lengthIdx,
+                                   const uint8_t bank,
+                                   const uint8_t nextBank,
+                                   const bool    loadPending,
+                                   const bool    resetPending)
+{
+  setLengthIdx(lengthIdx);
+  st_.offset   = offset % st_.length();
+  st_.bank     = bank;
+  st_.nextBank = nextBank;
+  st_.setFlag(SEQ_LOAD_PENDING,  loadPending);
+  st_.setFlag(SEQ_RESET_PENDING, resetPending);
+  st_.setFlag(SEQ_WAS_RESET | SEQ_READY_TO_LOAD | SEQ_LOADED, false);
 }
 
 
 void TransportParams::setNextPattern(const uint8_t slot)
 {
-  newLoadPending_ = true;
-  nextPattern_    = slot;
+  st_.setFlag(SEQ_LOAD_PENDING);
+  st_.nextBank = slot;
 }
 
 
 void TransportParams::pre_iterate(const int8_t steps, const bool inPlace)
 {
-  readyToLoad_ = false;
-  wasReset_    = false;
+  st_.setFlag(SEQ_READY_TO_LOAD | SEQ_WAS_RESET, false);
 
   if (!inPlace)
   {
     // Load new patterns on the downbeat
-    if (newLoadPending_ && shifter_.next() == 0)
+    if (st_.flag(SEQ_LOAD_PENDING) && st_.shift.next() == 0)
     {
-      wasReset_     = true;
-      readyToLoad_  = true;
+      st_.setFlag(SEQ_READY_TO_LOAD | SEQ_WAS_RESET);
     }
   }
 
-  shifter_.getShiftParams(*this, steps, inPlace);
-  offset_ = shifter_.next();
+  st_.shift.getShiftParams(*this, steps, inPlace);
+  st_.offset = st_.shift.next();
 }
 
 
 uint16_t TransportParams::rotateToZero(const uint16_t reg)
 {
-  return shifter_.rotateToZero(reg, offset_);
+  return st_.shift.rotateToZero(reg, st_.offset);
+}
+
+
+void TransportParams::moveInPlace(const int8_t steps)
+{
+  st_.setFlag(SEQ_READY_TO_LOAD | SEQ_WAS_RESET | SEQ_LOADED, false);
+
+  // Skip to one short of the end, then take the last one for real, so the
+  // shift's left the way that step would have left it. The next clock's
+  // downbeat check goes by shift.next().
+  int8_t dir(steps < 0 ? -1 : 1);
+  st_.offset = offsetAfter(st_.offset, steps - dir, st_.length());
+  st_.shift.getShiftParams(*this, dir, true);
+  st_.offset = st_.shift.next();
+  st_.reg    = rotateBy(st_.reg, steps);
 }
@@ -6,33 +6,58 @@
 // Ryan "Ratimus" Richardson
 // ------------------------------------------------------------------------
 
-#include "RatFuncs.h"
+#include "platform.h"
 #include "TuringRegister.h"
-#include "hwio.h"
+#include "seqIO.h"
+#include "hal.h"
+
+#ifdef RATDEBUG
+const uint16_t SEQ_LOG_INTERVAL(256);   // Steps between stats dumps
+#endif
 
 void TuringRegister::setBit()
 {
-  stoch_.bitSetPending_   = true;
-  stoch_.bitClearPending_ = false;
+  state_.setFlag(SEQ_SET_PENDING);
+  state_.setFlag(SEQ_CLEAR_PENDING, false);
+  syncWarmStart();
 }
 
 
 void TuringRegister::clearBit()
 {
-  stoch_.bitClearPending_ = true;
-  stoch_.bitSetPending_   = false;
+  state_.setFlag(SEQ_CLEAR_PENDING);
+  state_.setFlag(SEQ_SET_PENDING, false);
+  syncWarmStart();
 }
 
 
 // Returns the current base pattern (i.e. the stored one, not the working one)
 uint16_t TuringRegister::getPattern() const
 {
-  return workingRegister;
+  return state_.reg;
 }
 
 uint16_t TuringRegister::getReg(uint8_t slot) const
 {
-  return registersBank[slot];
+  return scenes_[slot % NUM_PATTERNS].reg;
+}
+
+
+const Scene& TuringRegister::activeScene() const
+{
+  return *activeScene_;
+}
+
+
+SeqSnapshot TuringRegister::snapshot() const
+{
+  return published_.load();
+}
+
+
+uint8_t TuringRegister::activeSceneIdx() const
+{
+  return activeScene_ - scenes_.data();
 }
 
 
@@ -49,18 +74,331 @@ uint8_t TuringRegister::getLength() const
 
 // Class to hold and manipulate sequencer shift register patterns
 TuringRegister::TuringRegister(Stochasticizer& stoch):
-    NUM_PATTERNS     (8),
-    workingRegister  (0),
-    stoch_           (stoch)
+    NUM_PATTERNS     (NUM_SCENES),
+    state_           (),
+    transport_       (state_),
+    stoch_           (stoch),
+    activeScene_     (nullptr),
+    stagedIdx_       (0),
+    freshBank_       (false),
+    retrograde_      (false)
 {
-  // C++ 20 <ranges> is not supported, so we have to do this instead of {enumerate}
-  auto reg_iter = registersBank.begin();
-  for (uint8_t bk = 0; reg_iter != registersBank.end(); ++bk, ++reg_iter)
+#ifdef RATDEBUG
+  steps_         = 0;
+  stepCycles_    = 0;
+  maxStepCycles_ = 0;
+#endif
+
+  // Factory scenes: a single hole walking through the register, each with
+  // its own fader bank
+  for (uint8_t idx(0); idx < NUM_PATTERNS; ++idx)
   {
-    *reg_iter = ~(0x01 << bk);
+    Scene &scene(scenes_[idx]);
+    scene.reg       = ~(0x01 << (idx % 16));
+    scene.lengthIdx = DEFAULT_LENGTH_IDX;
+    scene.faderBank = idx;
+    scene.range     = MIN_OCTAVES;
+    scene.outFlags  = 0;
+    scene.trigMs    = DEFAULT_TRIGGER_MS;
+    scene.spare     = 0;
+    std::fill(std::begin(scene.trig),  std::end(scene.trig),  DEFAULT_TRIG_CONFIG);
+    std::fill(std::begin(scene.glide), std::end(scene.glide), DEFAULT_SLEW_CONFIG);
   }
 
-  workingRegister = *registersBank.begin();
+  selectScene(0);
+  stageScene(0);
+  state_.reg = activeScene_->reg;
+}
+
+
+void TuringRegister::selectScene(uint8_t idx)
+{
+  activeScene_ = &scenes_[idx % NUM_PATTERNS];
+}
+
+
+void TuringRegister::stageScene(uint8_t idx)
+{
+  stagedIdx_ = idx % NUM_PATTERNS;
+  staged_    = scenes_[stagedIdx_];
+}
+
+
+void TuringRegister::commitStaged()
+{
+  activeScene_ = &scenes_[stagedIdx_];
+  transport_.loadPattern(staged_);
+  applySceneSettings();
+}
+
+
+void TuringRegister::selectFaderBank(uint8_t bank)
+{
+  state_.faderBank = bank;
+  ioSelectFaderBank(bank);
+  freshBank_ = true;
+}
+
+
+void TuringRegister::applySceneSettings()
+{
+  selectFaderBank(activeScene_->faderBank % NUM_PATTERNS);
+  ioSetRange(activeScene_->range);
+  ioSetTrigLength(activeScene_->trigMs);
+  ioSetOutputConfig(activeScene_->trig, activeScene_->glide);
+}
+
+
+void TuringRegister::outputStep(bool reset)
+{
+  uint16_t    vals[NUM_FADERS];
+  StepOutputs out{state_.reg, state_.offset, state_.length(), reset, nullptr};
+  if (freshBank_)
+  {
+    ioReadFaders(vals);
+    out.freshFaders = vals;
+    freshBank_      = false;
+  }
+  ioStep(out);
+}
+
+
+static bool modded(const ModValues& mods, uint8_t touched, mod_dest dest)
+{
+  return bitRead(mods.touched | touched, static_cast<uint8_t>(dest));
+}
+
+
+static int16_t modAmt(const ModValues& mods, mod_dest dest)
+{
+  return mods.amount[static_cast<uint8_t>(dest)];
+}
+
+
+void TuringRegister::applyModulation(const ModValues& mods, bool withLength)
+{
+  if (withLength && modded(mods, state_.modTouched, mod_dest::LOOP_LENGTH))
+  {
+    int16_t idx(constrain(activeScene_->lengthIdx + modAmt(mods, mod_dest::LOOP_LENGTH),
+                          0, NUM_STEP_LENGTHS - 1));
+    if (idx != transport_.getLengthIdx())
+    {
+      // Same as changeLen(): the history can't replay across a new length
+      transport_.setLengthIdx(idx);
+      state_.setFlag(SEQ_HISTORY_JUMP);
+    }
+  }
+
+  if (modded(mods, state_.modTouched, mod_dest::FADER_BANK))
+  {
+    int16_t bank(constrain(activeScene_->faderBank % NUM_PATTERNS + modAmt(mods, mod_dest::FADER_BANK),
+                           0, NUM_PATTERNS - 1));
+    if (bank != state_.faderBank)
+    {
+      selectFaderBank(bank);
+    }
+  }
+
+  if (modded(mods, state_.modTouched, mod_dest::TRIG_LENGTH))
+  {
+    int16_t ms(constrain(activeScene_->trigMs + modAmt(mods, mod_dest::TRIG_LENGTH), 1, 255));
+    ioSetTrigLength(ms);
+  }
+
+  if (modded(mods, state_.modTouched, mod_dest::OCTAVE_RANGE))
+  {
+    ioSetRange(constrain(activeScene_->range + modAmt(mods, mod_dest::OCTAVE_RANGE),
+                             MIN_OCTAVES, MAX_OCTAVES));
+  }
+
+  // FLIP_PROB goes straight to the stochasticizer when it latches
+}
+
+
+// Pulls any scenes that were saved to flash back in, then starts over on
+// scene 0
+void TuringRegister::restoreBanks()
+{
+  SceneRecord rec;
+  for (uint8_t idx(0); idx < NUM_PATTERNS; ++idx)
+  {
+    if (ioRestoreScene(idx, rec))
+    {
+      scenes_[idx] = rec.scene;
+    }
+  }
+
+  selectScene(0);
+  stageScene(transport_.nextPattern());
+  state_.reg = activeScene_->reg;
+  transport_.setLengthIdx(activeScene_->lengthIdx);
+  applySceneSettings();
+  history_.begin(currentState());
+  state_.cursor = 0;
+  syncWarmStart();
+}
+
+
+// Picks up where we left off before a brownout/watchdog/crash
+void TuringRegister::warmRestore(const WarmSnapshot& snap)
+{
+  state_.reg = snap.reg;
+  transport_.restoreState(snap.offset,
+                          snap.lengthIdx,
+                          snap.bank % NUM_PATTERNS,
+                          snap.nextBank % NUM_PATTERNS,
+                          snap.flags & WARM_LOAD_PENDING,
+                          snap.flags & WARM_RESET_PENDING);
+  state_.setFlag(SEQ_SET_PENDING,   snap.flags & WARM_SET_PENDING);
+  state_.setFlag(SEQ_CLEAR_PENDING, snap.flags & WARM_CLEAR_PENDING);
+
+  selectScene(transport_.currentBankIdx());
+  stageScene(transport_.nextPattern());
+  applySceneSettings();
+  if (snap.faderBank % NUM_PATTERNS != state_.faderBank)
+  {
+    selectFaderBank(snap.faderBank % NUM_PATTERNS);
+  }
+  history_.begin(currentState());
+  state_.cursor = 0;
+  syncWarmStart();
+}
+
+
+HistState TuringRegister::currentState() const
+{
+  return {state_.reg,
+          transport_.getStep(),
+          transport_.getLengthIdx(),
+          transport_.currentBankIdx()};
+}
+
+
+// Puts the register/transport back how they were at some earlier step.
+// Pending loads, resets and bit flips are left alone.
+void TuringRegister::applyState(const HistState& state)
+{
+  state_.reg = state.reg;
+  transport_.restoreState(state.offset,
+                          state.lengthIdx,
+                          state.bank,
+                          transport_.nextPattern(),
+                          transport_.newLoadPending(),
+                          transport_.resetPending());
+
+  if (&scenes_[state.bank % NUM_PATTERNS] != activeScene_)
+  {
+    selectScene(state.bank);
+    applySceneSettings();
+  }
+}
+
+
+void TuringRegister::recordStep(int8_t steps, bool inPlace)
+{
+  if (transport_.wasReset() || state_.flag(SEQ_HISTORY_JUMP))
+  {
+    history_.recordKey(currentState());
+    state_.setFlag(SEQ_HISTORY_JUMP, false);
+  }
+  else
+  {
+    bool forward(steps > 0);
+    history_.record(inPlace ? HIST_MOVE : HIST_WRITE,
+                    forward,
+                    bitRead(state_.reg, forward ? 0 : 7),
+                    currentState());
+  }
+  state_.cursor = history_.head();
+}
+
+
+void TuringRegister::scrub(int8_t steps)
+{
+  int64_t target((int64_t)state_.cursor + steps);
+  if (target < (int64_t)history_.oldest())
+  {
+    target = history_.oldest();
+  }
+  else if (target > (int64_t)history_.head())
+  {
+    target = history_.head();
+  }
+
+  HistState state;
+  if (!history_.seek(target, state))
+  {
+    return;
+  }
+
+  applyState(state);
+  state_.cursor = target;
+  syncWarmStart();
+}
+
+
+void TuringRegister::toggleRetrograde()
+{
+  retrograde_ = !retrograde_;
+  publish();
+  dbprintf("retrograde %s at step %lu\n", retrograde_ ? "on" : "off", state_.cursor);
+}
+
+
+bool TuringRegister::retrograde() const
+{
+  return retrograde_;
+}
+
+
+void TuringRegister::syncWarmStart()
+{
+  uint8_t flags(0);
+  if (transport_.newLoadPending())
+  {
+    flags |= WARM_LOAD_PENDING;
+  }
+  if (transport_.resetPending())
+  {
+    flags |= WARM_RESET_PENDING;
+  }
+  if (state_.flag(SEQ_SET_PENDING))
+  {
+    flags |= WARM_SET_PENDING;
+  }
+  if (state_.flag(SEQ_CLEAR_PENDING))
+  {
+    flags |= WARM_CLEAR_PENDING;
+  }
+
+  WarmSnapshot snap;
+  memset(&snap, 0, sizeof(snap));
+  snap.reg       = state_.reg;
+  snap.offset    = transport_.getStep();
+  snap.lengthIdx = transport_.getLengthIdx();
+  snap.bank      = transport_.currentBankIdx();
+  snap.nextBank  = transport_.nextPattern();
+  snap.faderBank = state_.faderBank;
+  snap.flags     = flags;
+  ioWarmSync(snap);
+  publish();
+}
+
+
+// Only ever called from whichever task is driving the sequencer (loop()),
+// which makes it the seqlock's one writer
+void TuringRegister::publish()
+{
+  SeqSnapshot snap;
+  snap.reg         = state_.reg;
+  snap.step        = state_.offset;
+  snap.length      = state_.length();
+  snap.bank        = state_.bank;
+  snap.nextBank    = state_.nextBank;
+  snap.faderBank   = state_.faderBank;
+  snap.loadPending = state_.flag(SEQ_LOAD_PENDING);
+  snap.retrograde  = retrograde_;
+  published_.store(snap);
 }
 
 
@@ -92,66 +430,149 @@ uint16_t TuringRegister::norm(const uint16_t reg, const uint8_t len) const
 }
 
 
-uint16_t TransportParams::iterate(uint16_t reg, Stochasticizer stoch)
+void TransportParams::iterate(const Stochasticizer& stoch)
 {
-  uint16_t ret = reg;
-  if (!wasReset_)
+  if (st_.flag(SEQ_WAS_RESET))
+  {
+    return;
+  }
+
+  // Update register
+  st_.setFlag(SEQ_LOADED, false);
+  const ShiftParams& shift(st_.shift);
+  uint16_t reg(st_.reg);
+  bool writeVal(bitRead(reg, shift.readIdx()));
+  reg = (reg << shift.leftAmt()) | \
+        (reg >> shift.rightAmt());
+  if (!shift.immutable())
   {
-    // Update register
-    newPatternLoaded_ = false;
-    bool writeVal(bitRead(reg, shifter_.readIdx()));
-    ret = (ret << shifter_.leftAmt()) | \
-          (ret >> shifter_.rightAmt());
-    if (!shifter_.immutable())
+    if (st_.flag(SEQ_SET_PENDING | SEQ_CLEAR_PENDING))
+    {
+      // Somebody asked for this one; it's used up now
+      writeVal = st_.flag(SEQ_SET_PENDING);
+      st_.setFlag(SEQ_SET_PENDING | SEQ_CLEAR_PENDING, false);
+    }
+    else
     {
       writeVal = stoch.stochasticize(writeVal);
-      bitWrite(ret, shifter_.writeIdx(), writeVal);
     }
+    bitWrite(reg, shift.writeIdx(), writeVal);
   }
-  return ret;
+  st_.reg = reg;
 }
 
 
-uint16_t TransportParams::loadPattern(const std::array<uint16_t, 8> &bank)
+// [scene] is the one at nextPattern(); the caller has already pointed at it
+void TransportParams::loadPattern(const Scene& scene)
 {
-  readyToLoad_ = false;
-  // Move pattern pointer to selected bank and copy its contents into working register
-  currentBankIdx_   = nextPattern_;
-  offset_          %= *workingLength;
-  newLoadPending_   = false;
-  newPatternLoaded_ = true;
-  dbprintf("Bank %u: length = %u; step = %u\n", currentBankIdx_, *workingLength, offset_);
-  dbprintf("Loaded pattern %u\n", currentBankIdx_);
-  return bank[currentBankIdx_];
+  st_.setFlag(SEQ_READY_TO_LOAD, false);
+  st_.bank = st_.nextBank;
+  setLengthIdx(scene.lengthIdx);
+  st_.setFlag(SEQ_LOAD_PENDING, false);
+  st_.setFlag(SEQ_LOADED);
+  st_.reg  = scene.reg;
+  dbprintf("Scene %u: length = %u; step = %d\n", st_.bank, st_.length(), st_.offset);
+  dbprintf("Loaded scene %u\n", st_.bank);
 }
 
 
 void TuringRegister::iterate(int8_t steps, bool inPlace /*=false*/)
 {
+  if (retrograde_)
+  {
+    // Clocks walk backwards through history; the encoder scrubs it
+    scrub(inPlace ? steps : -1);
+    if (inPlace)
+    {
+      return;
+    }
+
+    outputStep(false);
+    return;
+  }
+
+  // If we scrubbed back, carry on from there and forget what came after
+  history_.truncate(state_.cursor);
+
+  ModValues mods;
+  uint32_t  loopMv, cvMv;
+  ioModulation(mods, loopMv, cvMv);
+  stoch_.latch(loopMv, cvMv, mods.amount[static_cast<uint8_t>(mod_dest::FLIP_PROB)]);
+  applyModulation(mods, true);
+
+  if (inPlace && (steps > 1 || steps < -1))
+  {
+    // A burst of encoder detents: one rotation instead of a whole step per
+    // detent. It goes in the history as one jump.
+    transport_.moveInPlace(steps);
+    state_.modTouched = mods.touched;
+    state_.setFlag(SEQ_HISTORY_JUMP);
+    recordStep(steps, inPlace);
+    syncWarmStart();
+    return;
+  }
+
+#ifdef RATDEBUG
+  uint32_t start(halCycles());
+#endif
   transport_.pre_iterate(steps, inPlace);
-  if (transport_.readyToLoad())
+  bool loaded(transport_.readyToLoad());
+  if (loaded)
   {
-    workingRegister = transport_.loadPattern(registersBank);
+    // Switching scenes on the downbeat: the new scene was staged when it
+    // got picked, and all of it goes live before this step outputs
+    // anything
+    commitStaged();
   }
 
-  workingRegister = transport_.iterate(workingRegister, stoch_);
+  transport_.iterate(stoch_);
+#ifdef RATDEBUG
+  logStepStats(halCycles() - start);
+#endif
 
-  if (transport_.newPatternLoaded())
+  if (loaded)
   {
-    faders.selectBank(transport_.currentBankIdx());
-    dbprintf("loaded fader bank %u\n", transport_.currentBankIdx());
+    applyModulation(mods, false);
+    dbprintf("loaded fader bank %u\n", state_.faderBank);
   }
+  state_.modTouched = mods.touched;
 
+  recordStep(steps, inPlace);
+  syncWarmStart();
   if (inPlace)
   {
     return;
   }
+  ioFirstStep();
 
   // Update all the various outputs
-  expandVoltages(getOutput());
-  triggers.clock();
-  panelLeds.clock(transport_.wasReset());
+  outputStep(transport_.wasReset());
+}
+
+
+#ifdef RATDEBUG
+// Cycles for the shift itself (pre_iterate() through iterate()), and how
+// big the state it chews on is
+void TuringRegister::logStepStats(uint32_t cycles)
+{
+  stepCycles_ += cycles;
+  if (cycles > maxStepCycles_)
+  {
+    maxStepCycles_ = cycles;
+  }
+  if (++steps_ % SEQ_LOG_INTERVAL)
+  {
+    return;
+  }
+
+  dbprintf("step: %lu cycles avg (max %lu); SeqState %u bytes, TuringRegister %u\n",
+           (unsigned long)(stepCycles_ / SEQ_LOG_INTERVAL),
+           (unsigned long)maxStepCycles_,
+           (unsigned)sizeof(SeqState),
+           (unsigned)sizeof(TuringRegister));
+  stepCycles_ = 0;
 }
+#endif
 
 
 // Selects a new pattern to load on the downbeat. If you select the current
@@ -159,30 +580,44 @@ void TuringRegister::iterate(int8_t steps, bool inPlace /*=false*/)
 void TuringRegister::setNextPattern(uint8_t loadSlot)
 {
   loadSlot %= NUM_PATTERNS;
+  stageScene(loadSlot);
   transport_.setNextPattern(loadSlot);
+  syncWarmStart();
 }
 
 
 void TuringRegister::rotateToZero()
 {
-  workingRegister = transport_.rotateToZero(workingRegister);
+  state_.reg = transport_.rotateToZero(state_.reg);
 }
 
 
 void TuringRegister::reset()
 {
-  if (transport_.newLoadPending())
+  bool loaded(transport_.newLoadPending());
+  if (loaded)
   {
-    workingRegister = transport_.loadPattern(registersBank);
+    // Same switch as the downbeat, just sooner
+    commitStaged();
     transport_.reAnchor();
+    state_.setFlag(SEQ_HISTORY_JUMP);
   }
 
   if (transport_.resetPending())
   {
+    syncWarmStart();
     return;
   }
-  rotateToZero();
+
+  // A scene that just got loaded is already at step 0. (Rotating it by 0
+  // isn't a no-op: rotateToZero() would reuse the last shift's amounts.)
+  if (!loaded)
+  {
+    rotateToZero();
+  }
   transport_.flagForReset();
+  state_.setFlag(SEQ_HISTORY_JUMP);
+  syncWarmStart();
 }
 
 
@@ -202,24 +637,46 @@ void TuringRegister::changeLen(int8_t amt)
     transport_.lengthMINUS();
   }
 
-  dbprintf("Bank %u: length = %u; step = %u\n",
-            transport_.currentBankIdx_,
-           *transport_.workingLength,
-            transport_.offset_);
+  dbprintf("Bank %u: length = %u; step = %d\n",
+           state_.bank,
+           state_.length(),
+           state_.offset);
+  state_.setFlag(SEQ_HISTORY_JUMP);
+  syncWarmStart();
 }
 
 
 void TuringRegister::savePattern(uint8_t bankIdx)
 {
-  // Copy working register into selected bank
+  // Snapshot everything that's live right now into the selected scene. It
+  // keeps the output mapping, triggers and glides of whatever scene we're
+  // playing.
   bankIdx %= NUM_PATTERNS;
-  uint16_t workingRegCopy = workingRegister;
+  uint16_t workingRegCopy = state_.reg;
   rotateToZero();
-  registersBank[bankIdx]  = workingRegister;
-  workingRegister         = workingRegCopy;
 
-  dbprintf("saved to slot %u\n", bankIdx);
-  faders.saveBank(bankIdx);
+  Scene &scene(scenes_[bankIdx]);
+  scene           = *activeScene_;
+  scene.reg       = state_.reg;
+  scene.lengthIdx = transport_.getLengthIdx();
+  scene.faderBank = bankIdx;
+  scene.range     = ioRange();
+  scene.trigMs    = ioTrigLength();
+  scene.spare     = 0;
+  state_.reg      = workingRegCopy;
+  if (bankIdx == stagedIdx_)
+  {
+    // Whatever's queued up for the downbeat had better be what was just saved
+    stageScene(bankIdx);
+  }
+
+  dbprintf("saved to scene %u\n", bankIdx);
+  ioSaveFaderBank(bankIdx);
+
+  // Queue it up for the trip to flash
+  SceneRecord rec;
+  rec.scene = scene;
+  ioSaveScene(bankIdx, rec);
 }
 
 
@@ -243,7 +700,7 @@ uint8_t markov(uint8_t seed)
 uint8_t TuringRegister::pulseIt()
 {
   // Bit 0 from shift register; Bit 1 is !Bit 0
-  uint8_t inputReg(static_cast<uint8_t>(workingRegister & 0xFF));
+  uint8_t inputReg(static_cast<uint8_t>(state_.reg & 0xFF));
   uint8_t outputReg(inputReg & BIT0);
 
   inputReg = markov(inputReg);
@@ -289,46 +746,15 @@ uint8_t TuringRegister::getDrunkenIndex()
     rn *= -1;
   }
 
-  transport_.drunkStep_ += rn;
-  if (transport_.drunkStep_ < 0)
+  state_.drunkStep += rn;
+  if (state_.drunkStep < 0)
   {
-    transport_.drunkStep_ += 8;
+    state_.drunkStep += 8;
   }
-  else if (transport_.drunkStep_ > 7)
+  else if (state_.drunkStep > 7)
   {
-    transport_.drunkStep_ -= 8;
+    state_.drunkStep -= 8;
   }
 
-  return transport_.drunkStep_;
+  return state_.drunkStep;
 }
-
-// TODO: incorporate this stuff:
-// void savePatternToFlash(uint8_t slot)
-// {
-//   char lclbuf[8];
-//   sprintf(lclbuf, "reg%u", slot);
-//   prefs.putUShort(lclbuf, 0);
-
-//   int16_t min;
-//   int16_t max;
-//   int16_t lockVal;
-// }
-
-// // save settings to eeprom
-// void savesetup(void)
-// {
-//     // https://randomnerdtutorials.com/esp32-save-data-permanently-preferences/
-//   prefs.begin("setup", false);  // Read-only = false
-//    ...
-//   prefs.end();
-//   Serial.println("Settings saved");
-//   return proceed;
-// }
-
-
-// void loadPrefs(uint8_t vidx)
-// {
-// prefs.begin("setup", true);  // Read-only = true
-//  ...
-// prefs.end();
-// }
\ No newline at end of file
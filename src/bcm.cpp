@@ -0,0 +1,83 @@
+#include "bcm.h"
+
+BcmLeds bcmLeds;
+
+static_assert(BCM_BITS <= 8,                   "Levels are stored in bytes");
+static_assert(NUM_PANEL_LEDS == 16,            "One plane is one 16-bit LED frame");
+static_assert((BCM_BASE_MICROS << (BCM_BITS - 1)) < 65536, "Plane period overflow");
+
+
+void IRAM_ATTR onBcmTimer()
+{
+  bcmLeds.tick();
+}
+
+
+BcmLeds::BcmLeds():
+  front_      (0),
+  swapPending_(false),
+  plane_      (0),
+  lastFrame_  (0),
+  timer_      (nullptr),
+  mux_        (portMUX_INITIALIZER_UNLOCKED)
+{
+  memset(planes_, 0, sizeof(planes_));
+}
+
+
+void BcmLeds::begin()
+{
+  // 1 MHz ticks, so alarm values are in microseconds
+  timer_ = timerBegin(BCM_TIMER, 80, true);
+  timerAttachInterrupt(timer_, &onBcmTimer, true);
+  timerAlarmWrite(timer_, BCM_BASE_MICROS, true);
+  timerAlarmEnable(timer_);
+}
+
+
+void BcmLeds::show(const uint8_t levels[NUM_PANEL_LEDS])
+{
+  // Slice levels into planes, then remap each plane for the hardware
+  uint16_t planes[BCM_BITS];
+  for (uint8_t b(0); b < BCM_BITS; ++b)
+  {
+    uint16_t plane(0);
+    for (uint8_t led(0); led < NUM_PANEL_LEDS; ++led)
+    {
+      if (bitRead(levels[led], b))
+      {
+        plane |= (1 << led);
+      }
+    }
+    planes[b] = LED_PERM[0][plane & 0xFF] | LED_PERM[1][plane >> 8];
+  }
+
+  portENTER_CRITICAL(&mux_);
+  memcpy(planes_[front_ ^ 1], planes, sizeof(planes));
+  swapPending_ = true;
+  portEXIT_CRITICAL(&mux_);
+}
+
+
+// Show this plane, then come back in 2^plane base periods for the next one
+void IRAM_ATTR BcmLeds::tick()
+{
+  portENTER_CRITICAL_ISR(&mux_);
+  if (plane_ == 0 && swapPending_)
+  {
+    front_       = front_ ^ 1;
+    swapPending_ = false;
+  }
+  uint16_t frame(planes_[front_][plane_]);
+  portEXIT_CRITICAL_ISR(&mux_);
+
+  // Fully on/off LEDs look the same in every plane; no point resending
+  if (frame != lastFrame_)
+  {
+    srBus.postFromISR(sr_device::LEDS, frame);
+    lastFrame_ = frame;
+  }
+
+  timerAlarmWrite(timer_, BCM_BASE_MICROS << plane_, true);
+  plane_ = (plane_ + 1) % BCM_BITS;
+}
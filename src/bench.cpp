@@ -0,0 +1,328 @@
+// ------------------------------------------------------------------------
+// bench.cpp
+//
+// See bench.h. On the board runBenchmarks() gets called at the end of
+// setup() and works on the real alan/expandVoltages(); on the host this
+// file has its own main() and sequencer, and only expandVoltages()'s
+// arithmetic (CvMixer) gets timed.
+// ------------------------------------------------------------------------
+#ifdef TMOC_BENCH
+
+#include "bench.h"
+#include "hal.h"
+#include "TuringRegister.h"
+#include "cvMix.h"
+
+#ifdef ARDUINO
+#include "setup.h"
+#include "hwio.h"
+#else
+#include "seqIO.h"
+
+Stochasticizer stoch;
+TuringRegister alan(stoch);
+#endif
+
+const uint8_t BENCH_MAX_RESULTS(16);
+const int8_t  BENCH_SPIN_DETENTS(32);   // A fast spin's worth (MAX_ENC_BURST)
+
+struct BenchResult
+{
+  char      name[32];
+  char      unit[8];
+  float     perCall;
+  uint32_t  calls;
+};
+
+static BenchResult  results[BENCH_MAX_RESULTS];
+static uint8_t      numResults(0);
+
+// Everything a benchmark computes ends up in here, so none of it gets
+// optimized away
+static volatile uint32_t benchSink(0);
+
+#ifdef ARDUINO
+static const char* BENCH_UNIT("cycles");
+#else
+static const char* BENCH_UNIT("ns");
+#endif
+
+
+// Best of BENCH_BATCHES batches of [calls] calls to [fn](n)
+template <typename F>
+static void timeIt(const char* name, uint32_t calls, F fn)
+{
+  uint32_t best(UINT32_MAX);
+  for (uint8_t batch(0); batch < BENCH_BATCHES; ++batch)
+  {
+    uint32_t sink(0);
+    uint32_t start(halCycles());
+    for (uint32_t n(0); n < calls; ++n)
+    {
+      sink += fn(n);
+    }
+    uint32_t elapsed(halCycles() - start);
+    benchSink = benchSink + sink;
+    best = std::min(best, elapsed);
+  }
+
+  float perCall((float)best / calls);
+  printf("bench,%s,%s,%.1f,%lu\n", name, BENCH_UNIT, perCall, (unsigned long)calls);
+
+  if (numResults < BENCH_MAX_RESULTS)
+  {
+    BenchResult& res(results[numResults++]);
+    snprintf(res.name, sizeof(res.name), "%s", name);
+    snprintf(res.unit, sizeof(res.unit), "%s", BENCH_UNIT);
+    res.perCall = perCall;
+    res.calls   = calls;
+  }
+}
+
+
+void runBenchmarks(uint32_t calls)
+{
+  numResults = 0;
+
+  // Nothing but the loop and the call, for scale
+  timeIt("overhead", calls, [](uint32_t n)
+  {
+    return n;
+  });
+
+  // A sequencer of its own for the transport, so these don't disturb the
+  // one that's playing
+  SeqState        state;
+  TransportParams transport(state);
+  Stochasticizer  coin;
+  coin.latch(1600, 0);                    // LOOP knob halfway: every step's a coin toss
+  state.reg = 0xA5C3;
+
+  timeIt("TransportParams::iterate", calls, [&](uint32_t n)
+  {
+    transport.pre_iterate((n & 0x07) ? 1 : -1, false);
+    transport.iterate(coin);
+    return (uint32_t)state.reg;
+  });
+
+  ShiftParams shift;
+  timeIt("ShiftParams::getShiftParams", calls, [&](uint32_t n)
+  {
+    shift.getShiftParams(transport, (n & 0x01) ? 1 : -1, (n & 0x06) == 0);
+    return (uint32_t)shift.readIdx() + shift.writeIdx();
+  });
+
+  timeIt("ShiftParams::rotateToZero", calls, [&](uint32_t n)
+  {
+    return (uint32_t)shift.rotateToZero(0xA5C3 ^ n, (int8_t)(n % 31) - 15);
+  });
+
+  timeIt("TuringRegister::norm", calls, [](uint32_t n)
+  {
+    return (uint32_t)alan.norm(0xA5C3 ^ n, 1 + n % 16);
+  });
+
+  timeIt("markov", calls, [](uint32_t n)
+  {
+    return (uint32_t)markov(n);
+  });
+
+  timeIt("TuringRegister::pulseIt", calls, [](uint32_t n)
+  {
+    (void)n;
+    return (uint32_t)alan.pulseIt();
+  });
+
+  timeIt("Stochasticizer::stochasticize", calls, [&](uint32_t n)
+  {
+    return (uint32_t)coin.stochasticize(n & 0x01);
+  });
+
+  // The arithmetic half of expandVoltages(), on its own
+  uint16_t faderVals[NUM_FADERS]{100, 200, 300, 400, 500, 600, 700, 800};
+  CvMixer  mixer;
+  timeIt("CvMixer::mix", calls, [&](uint32_t n)
+  {
+    uint16_t noteVals[NUM_DAC_CHANNELS];
+    mixer.mix((uint8_t)n, faderVals, (n & 0x100) ? OUT_SWAP_AB : 0, noteVals);
+    return (uint32_t)noteVals[0] + noteVals[3];
+  });
+
+#ifdef ARDUINO
+  // ...and the whole thing, out to the DACs. Fresh fader values every
+  // time, so it can't take the nothing-changed shortcut. There's no host
+  // version of this one: the stand-in board doesn't do what the real
+  // one does.
+  timeIt("expandVoltages", calls, [&](uint32_t n)
+  {
+    expandVoltages((uint8_t)n, faderVals);
+    return n;
+  });
+#endif
+
+  // Turning the encoder fast with the clock stopped: the detents one at a
+  // time, the way they used to be handled, against the whole burst in one
+  // go. Back and forth alternately, so the sequencer ends up where it
+  // started.
+  timeIt("spin: single detents", calls / BENCH_SPIN_DETENTS, [](uint32_t n)
+  {
+    int8_t dir((n & 0x01) ? -1 : 1);
+    for (int8_t detent(0); detent < BENCH_SPIN_DETENTS; ++detent)
+    {
+      alan.iterate(dir, true);
+    }
+    return (uint32_t)alan.getPattern();
+  });
+
+  timeIt("spin: one burst", calls / BENCH_SPIN_DETENTS, [](uint32_t n)
+  {
+    alan.iterate((n & 0x01) ? -BENCH_SPIN_DETENTS : BENCH_SPIN_DETENTS, true);
+    return (uint32_t)alan.getPattern();
+  });
+}
+
+
+#ifndef ARDUINO
+////////////////////////////////////////////////////////////////
+//                      HOST
+////////////////////////////////////////////////////////////////
+
+// Reads every "bench," line out of [path] (a previous run, or a log off
+// the board's serial port)
+static uint8_t readResults(const char* path, BenchResult* out)
+{
+  FILE* file(fopen(path, "r"));
+  if (!file)
+  {
+    fprintf(stderr, "can't open %s\n", path);
+    return 0;
+  }
+
+  uint8_t count(0);
+  char    line[128];
+  while (count < BENCH_MAX_RESULTS && fgets(line, sizeof(line), file))
+  {
+    BenchResult&  res(out[count]);
+    unsigned long calls;
+    if (sscanf(line, "bench,%31[^,],%7[^,],%f,%lu", res.name, res.unit, &res.perCall, &calls) == 4)
+    {
+      res.calls = calls;
+      ++count;
+    }
+  }
+  fclose(file);
+  return count;
+}
+
+
+// One line per benchmark that's in both:
+//
+//   compare,<name>,<unit>,<baseline>,<now>,<change %>,ok|REGRESSION
+//
+// Returns how many got slower by more than [thresholdPct] (and more than
+// BENCH_MIN_DELTA)
+static uint8_t compare(const BenchResult* baseline, uint8_t numBaseline,
+                       const BenchResult* current,  uint8_t numCurrent,
+                       uint8_t thresholdPct)
+{
+  uint8_t regressions(0);
+  for (uint8_t cur(0); cur < numCurrent; ++cur)
+  {
+    for (uint8_t base(0); base < numBaseline; ++base)
+    {
+      if (strcmp(current[cur].name, baseline[base].name)
+       || strcmp(current[cur].unit, baseline[base].unit)
+       || baseline[base].perCall <= 0.0f)
+      {
+        continue;
+      }
+
+      float delta (current[cur].perCall - baseline[base].perCall);
+      float change(100.0f * delta / baseline[base].perCall);
+      bool  worse (change > thresholdPct && delta >= BENCH_MIN_DELTA);
+      regressions += worse;
+      printf("compare,%s,%s,%.1f,%.1f,%+.1f,%s\n",
+             current[cur].name,
+             current[cur].unit,
+             baseline[base].perCall,
+             current[cur].perCall,
+             change,
+             worse ? "REGRESSION" : "ok");
+      break;
+    }
+  }
+  return regressions;
+}
+
+
+int main(int argc, char** argv)
+{
+  const char* baselinePath(nullptr);
+  const char* resultsPath (nullptr);
+  uint8_t     thresholdPct(BENCH_THRESHOLD_PCT);
+  uint32_t    calls       (BENCH_CALLS);
+
+  for (int arg(1); arg < argc; ++arg)
+  {
+    if (!strcmp(argv[arg], "-b") && arg + 1 < argc)
+    {
+      baselinePath = argv[++arg];
+    }
+    else if (!strcmp(argv[arg], "-c") && arg + 2 < argc)
+    {
+      baselinePath = argv[++arg];
+      resultsPath  = argv[++arg];
+    }
+    else if (!strcmp(argv[arg], "-t") && arg + 1 < argc)
+    {
+      thresholdPct = atoi(argv[++arg]);
+    }
+    else if (!strcmp(argv[arg], "-n") && arg + 1 < argc)
+    {
+      calls = std::max(1L, atol(argv[++arg]));
+    }
+    else
+    {
+      fprintf(stderr, "usage: %s [-b baseline.csv] [-t percent] [-n calls]\n"
+                      "       %s -c baseline.csv results.csv [-t percent]\n", argv[0], argv[0]);
+      return 2;
+    }
+  }
+
+  const BenchResult* current(results);
+  uint8_t            numCurrent;
+  BenchResult        loaded[BENCH_MAX_RESULTS];
+  if (resultsPath)
+  {
+    numCurrent = readResults(resultsPath, loaded);
+    current    = loaded;
+  }
+  else
+  {
+    // Same inputs every run
+    randomSeed(1);
+    halHostSetAdcMv(LOOP_CTRL, 1600);
+    modMatrix.sample();
+    alan.restoreBanks();
+
+    runBenchmarks(calls);
+    numCurrent = numResults;
+  }
+
+  if (!baselinePath)
+  {
+    return 0;
+  }
+
+  BenchResult baseline[BENCH_MAX_RESULTS];
+  uint8_t     numBaseline(readResults(baselinePath, baseline));
+  if (!numBaseline)
+  {
+    return 2;
+  }
+  return compare(baseline, numBaseline, current, numCurrent, thresholdPct) ? 1 : 0;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,283 @@
+#include "calibration.h"
+#include "nvstore.h"
+
+// Bump this if CalPoints ever changes shape so stale data gets ignored
+const uint8_t CAL_VERSION(1);
+
+const char* const CAL_KEYS[NUM_DAC_CHANNELS]{"ch0", "ch1", "ch2", "ch3"};
+
+DacCalibration dacCal;
+NvStore        calStore("daccal");
+
+
+DacCalibration::DacCalibration()
+{
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    points_[ch].version   = CAL_VERSION;
+    points_[ch].validMask = 0;
+    for (uint8_t pt(0); pt < NUM_CAL_POINTS; ++pt)
+    {
+      points_[ch].code[pt] = 0;
+    }
+    rebuild(ch);
+  }
+}
+
+
+void DacCalibration::load()
+{
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    CalPoints stored;
+    if (calStore.load(CAL_KEYS[ch], &stored, sizeof(stored))
+     && stored.version == CAL_VERSION)
+    {
+      points_[ch] = stored;
+      dbprintf("DAC %u calibration loaded (points 0x%02x)\n", ch, stored.validMask);
+    }
+    rebuild(ch);
+  }
+}
+
+
+bool DacCalibration::save()
+{
+  bool ok(true);
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    ok = calStore.store(CAL_KEYS[ch], &points_[ch], sizeof(CalPoints)) && ok;
+  }
+
+  dbprintf("DAC calibration %s\n", ok ? "saved" : "NOT saved");
+  return ok;
+}
+
+
+void DacCalibration::setPoint(uint8_t ch, uint8_t point, uint16_t code)
+{
+  points_[ch].code[point] = code;
+  bitSet(points_[ch].validMask, point);
+}
+
+
+void DacCalibration::clearPoint(uint8_t ch, uint8_t point)
+{
+  bitClear(points_[ch].validMask, point);
+}
+
+
+bool DacCalibration::hasPoint(uint8_t ch, uint8_t point) const
+{
+  return bitRead(points_[ch].validMask, point);
+}
+
+
+uint8_t DacCalibration::validMask(uint8_t ch) const
+{
+  return points_[ch].validMask;
+}
+
+
+// Straight line through (loNote, loCode) and (hiNote, hiCode), evaluated at
+// [note] and clamped to what the DAC can actually do
+uint16_t DacCalibration::interpolate(uint8_t note, uint8_t loNote, uint8_t hiNote,
+                                     uint16_t loCode, uint16_t hiCode) const
+{
+  int32_t num(((int32_t)hiCode - loCode) * ((int32_t)note - loNote));
+  int32_t den(hiNote - loNote);
+
+  // Round to nearest rather than towards zero
+  int32_t val(loCode + (num >= 0 ? (num + den / 2) / den
+                                 : (num - den / 2) / den));
+  if (val < 0)
+  {
+    return 0;
+  }
+  if (val > DAC_MAX_CODE)
+  {
+    return DAC_MAX_CODE;
+  }
+  return (uint16_t)val;
+}
+
+
+// With no measured points, this is the nominal scale. One point gives you an
+// offset with nominal gain, two give you offset and gain, and any more than
+// that become a piecewise-linear correction curve. Below the first and above
+// the last point, the nearest segment is extended.
+void DacCalibration::rebuild(uint8_t ch)
+{
+  uint8_t  notes[NUM_CAL_POINTS];
+  uint16_t codes[NUM_CAL_POINTS];
+  uint8_t  count(0);
+
+  for (uint8_t pt(0); pt < NUM_CAL_POINTS; ++pt)
+  {
+    if (hasPoint(ch, pt))
+    {
+      notes[count] = pt * CAL_NOTES_PER_POINT;
+      codes[count] = points_[ch].code[pt];
+      ++count;
+    }
+  }
+
+  if (count == 0)
+  {
+    notes[0] = 0;
+    codes[0] = 0;
+    ++count;
+  }
+
+  if (count == 1)
+  {
+    notes[1] = notes[0] + CAL_NOTES_PER_POINT;
+    codes[1] = codes[0] + DAC_NOMINAL_CODES_PER_OCTAVE;
+    ++count;
+  }
+
+  uint8_t seg(0);
+  for (uint8_t note(0); note < CAL_NUM_NOTES; ++note)
+  {
+    // Advance to the segment containing this note (or the last one)
+    while (seg < count - 2 && note >= notes[seg + 1])
+    {
+      ++seg;
+    }
+
+    table_[ch][note] = interpolate(note,
+                                   notes[seg], notes[seg + 1],
+                                   codes[seg], codes[seg + 1]);
+  }
+}
+
+
+#ifdef ARDUINO
+////////////////////////////////////////////////////////////////
+//                    CALIBRATION MODE
+////////////////////////////////////////////////////////////////
+
+#include "hwio.h"
+#include "faderScan.h"
+#include "setup.h"
+#include "timers.h"
+#include "toggle.h"
+
+// How far one encoder detent moves the DAC code while the button is held
+const int8_t  CAL_COARSE_STEP(32);
+
+// Highest fader that's been pushed up selects the calibration point. The
+// scan task's still servicing the faders, so this goes through it rather
+// than reading them under its feet.
+uint8_t selectedCalPoint()
+{
+  uint8_t point(0);
+  for (uint8_t fd(0); fd < NUM_FADERS && fd < NUM_CAL_POINTS; ++fd)
+  {
+    if (faderScan.read(fd) > 0)
+    {
+      point = fd;
+    }
+  }
+  return point;
+}
+
+
+void calibrate()
+{
+  uint8_t  ch(0);
+  uint8_t  point(selectedCalPoint());
+  int16_t  trim(0);
+  int32_t  lastCode(-1);
+  uint16_t lastLeds(0xFFFF);
+
+  mode.startCalibration();
+  dbprintf("Calibrating DAC %u\n", ch);
+
+  while (true)
+  {
+    uint8_t newPoint(selectedCalPoint());
+    if (newPoint != point)
+    {
+      point = newPoint;
+      trim  = 0;
+    }
+
+    ModeCommand cmd(mode.update());
+    switch (cmd.cmd)
+    {
+      case command_enum::CAL_TRIM:
+        trim += cmd.val;
+        break;
+
+      case command_enum::CAL_COARSE:
+        trim += cmd.val * CAL_COARSE_STEP;
+        break;
+
+      case command_enum::CAL_CHANNEL:
+        output.setChannelVal(ch, 0);
+        ch    = (ch + 1) % NUM_DAC_CHANNELS;
+        trim  = 0;
+        dbprintf("Calibrating DAC %u\n", ch);
+        break;
+
+      case command_enum::CAL_DONE:
+        dacCal.save();
+        mode.cancel();
+        return;
+
+      default:
+        break;
+    }
+
+    int32_t code(dacCal.code(ch, point * CAL_NOTES_PER_POINT) + trim);
+    if (code < 0)
+    {
+      code = 0;
+    }
+    else if (code > DAC_MAX_CODE)
+    {
+      code = DAC_MAX_CODE;
+    }
+
+    ButtonState up(writeHigh.readAndFree());
+    ButtonState down(writeLow.readAndFree());
+    if (up == ButtonState::Clicked || up == ButtonState::Held)
+    {
+      dacCal.setPoint(ch, point, code);
+      dacCal.rebuild(ch);
+      trim = 0;
+      dbprintf("DAC %u point %u = %d\n", ch, point, code);
+    }
+    else if (down == ButtonState::Clicked || down == ButtonState::Held)
+    {
+      dacCal.clearPoint(ch, point);
+      dacCal.rebuild(ch);
+      trim = 0;
+      dbprintf("DAC %u point %u cleared\n", ch, point);
+    }
+
+    if (code != lastCode)
+    {
+      output.setChannelVal(ch, code);
+      lastCode = code;
+    }
+
+    // Main LEDs: channel. Fader LEDs: stored points, with the one being
+    // tuned blinking
+    uint8_t pointLeds(dacCal.validMask(ch));
+    bitWrite(pointLeds, point, getFlashTimer() & BIT0);
+    uint16_t leds((ch << 8) | pointLeds);
+    if (leds != lastLeds)
+    {
+      panelLeds.setMain_all(0x01 << ch);
+      panelLeds.setFader_all(pointLeds);
+      lastLeds = leds;
+    }
+
+    // Nothing here changes faster than the encoder gets serviced
+    vTaskDelay(pdMS_TO_TICKS(ENC_SERVICE_MS));
+  }
+}
+
+#endif
@@ -0,0 +1,27 @@
+#include "clockRate.h"
+
+// Smoothed time between clock pulses
+uint32_t clockPeriod(500000UL);
+uint32_t lastClockMicros(0);
+
+uint32_t clockPeriodMicros()
+{
+  return clockPeriod;
+}
+
+
+uint32_t lastClockEdgeMicros()
+{
+  return lastClockMicros;
+}
+
+
+void clockEdge(uint32_t now)
+{
+  uint32_t period(now - lastClockMicros);
+  lastClockMicros = now;
+  if (period < CLOCK_TIMEOUT_MICROS)
+  {
+    clockPeriod = (3 * clockPeriod + period) / 4;
+  }
+}
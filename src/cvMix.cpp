@@ -0,0 +1,55 @@
+#include "cvMix.h"
+#include "scene.h"
+
+
+CvMixer::CvMixer():
+  heldD_  (0),
+  primed_ (false)
+{ ; }
+
+
+void CvMixer::mix(uint8_t        shiftReg,
+                  const uint16_t faderVals[NUM_FADERS],
+                  uint8_t        outFlags,
+                  uint16_t       noteVals[NUM_DAC_CHANNELS])
+{
+  noteVals[0] = 0;
+  noteVals[1] = 0;
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    if (bitRead(shiftReg, ch))
+    {
+      // CV A: Faders & register
+      noteVals[0] += faderVals[ch];
+    }
+    else
+    {
+      // CV B: Faders & ~register
+      noteVals[1] += faderVals[ch];
+    }
+  }
+
+  // CV C: abs(CV A - CV B)
+  if (noteVals[0] > noteVals[1])
+  {
+    noteVals[2] = noteVals[0] - noteVals[1];
+  }
+  else
+  {
+    noteVals[2] = noteVals[1] - noteVals[0];
+  }
+
+  // CV D: same as CV A, but only changes when BIT 0 is high (and starts
+  // out wherever CV A first was)
+  if (bitRead(shiftReg, 0) || !primed_)
+  {
+    heldD_  = noteVals[0];
+    primed_ = true;
+  }
+  noteVals[3] = heldD_;
+
+  if (outFlags & OUT_SWAP_AB)
+  {
+    std::swap(noteVals[0], noteVals[1]);
+  }
+}
@@ -0,0 +1,184 @@
+#include "dacBatch.h"
+#include "hwio.h"
+#include <Wire.h>
+#include <RatFuncs.h>
+
+DacBatch dacBatch;
+
+#ifdef RATDEBUG
+const uint16_t DAC_LOG_INTERVAL(1024);   // Commits between stats dumps
+#endif
+
+
+DacBatch::DacBatch():
+  dirty_  (true),
+  present_(false)
+{
+  memset(staged_,    0, sizeof(staged_));
+  memset(committed_, 0, sizeof(committed_));
+  memset(&stats_,    0, sizeof(stats_));
+}
+
+
+void DacBatch::begin()
+{
+  Wire.beginTransmission(MCP4728_ADDR);
+  present_ = (Wire.endTransmission() == 0);
+  if (!present_)
+  {
+    dbprintf("dac: no MCP4728 at 0x%02x, writing channels one at a time\n", MCP4728_ADDR);
+  }
+}
+
+
+void DacBatch::stage(uint8_t ch, uint16_t code)
+{
+  if (ch >= NUM_DAC_CHANNELS)
+  {
+    return;
+  }
+
+  if (code > DAC_MAX_CODE)
+  {
+    code = DAC_MAX_CODE;
+  }
+  staged_[ch] = code;
+  if (code != committed_[ch])
+  {
+    dirty_ = true;
+  }
+}
+
+
+bool DacBatch::commit()
+{
+  if (!dirty_)
+  {
+    ++stats_.skipped;
+    return true;
+  }
+
+  if (!(present_ ? commitLatched() : commitUnlatched()))
+  {
+    dbprintln("DAC batch write failed");
+    return false;
+  }
+
+  memcpy(committed_, staged_, sizeof(committed_));
+  dirty_ = false;
+  ++stats_.commits;
+
+#ifdef RATDEBUG
+  if (stats_.commits % DAC_LOG_INTERVAL == 0)
+  {
+    logStats();
+  }
+#endif
+  return true;
+}
+
+
+bool DacBatch::commitLatched()
+{
+  // Fast Write: two bytes per channel, A through D, power-down bits zero
+  uint32_t start(micros());
+  Wire.beginTransmission(MCP4728_ADDR);
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    Wire.write((staged_[ch] >> 8) & 0x0F);
+    Wire.write(staged_[ch] & 0xFF);
+  }
+  bool ok(Wire.endTransmission() == 0);
+  uint32_t loaded(micros());
+
+  // Everybody move
+  Wire.beginTransmission(I2C_GENERAL_CALL);
+  Wire.write(GC_SOFTWARE_UPDATE);
+  ok = (Wire.endTransmission() == 0) && ok;
+  uint32_t latched(micros());
+
+  if (!ok)
+  {
+    return false;
+  }
+
+  stats_.loadMicros  = loaded - start;
+  stats_.latchMicros = latched - loaded;
+  if (latched - start > stats_.maxTotalMicros)
+  {
+    stats_.maxTotalMicros = latched - start;
+  }
+  return true;
+}
+
+
+// No MCP4728: the library writes each channel that changed, and each one
+// moves as soon as its write's done
+bool DacBatch::commitUnlatched()
+{
+  uint32_t start(micros());
+  uint32_t first(0);
+  uint32_t last (0);
+  bool     any  (false);
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    if (staged_[ch] == committed_[ch])
+    {
+      continue;
+    }
+    output.setChannelVal(ch, staged_[ch]);
+    last = micros();
+    if (!any)
+    {
+      first = last;
+      any   = true;
+    }
+  }
+  uint32_t done(micros());
+
+  stats_.loadMicros  = done - start;
+  stats_.latchMicros = 0;
+  stats_.skewMicros  = last - first;
+  if (stats_.skewMicros > stats_.maxSkewMicros)
+  {
+    stats_.maxSkewMicros = stats_.skewMicros;
+  }
+  if (done - start > stats_.maxTotalMicros)
+  {
+    stats_.maxTotalMicros = done - start;
+  }
+  return true;
+}
+
+
+const DacBatchStats& DacBatch::stats() const
+{
+  return stats_;
+}
+
+
+void DacBatch::logStats() const
+{
+  if (present_)
+  {
+    // There's no seeing the outputs move from here, so no skew figure:
+    // the MCP4728 moves all four together on the update
+    dbprintf("dac: %lu commits (%lu skipped), %lu us total (load %lu + latch %lu, max %lu), latched\n",
+             (unsigned long)stats_.commits,
+             (unsigned long)stats_.skipped,
+             (unsigned long)(stats_.loadMicros + stats_.latchMicros),
+             (unsigned long)stats_.loadMicros,
+             (unsigned long)stats_.latchMicros,
+             (unsigned long)stats_.maxTotalMicros);
+    return;
+  }
+
+  dbprintf("dac: %lu commits (%lu skipped), %lu us total (max %lu), unlatched; "
+           "first to last channel %lu us (max %lu)\n",
+           (unsigned long)stats_.commits,
+           (unsigned long)stats_.skipped,
+           (unsigned long)stats_.loadMicros,
+           (unsigned long)stats_.maxTotalMicros,
+           (unsigned long)stats_.skewMicros,
+           (unsigned long)stats_.maxSkewMicros);
+}
@@ -0,0 +1,293 @@
+#include "events.h"
+#include "handlers.h"
+#include "setup.h"
+#include "toggle.h"
+#include "inputs.h"
+#include "hal.h"
+
+EventQueue inputEvents;
+
+// LED_FRAME comes around this often (in timer ticks, i.e. msec)
+const uint8_t LED_FRAME_TICKS(1000 / LED_MAX_FPS);
+
+
+EventQueue::EventQueue():
+  queue_          (NULL),
+  store_          (nullptr),
+  ledFramePending_(false),
+  ledTicks_       (0),
+  dropped_        (0)
+#ifdef RATDEBUG
+  , merged_       (0)
+  , busyMicros_   (0)
+  , windowStart_  (0)
+#endif
+{
+#ifdef RATDEBUG
+  memset(count_,      0, sizeof(count_));
+  memset(latency_,    0, sizeof(latency_));
+  memset(maxLatency_, 0, sizeof(maxLatency_));
+  memset(handlerMicros_, 0, sizeof(handlerMicros_));
+#endif
+}
+
+
+void EventQueue::begin(EventStore* store)
+{
+  store_ = store;
+#ifdef ARDUINO
+  if (!store_)
+  {
+    queue_ = xQueueCreate(EVT_QUEUE_LEN, sizeof(InputEvent));
+  }
+#endif
+#ifdef RATDEBUG
+  windowStart_ = halMicros();
+#endif
+}
+
+
+void IRAM_ATTR EventQueue::post(evt_type type, uint8_t a, uint8_t b)
+{
+  InputEvent ev{type, a, b, halMicros()};
+  if (!push(ev))
+  {
+    dropped_ = dropped_ + 1;
+  }
+}
+
+
+bool IRAM_ATTR EventQueue::push(const InputEvent& ev)
+{
+#ifdef ARDUINO
+  if (!store_)
+  {
+    BaseType_t woken(pdFALSE);
+    if (xQueueSendFromISR(queue_, &ev, &woken) != pdTRUE)
+    {
+      return false;
+    }
+    if (woken)
+    {
+      portYIELD_FROM_ISR();
+    }
+    return true;
+  }
+#endif
+  return store_->push(ev);
+}
+
+
+bool EventQueue::pop(InputEvent& ev, TickType_t timeout)
+{
+#ifdef ARDUINO
+  if (!store_)
+  {
+    return xQueueReceive(queue_, &ev, timeout) == pdTRUE;
+  }
+#endif
+  return store_->pop(ev, timeout);
+}
+
+
+bool EventQueue::peek(InputEvent& ev)
+{
+#ifdef ARDUINO
+  if (!store_)
+  {
+    return xQueuePeek(queue_, &ev, 0) == pdTRUE;
+  }
+#endif
+  return store_->peek(ev);
+}
+
+
+static bool toggleEvent(ButtonState state)
+{
+  return state == ButtonState::Clicked
+      || state == ButtonState::DoubleClicked
+      || state == ButtonState::Held;
+}
+
+
+// Same checks loop() used to make, but only once per tick, and nobody
+// wakes up unless one of them comes back with something
+void IRAM_ATTR EventQueue::pollSources()
+{
+  if (!queue_ && !store_)
+  {
+    return;
+  }
+
+  if (newClock())
+  {
+    post(evt_type::CLOCK_RISE);
+  }
+  else if (clockDown())
+  {
+    post(evt_type::CLOCK_FALL);
+  }
+
+  if (newReset())
+  {
+    post(evt_type::RESET);
+  }
+
+  encEvnts enc(mode.pollEncoder());
+  if (enc != encEvnts::NUM_ENC_EVNTS)
+  {
+    post(evt_type::ENCODER, static_cast<uint8_t>(enc));
+  }
+
+  ButtonState low (writeLow.readAndFree());
+  ButtonState high(writeHigh.readAndFree());
+  if (toggleEvent(low) || toggleEvent(high))
+  {
+    post(evt_type::TOGGLE, static_cast<uint8_t>(low), static_cast<uint8_t>(high));
+  }
+
+  // One LED frame in the queue at a time is plenty
+  if (++ledTicks_ >= LED_FRAME_TICKS)
+  {
+    ledTicks_ = 0;
+    if (!ledFramePending_)
+    {
+      ledFramePending_ = true;
+      post(evt_type::LED_FRAME);
+    }
+  }
+}
+
+
+uint8_t EventQueue::takeRepeats(const InputEvent& ev)
+{
+  uint8_t    repeats(1);
+  InputEvent next;
+  while (repeats < MAX_ENC_BURST
+      && peek(next)
+      && next.type == evt_type::ENCODER
+      && next.a    == ev.a)
+  {
+    pop(next, 0);
+    ++repeats;
+  }
+#ifdef RATDEBUG
+  merged_ += repeats - 1;
+#endif
+  return repeats;
+}
+
+
+bool EventQueue::dispatchNext(TickType_t timeout)
+{
+  InputEvent ev;
+  if ((!queue_ && !store_) || !pop(ev, timeout))
+  {
+    return false;
+  }
+
+#ifdef RATDEBUG
+  uint32_t start(halMicros());
+  uint8_t  type(static_cast<uint8_t>(ev.type));
+  uint32_t late(start - ev.micros);
+  ++count_[type];
+  latency_[type] += late;
+  if (late > maxLatency_[type])
+  {
+    maxLatency_[type] = late;
+  }
+#endif
+
+  switch (ev.type)
+  {
+    case evt_type::ENCODER:
+    {
+      encEvnts evt(static_cast<encEvnts>(ev.a));
+      onEncoder(evt, isTurn(evt) ? takeRepeats(ev) : 1);
+      break;
+    }
+
+    case evt_type::TOGGLE:
+      onToggle(static_cast<ButtonState>(ev.a), static_cast<ButtonState>(ev.b));
+      // Bailing out of a mode takes one more trip through the mode
+      // control, which the polled loop would have got to on its next pass
+      if (mode.currentMode() == mode_type::CANCEL)
+      {
+        onEncoder(encEvnts::NUM_ENC_EVNTS);
+      }
+      break;
+
+    case evt_type::CLOCK_RISE:
+      onClockRise(ev.micros);
+      break;
+
+    case evt_type::CLOCK_FALL:
+      onClockFall();
+      break;
+
+    case evt_type::RESET:
+      onReset();
+      break;
+
+    case evt_type::LED_FRAME:
+      ledFramePending_ = false;
+      onLedFrame();
+      break;
+
+    case evt_type::NUM_EVENTS:
+    default:
+      break;
+  }
+
+#ifdef RATDEBUG
+  uint32_t took(halMicros() - start);
+  busyMicros_          += took;
+  handlerMicros_[type] += took;
+#endif
+  return true;
+}
+
+
+void EventQueue::logStats()
+{
+#ifdef RATDEBUG
+  uint32_t now(halMicros());
+  uint32_t window(now - windowStart_);
+  if (window < 1000000UL)
+  {
+    return;
+  }
+
+  // Whatever loop() didn't spend handling events, it spent asleep (which
+  // is as close as we get to measuring power from in here)
+  uint32_t busyPermille(busyMicros_ / (window / 1000));
+  dbprintf("events: busy %lu.%lu%%, idle %lu.%lu%%, %lu dropped, %lu knob events merged\n",
+           (unsigned long)(busyPermille / 10), (unsigned long)(busyPermille % 10),
+           (unsigned long)((1000 - busyPermille) / 10), (unsigned long)((1000 - busyPermille) % 10),
+           (unsigned long)dropped_,
+           (unsigned long)merged_);
+
+  const char* names[NUM_EVT_TYPES]{"enc", "toggle", "clk+", "clk-", "reset", "leds"};
+  for (uint8_t type(0); type < NUM_EVT_TYPES; ++type)
+  {
+    if (!count_[type])
+    {
+      continue;
+    }
+    dbprintf("  %-6s %5lu, latency %lu us avg, %lu max, handler %lu us avg\n",
+             names[type],
+             (unsigned long)count_[type],
+             (unsigned long)(latency_[type] / count_[type]),
+             (unsigned long)maxLatency_[type],
+             (unsigned long)(handlerMicros_[type] / count_[type]));
+  }
+
+  memset(count_,      0, sizeof(count_));
+  memset(latency_,    0, sizeof(latency_));
+  memset(maxLatency_, 0, sizeof(maxLatency_));
+  memset(handlerMicros_, 0, sizeof(handlerMicros_));
+  merged_      = 0;
+  busyMicros_  = 0;
+  windowStart_ = now;
+#endif
+}
@@ -0,0 +1,217 @@
+#include "faderScan.h"
+#include "hwio.h"
+#include <RatFuncs.h>
+
+FaderScanner faderScan;
+
+#ifdef RATDEBUG
+const uint16_t FADER_LOG_INTERVAL(4096);   // Passes between stats dumps
+#endif
+
+
+void faderScanTask(void *param)
+{
+  FaderScanner* scanner(static_cast<FaderScanner*>(param));
+  TickType_t    lastWake(xTaskGetTickCount());
+  while (1)
+  {
+    vTaskDelayUntil(&lastWake, scanner->period());
+    scanner->scan();
+  }
+}
+
+
+FaderScanner::FaderScanner():
+  samples_    (0),
+  restart_    (false),
+  periodTicks_(1),
+  taskHandle_ (NULL)
+#ifdef RATDEBUG
+  , passes_           (0)
+  , serviceMicros_    (0)
+  , maxServiceMicros_ (0)
+#endif
+{
+  memset(sums_,  0, sizeof(sums_));
+  memset(&frame_, 0, sizeof(frame_));
+  setRate(FADER_SCAN_HZ);
+}
+
+
+void FaderScanner::begin()
+{
+  // Prime the published values so nothing reads zeros while the first
+  // average fills up
+  faders.service();
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    frame_.values[ch] = faders.read(ch);
+  }
+  published_.store(frame_);
+
+  // Below the timer callbacks (which is where most of the readers live),
+  // above the slew task
+  xTaskCreate
+  (
+    faderScanTask,
+    "faderScan Task",
+    2048,
+    this,
+    8,
+    &taskHandle_
+  );
+}
+
+
+void FaderScanner::setRate(uint16_t hz)
+{
+  TickType_t ticks(pdMS_TO_TICKS(1000 / (hz ? hz : 1)));
+  periodTicks_ = (ticks < 1) ? 1 : ticks;
+}
+
+
+TickType_t FaderScanner::period() const
+{
+  return periodTicks_;
+}
+
+
+void FaderScanner::scan()
+{
+  uint32_t start(micros());
+  faders.service();
+  uint32_t took(micros() - start);
+
+  if (restart_)
+  {
+    restart_ = false;
+    rebase();
+  }
+
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    sums_[ch] += faders.read(ch);
+  }
+
+  if (++samples_ == FADER_OVERSAMPLE)
+  {
+    publish();
+    samples_ = 0;
+    memset(sums_, 0, sizeof(sums_));
+  }
+
+#ifdef RATDEBUG
+  serviceMicros_ += took;
+  if (took > maxServiceMicros_)
+  {
+    maxServiceMicros_ = took;
+  }
+  if (++passes_ % FADER_LOG_INTERVAL == 0)
+  {
+    // The channels are converted one after another inside service(), so
+    // that's also about how stale fader 0 is by the time fader 7 is read
+    dbprintf("faderScan: service %lu us avg (max %lu) taken out of the ISR, "
+             "~%lu us ch-to-ch, version %lu, %lu reader retries\n",
+             (unsigned long)(serviceMicros_ / FADER_LOG_INTERVAL),
+             (unsigned long)maxServiceMicros_,
+             (unsigned long)(serviceMicros_ / FADER_LOG_INTERVAL / NUM_FADERS),
+             (unsigned long)frame_.version,
+             (unsigned long)published_.retries());
+    serviceMicros_    = 0;
+    maxServiceMicros_ = 0;
+  }
+#else
+  (void)took;
+#endif
+}
+
+
+// Averages what's been collected, and passes on any fader whose note
+// changed
+void FaderScanner::publish()
+{
+  uint16_t avg[NUM_FADERS];
+  uint8_t  moved(0);
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    avg[ch] = (sums_[ch] + FADER_OVERSAMPLE / 2) / FADER_OVERSAMPLE;
+    if (avg[ch] != frame_.values[ch])
+    {
+      moved |= (0x01 << ch);
+    }
+  }
+
+  if (!moved)
+  {
+    return;
+  }
+
+  ++frame_.version;
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    if (bitRead(moved, ch))
+    {
+      frame_.values[ch]    = avg[ch];
+      frame_.changedAt[ch] = frame_.version;
+    }
+  }
+  published_.store(frame_);
+}
+
+
+void FaderScanner::restart()
+{
+  restart_ = true;
+}
+
+
+// New bank: its values go out as they are, no averaging
+// (they're saved values, not noisy readings), and the average starts over
+void FaderScanner::rebase()
+{
+  samples_ = 0;
+  memset(sums_, 0, sizeof(sums_));
+
+  ++frame_.version;
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    frame_.values[ch]    = faders.read(ch);
+    frame_.changedAt[ch] = frame_.version;
+  }
+  published_.store(frame_);
+}
+
+
+uint32_t FaderScanner::version() const
+{
+  return published_.load().version;
+}
+
+
+uint16_t FaderScanner::read(uint8_t ch) const
+{
+  return published_.load().values[ch % NUM_FADERS];
+}
+
+
+uint32_t FaderScanner::snapshot(uint16_t vals[NUM_FADERS]) const
+{
+  FaderFrame frame(published_.load());
+  memcpy(vals, frame.values, sizeof(frame.values));
+  return frame.version;
+}
+
+
+uint8_t FaderScanner::changedSince(uint32_t version) const
+{
+  FaderFrame frame(published_.load());
+  uint8_t mask(0);
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    if (frame.changedAt[ch] > version)
+    {
+      mask |= (0x01 << ch);
+    }
+  }
+  return mask;
+}
@@ -0,0 +1,408 @@
+#include "hal.h"
+
+////////////////////////////////////////////////////////////////
+//                      ESP32
+////////////////////////////////////////////////////////////////
+#ifdef ARDUINO
+
+#include <soc/gpio_reg.h>
+#include <driver/pcnt.h>
+#include "hwio.h"
+#include "srBus.h"
+#include "dacBatch.h"
+
+static_assert(HAL_SR_LEDS     == static_cast<uint8_t>(sr_device::LEDS),     "HAL chains out of step with srBus");
+static_assert(HAL_SR_TRIGGERS == static_cast<uint8_t>(sr_device::TRIGGERS), "HAL chains out of step with srBus");
+
+
+// Event timestamps get taken with this from the timer ISR
+uint32_t IRAM_ATTR halMicros()
+{
+  return micros();
+}
+
+
+uint32_t halMillis()
+{
+  return millis();
+}
+
+
+uint32_t halCycles()
+{
+  return ESP.getCycleCount();
+}
+
+
+TickType_t halTicks()
+{
+  return xTaskGetTickCount();
+}
+
+
+bool halPinRead(uint8_t pin)
+{
+  return digitalRead(pin);
+}
+
+
+void halPinWrite(uint8_t pin, bool high)
+{
+  digitalWrite(pin, high ? HIGH : LOW);
+}
+
+
+uint64_t IRAM_ATTR halReadPins()
+{
+  return (uint64_t)REG_READ(GPIO_IN_REG)            // GPIO 0-31
+       | ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);  // GPIO 32-39
+}
+
+
+// The inputs we've got calibrated readers for use those
+uint16_t halAdcMv(uint8_t pin)
+{
+  switch (pin)
+  {
+    case CV_IN_A:       return cvA.readMiliVolts();
+    case CV_IN_B:       return cvB.readMiliVolts();
+    case LOOP_CTRL:     return cvLOOP.readMiliVolts();
+    case UNUSED_ANALOG: return cvAUX.readMiliVolts();
+    default:            return analogReadMilliVolts(pin);
+  }
+}
+
+
+void halDacWrite(uint8_t ch, uint16_t code)
+{
+  if (ch == HAL_INT_DAC)
+  {
+    voltsExp.outputVoltage((uint8_t)code);
+    return;
+  }
+  dacBatch.stage(ch, code);
+}
+
+
+void halDacLatch()
+{
+  dacBatch.commit();
+}
+
+
+void halShiftOut(uint8_t chain, uint16_t frame)
+{
+  srBus.post(static_cast<sr_device>(chain % HAL_NUM_SR), frame);
+}
+
+
+void halPcntBegin(uint8_t unit, uint8_t pinA, uint8_t pinB, uint16_t filter)
+{
+  pinMode(pinA, INPUT_PULLUP);
+  pinMode(pinB, INPUT_PULLUP);
+
+  // Both channels, each counting the edges of one line with the other as
+  // direction, so every edge of a full quadrature cycle counts
+  pcnt_unit_t   pcnt(static_cast<pcnt_unit_t>(unit));
+  pcnt_config_t cfg;
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.pulse_gpio_num = pinA;
+  cfg.ctrl_gpio_num  = pinB;
+  cfg.channel        = PCNT_CHANNEL_0;
+  cfg.unit           = pcnt;
+  cfg.pos_mode       = PCNT_COUNT_DEC;
+  cfg.neg_mode       = PCNT_COUNT_INC;
+  cfg.lctrl_mode     = PCNT_MODE_REVERSE;
+  cfg.hctrl_mode     = PCNT_MODE_KEEP;
+  cfg.counter_h_lim  = INT16_MAX;
+  cfg.counter_l_lim  = INT16_MIN;
+  pcnt_unit_config(&cfg);
+
+  cfg.pulse_gpio_num = pinB;
+  cfg.ctrl_gpio_num  = pinA;
+  cfg.channel        = PCNT_CHANNEL_1;
+  cfg.pos_mode       = PCNT_COUNT_INC;
+  cfg.neg_mode       = PCNT_COUNT_DEC;
+  pcnt_unit_config(&cfg);
+
+  pcnt_set_filter_value(pcnt, filter);
+  pcnt_filter_enable(pcnt);
+
+  pcnt_counter_pause(pcnt);
+  pcnt_counter_clear(pcnt);
+  pcnt_counter_resume(pcnt);
+}
+
+
+int16_t halPcntCount(uint8_t unit)
+{
+  int16_t count;
+  pcnt_get_counter_value(static_cast<pcnt_unit_t>(unit), &count);
+  return count;
+}
+
+
+bool halTaskStart(HalTaskFn fn,
+                  const char* name,
+                  uint32_t stackBytes,
+                  void* param,
+                  uint8_t priority,
+                  TaskHandle_t* handle)
+{
+  return xTaskCreate(fn, name, stackBytes, param, priority, handle) == pdPASS;
+}
+
+
+void halDelayUntil(TickType_t& lastWake, TickType_t period)
+{
+  vTaskDelayUntil(&lastWake, period);
+}
+
+
+#else // Host build
+////////////////////////////////////////////////////////////////
+//                      HOST
+////////////////////////////////////////////////////////////////
+
+#include <chrono>
+#include <random>
+#include <thread>
+
+const uint8_t HAL_HOST_PINS(40);
+const uint8_t HAL_HOST_PCNT_UNITS(8);
+
+static std::atomic<uint64_t> hostPins(0);
+static std::atomic<uint16_t> hostAdcMv[HAL_HOST_PINS];
+static uint16_t              hostDacStaged[NUM_DAC_CHANNELS + 1];
+static std::atomic<uint16_t> hostDac[NUM_DAC_CHANNELS + 1];
+static std::atomic<uint16_t> hostShiftReg[HAL_NUM_SR];
+static std::atomic<uint32_t> hostShiftCount[HAL_NUM_SR];
+static std::atomic<int16_t>  hostPcnt[HAL_HOST_PCNT_UNITS];
+static std::atomic<uint32_t> hostMicros(0);
+static std::minstd_rand      hostRandom(1);
+
+
+void randomSeed(unsigned long seed)
+{
+  hostRandom.seed(seed ? seed : 1);
+}
+
+
+long random(long howbig)
+{
+  return (howbig > 0) ? (long)(hostRandom() % (unsigned long)howbig) : 0;
+}
+
+
+long random(long howsmall, long howbig)
+{
+  return (howsmall >= howbig) ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+
+void printBits(uint8_t bits)
+{
+#ifdef RATDEBUG
+  for (int8_t bit(7); bit >= 0; --bit)
+  {
+    putchar(bitRead(bits, bit) ? '1' : '0');
+  }
+  putchar('\n');
+#else
+  (void)bits;
+#endif
+}
+
+
+void vTaskDelay(TickType_t ticks)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+
+uint32_t halMicros()
+{
+  return hostMicros.load();
+}
+
+
+uint32_t halMillis()
+{
+  return hostMicros.load() / 1000;
+}
+
+
+// Wall clock, not simulated time: this is for timing code, which has
+// to be real
+uint32_t halCycles()
+{
+  using namespace std::chrono;
+  return (uint32_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
+TickType_t halTicks()
+{
+  return halMillis();
+}
+
+
+bool halPinRead(uint8_t pin)
+{
+  return (hostPins.load() >> pin) & 0x01;
+}
+
+
+void halPinWrite(uint8_t pin, bool high)
+{
+  halHostSetPin(pin, high);
+}
+
+
+uint64_t halReadPins()
+{
+  return hostPins.load();
+}
+
+
+uint16_t halAdcMv(uint8_t pin)
+{
+  return (pin < HAL_HOST_PINS) ? hostAdcMv[pin].load() : 0;
+}
+
+
+void halDacWrite(uint8_t ch, uint16_t code)
+{
+  if (ch == HAL_INT_DAC)
+  {
+    hostDac[ch] = code;
+  }
+  else if (ch < NUM_DAC_CHANNELS)
+  {
+    hostDacStaged[ch] = code;
+  }
+}
+
+
+void halDacLatch()
+{
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    hostDac[ch] = hostDacStaged[ch];
+  }
+}
+
+
+void halShiftOut(uint8_t chain, uint16_t frame)
+{
+  chain %= HAL_NUM_SR;
+  hostShiftReg[chain] = frame;
+  ++hostShiftCount[chain];
+}
+
+
+void halPcntBegin(uint8_t unit, uint8_t pinA, uint8_t pinB, uint16_t filter)
+{
+  (void)pinA;
+  (void)pinB;
+  (void)filter;
+  hostPcnt[unit % HAL_HOST_PCNT_UNITS] = 0;
+}
+
+
+int16_t halPcntCount(uint8_t unit)
+{
+  return hostPcnt[unit % HAL_HOST_PCNT_UNITS].load();
+}
+
+
+bool halTaskStart(HalTaskFn fn,
+                  const char* name,
+                  uint32_t stackBytes,
+                  void* param,
+                  uint8_t priority,
+                  TaskHandle_t* handle)
+{
+  (void)name;
+  (void)stackBytes;
+  (void)priority;
+  std::thread(fn, param).detach();
+  if (handle)
+  {
+    *handle = nullptr;
+  }
+  return true;
+}
+
+
+// Follows simulated time: sleeps (for real) until somebody has advanced
+// the clock far enough
+void halDelayUntil(TickType_t& lastWake, TickType_t period)
+{
+  lastWake += period;
+  while ((int32_t)(halTicks() - lastWake) < 0)
+  {
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+
+void halHostSetPin(uint8_t pin, bool high)
+{
+  uint64_t mask(1ULL << pin);
+  if (high)
+  {
+    hostPins |= mask;
+  }
+  else
+  {
+    hostPins &= ~mask;
+  }
+}
+
+
+void halHostSetAdcMv(uint8_t pin, uint16_t mv)
+{
+  if (pin < HAL_HOST_PINS)
+  {
+    hostAdcMv[pin] = mv;
+  }
+}
+
+
+uint16_t halHostDac(uint8_t ch)
+{
+  return (ch <= NUM_DAC_CHANNELS) ? hostDac[ch].load() : 0;
+}
+
+
+uint16_t halHostShiftReg(uint8_t chain)
+{
+  return hostShiftReg[chain % HAL_NUM_SR].load();
+}
+
+
+uint32_t halHostShiftCount(uint8_t chain)
+{
+  return hostShiftCount[chain % HAL_NUM_SR].load();
+}
+
+
+void halHostTurnPcnt(uint8_t unit, int16_t counts)
+{
+  hostPcnt[unit % HAL_HOST_PCNT_UNITS] += counts;
+}
+
+
+void halHostAdvance(uint32_t micros)
+{
+  hostMicros += micros;
+}
+
+
+void halHostSetMicros(uint32_t micros)
+{
+  hostMicros = micros;
+}
+
+#endif
@@ -0,0 +1,103 @@
+#include "handlers.h"
+#include "setup.h"
+#include "seqIO.h"
+#include "modMatrix.h"
+
+
+void onReset()
+{
+  alan.reset();
+}
+
+
+void onClockRise(uint32_t atMicros)
+{
+  clockEdge(atMicros);
+  modMatrix.sampleEdge();
+  alan.iterate((modMatrix.stepMillivolts(mod_src::CV_B) > MOD_FULL_SCALE_MV / 2) ? -1 : 1);
+  modMatrix.endEdge();
+}
+
+
+void onClockFall()
+{
+  ioClockFell();
+}
+
+
+void onEncoder(encEvnts evt, uint8_t repeats)
+{
+  ModeCommand cmd(mode.handle(evt));
+  if (cmd.cmd == command_enum::STEP || cmd.cmd == command_enum::SCRUB)
+  {
+    cmd.val *= repeats;
+    onModeCommand(cmd);
+    return;
+  }
+
+  // Everything else (slot selection, length...) goes one detent at a time
+  onModeCommand(cmd);
+  for (uint8_t rep(1); rep < repeats; ++rep)
+  {
+    onModeCommand(mode.handle(evt));
+  }
+}
+
+
+void onModeCommand(const ModeCommand& cmd)
+{
+  if(cmd.cmd == command_enum::NO_CMD)
+  {
+    return;
+  }
+
+  switch(cmd.cmd)
+  {
+    case command_enum::CHANGEMODE:
+      break;
+
+    case command_enum::STEP:
+      alan.iterate(cmd.val, true);
+      break;
+
+    case command_enum::LOAD:
+      alan.setNextPattern(cmd.val);
+      break;
+
+    case command_enum::SAVE:
+      alan.savePattern(cmd.val);
+      break;
+
+    case command_enum::LENGTH:
+      alan.changeLen(cmd.val);
+      break;
+
+    case command_enum::LEDS:
+      break;
+
+    case command_enum::SCRUB:
+      alan.scrub(cmd.val);
+      break;
+
+    case command_enum::RETROGRADE:
+      alan.toggleRetrograde();
+      break;
+
+    // Calibration mode consumes these itself
+    case command_enum::CAL_TRIM:
+    case command_enum::CAL_COARSE:
+    case command_enum::CAL_CHANNEL:
+    case command_enum::CAL_DONE:
+      break;
+
+    case command_enum::NO_CMD:
+    default:
+      break;
+  }
+}
+
+
+void onLedFrame()
+{
+  ioLedFrame();
+}
@@ -0,0 +1,86 @@
+// ------------------------------------------------------------------------
+// hostMain.cpp
+//
+// main() for the native build (pio run -e native): the sequencer core,
+// headless, on the host HAL. Clocks it [steps] times, [period] us apart,
+// queueing up a different scene every 16 steps and resetting every 50,
+// and prints a CSV line per step:
+//
+//   us,reg,step,len,bank,faderBank,cvA,cvB,trig
+//
+//   tmoc_native [steps] [period us] [seed] [loop mV]
+//
+// Everything's deterministic for a given seed; diff two runs to see
+// whether a change did anything to the output.
+// ------------------------------------------------------------------------
+#if !defined(ARDUINO) && !defined(PIO_UNIT_TESTING)
+
+#include "TuringRegister.h"
+#include "seqIO.h"
+#include "hal.h"
+
+Stochasticizer stoch;
+TuringRegister alan(stoch);
+
+
+static unsigned long argOr(int argc, char** argv, int idx, unsigned long dflt)
+{
+  return (argc > idx) ? strtoul(argv[idx], nullptr, 0) : dflt;
+}
+
+
+int main(int argc, char** argv)
+{
+  uint32_t steps (argOr(argc, argv, 1, 256));
+  uint32_t period(argOr(argc, argv, 2, 125000));
+  uint32_t seed  (argOr(argc, argv, 3, 1));
+  uint16_t loopMv(argOr(argc, argv, 4, 1600));    // Halfway: a real coin toss
+
+  randomSeed(seed);
+  halHostSetAdcMv(LOOP_CTRL, loopMv);
+
+  // Every bank gets its own fader settings, so a bank switch shows up in
+  // the CVs
+  for (uint8_t bank(0); bank < NUM_SCENES; ++bank)
+  {
+    for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+    {
+      ioHostSetFader(bank, ch, 100 * (ch + 1) + 10 * bank);
+    }
+  }
+
+  // One reading, no sampling task: nothing changes on its own in here
+  modMatrix.sample();
+  alan.restoreBanks();
+
+  printf("us,reg,step,len,bank,faderBank,cvA,cvB,trig\n");
+  for (uint32_t idx(0); idx < steps; ++idx)
+  {
+    if (idx % 16 == 8)
+    {
+      alan.setNextPattern((idx / 16) % NUM_SCENES);
+    }
+    if (idx % 50 == 49)
+    {
+      alan.reset();
+    }
+
+    halHostAdvance(period);
+    alan.iterate(1);
+
+    SeqSnapshot snap(alan.snapshot());
+    printf("%lu,0x%04x,%d,%u,%u,%u,%u,%u,0x%02x\n",
+           (unsigned long)halMicros(),
+           snap.reg,
+           snap.step,
+           snap.length,
+           snap.bank,
+           snap.faderBank,
+           halHostDac(0),
+           halHostDac(1),
+           halHostShiftReg(HAL_SR_TRIGGERS));
+  }
+  return 0;
+}
+
+#endif
@@ -4,6 +4,13 @@
 #include "timers.h"
 #include <memory>
 #include "toggle.h"
+#include "calibration.h"
+#include "slew.h"
+#include "faderScan.h"
+#include "modMatrix.h"
+#include "cvMix.h"
+#include "events.h"
+#include "dacBatch.h"
 
 ////////////////////////////////////////////////////////////////
 //                      BUILT-IN IO
@@ -12,6 +19,7 @@
 ESP32AnalogRead cvA;    // "CV" input
 ESP32AnalogRead cvB;    // "NOISE" input
 ESP32AnalogRead cvLOOP; // "LOOP" variable resistor
+ESP32AnalogRead cvAUX;  // UNUSED_ANALOG
 
 // Here's the ESP32 DAC output
 DacESP32 voltsExp(static_cast<gpio_num_t>(DAC1_CV_OUT));
@@ -19,6 +27,7 @@ DacESP32 voltsExp(static_cast<gpio_num_t>(DAC1_CV_OUT));
 ////////////////////////////////////////////////////////////////
 //                      GATE INPUTS
 ////////////////////////////////////////////////////////////////
+#ifdef INPUTS_PER_PIN
 // Keep track of Clock and Reset digital inputs
 GateInArduino gates(NUM_GATES_IN, GATE_PIN, true);
 
@@ -39,6 +48,7 @@ bool clockDown()
 {
   return gates.readFallFlag(CLOCK_FLAG);
 }
+#endif
 
 #ifdef DEBUG_CLOCK
 toggle_cmd floating_debug_flag(toggle_cmd::NO);
@@ -55,15 +65,14 @@ void handleReset()
     return;
   }
 #else
-  if (!newReset())
+  if (newReset())
   {
-    return;
+    onReset();
   }
-
-  alan.reset();
 #endif
 }
 
+
 void handleClock()
 {
 #ifdef DEBUG_CLOCK
@@ -81,108 +90,127 @@ void handleClock()
 #else
   if (newClock())
   {
-    alan.iterate((cvB.readRaw() > 2047) ? -1 : 1);
+    onClockRise(micros());
+  }
+  else if (clockDown())
+  {
+    onClockFall();
   }
-  // else if (clockDown())
-  // {
-  //   triggers.allOff();
-  // }
 #endif
 }
 
+
+uint8_t currentRange(MIN_OCTAVES);
+
+uint8_t octaveRange()
+{
+  return currentRange;
+}
+
+
+void setOctaveRange(uint8_t octaves)
+{
+  octaves = constrain(octaves, MIN_OCTAVES, MAX_OCTAVES);
+  while (currentRange < octaves)
+  {
+    faders.moreRange();
+    ++currentRange;
+  }
+  while (currentRange > octaves)
+  {
+    faders.lessRange();
+    --currentRange;
+  }
+}
+
+
 // Handle commands from WRITE/CLEAR toggle
 void handleToggle()
 {
   #ifdef DEBUG_CLOCK
   return;
   #else
-  toggle_cmd cmd(updateToggle());
-  switch(cmd)
-  {
-    case toggle_cmd::LESS_OCTAVES:
-      faders.lessRange();
-      break;
-
-    case toggle_cmd::MORE_OCTAVES:
-      faders.moreRange();
-      break;
-
-    case toggle_cmd::CLEAR_BIT:
-      alan.clearBit();
-      break;
-
-    case toggle_cmd::SET_BIT:
-      alan.setBit();
-      break;
-
-    case toggle_cmd::EXIT:
-      mode.cancel();
-      break;
-
-    case toggle_cmd::NO:
-    default:
-      break;
-  }
+  onToggleCommand(updateToggle());
   #endif
 }
 
 
 void handleMode()
 {
-  ModeCommand cmd(mode.update());
-  if(cmd.cmd == command_enum::NO_CMD)
+  encEvnts evt(mode.pollEncoder());
+  uint8_t  repeats(1);
+  while (isTurn(evt) && repeats < MAX_ENC_BURST && mode.peekEncoder() == evt)
   {
-    return;
+    mode.pollEncoder();
+    ++repeats;
   }
+  onEncoder(evt, repeats);
+}
 
-  switch(cmd.cmd)
-  {
-    case command_enum::CHANGEMODE:
-      break;
 
-    case command_enum::STEP:
-      alan.iterate(cmd.val, true);
-      break;
+////////////////////////////////////////////////////////////////
+//               HARDWARE SHIFT REGISTER OUTPUTS
+////////////////////////////////////////////////////////////////
+Triggers triggers;
+
+void Triggers::reset()
+{
+  portENTER_CRITICAL(&mux_);
+  regVal = 0;
+  uint16_t frame(hw_reg.frame(0));
+  uint32_t seq(++frameSeq_);
+  portEXIT_CRITICAL(&mux_);
+
+  srBus.post(sr_device::TRIGGERS, frame, seq);
+}
 
-    case command_enum::LOAD:
-      alan.setNextPattern(cmd.val);
-      break;
+Triggers::Triggers() :
+  hw_reg(BusRegister<uint8_t>(sr_device::TRIGGERS, TRIG_PERM.data())),
+  triggerLength(DEFAULT_TRIGGER_MS),
+  numEvents_(0),
+  nextEvent_(0),
+  gen_(0),
+  frameSeq_(0),
+  stepMicros_(0),
+  mux_(portMUX_INITIALIZER_UNLOCKED)
+#ifdef RATDEBUG
+  , steps_(0)
+#endif
+{
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    config_[out] = DEFAULT_TRIG_CONFIG;
+  }
+#ifdef RATDEBUG
+  memset(maxLate_, 0, sizeof(maxLate_));
+#endif
+}
 
-    case command_enum::SAVE:
-      alan.savePattern(cmd.val);
-      break;
 
-    case command_enum::LENGTH:
-      alan.changeLen(cmd.val);
-      break;
+void Triggers::setLength(uint8_t ms)
+{
+  triggerLength = ms ? ms : DEFAULT_TRIGGER_MS;
+}
 
-    case command_enum::LEDS:
-      break;
 
-    case command_enum::NO_CMD:
-    default:
-      break;
-  }
+uint8_t Triggers::length() const
+{
+  return triggerLength;
 }
 
-////////////////////////////////////////////////////////////////
-//               HARDWARE SHIFT REGISTER OUTPUTS
-////////////////////////////////////////////////////////////////
-Triggers triggers;
 
-void Triggers::reset()
+void Triggers::configure(uint8_t out, const TrigConfig& cfg)
 {
-  hw_reg.reset();
+  if (out < NUM_TRIGGERS)
+  {
+    config_[out] = cfg;
+  }
 }
 
-Triggers::Triggers() :
-  hw_reg(OutputRegister<uint8_t>(SR_CLK,
-                                 SR_DATA,
-                                 TRIG_SR_CS,
-                                 trgMap)),
-  triggerLength(10)
+
+const TrigConfig& Triggers::config(uint8_t out) const
 {
-  ;
+  return config_[out % NUM_TRIGGERS];
 }
 
 // Note: you're still gonna need to clock this before it updates
@@ -192,17 +220,198 @@ void Triggers::setReg(uint8_t val)
   hw_reg.setReg(regVal);
 }
 
+
+// Slots an edge into [list], which stays sorted by time. Edges at the same
+// time share an entry.
+void Triggers::addEdge(TrigEvent* list, uint8_t& count, uint16_t atMs, uint8_t mask, bool on) const
+{
+  uint8_t idx(0);
+  while (idx < count && list[idx].atMs < atMs)
+  {
+    ++idx;
+  }
+
+  if (idx == count || list[idx].atMs != atMs)
+  {
+    if (count == MAX_TRIG_EVENTS)
+    {
+      return;
+    }
+    memmove(&list[idx + 1], &list[idx], (count - idx) * sizeof(TrigEvent));
+    list[idx] = {atMs, 0, 0};
+    ++count;
+  }
+
+  if (on)
+  {
+    list[idx].on  |= mask;
+  }
+  else
+  {
+    list[idx].off |= mask;
+  }
+}
+
+
 void Triggers::clock()
 {
-  setReg(alan.pulseIt());
-  hw_reg.clock();
-  // Turn the triggers off in {triggerLength} msec
-  auto trigOffLambda = [this]()
+  uint8_t  pulse(alan.pulseIt());
+  uint16_t periodMs(clockPeriodMicros() / 1000);
+  if (periodMs < 2)
   {
-    setReg(0);
-    hw_reg.clock();
-  };
-  one_shot(triggerLength, trigOffLambda);
+    periodMs = 2;
+  }
+
+  // Work out every edge this step will need
+  TrigEvent events[MAX_TRIG_EVENTS];
+  uint8_t   count(0);
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    if (!bitRead(pulse, out))
+    {
+      continue;
+    }
+
+    uint8_t          mask(0x01 << out);
+    const TrigConfig &cfg(config_[out]);
+    switch (cfg.mode)
+    {
+      case trig_mode::TRIGGER:
+        addEdge(events, count, cfg.param ? cfg.param : triggerLength, mask, false);
+        break;
+
+      case trig_mode::CLOCK_PCT:
+        addEdge(events, count,
+                constrain((uint32_t)periodMs * cfg.param / 100, 1U, periodMs - 1U),
+                mask, false);
+        break;
+
+      case trig_mode::RATCHET:
+      {
+        uint8_t  hits(constrain(cfg.param, 2, MAX_RATCHETS));
+        uint16_t spacing(periodMs / hits);
+        uint16_t hitLen(std::min<uint16_t>(triggerLength, spacing / 2));
+        if (hitLen == 0)
+        {
+          // Clock's too fast to fit them in; just do the one
+          addEdge(events, count, 1, mask, false);
+          break;
+        }
+        for (uint8_t hit(0); hit < hits; ++hit)
+        {
+          if (hit)
+          {
+            addEdge(events, count, hit * spacing, mask, true);
+          }
+          addEdge(events, count, hit * spacing + hitLen, mask, false);
+        }
+        break;
+      }
+
+      case trig_mode::GATE:   // clockFell() takes care of these
+      case trig_mode::TIE:    // ...and the next step takes care of these
+      default:
+        break;
+    }
+  }
+
+  portENTER_CRITICAL(&mux_);
+  memcpy(events_, events, count * sizeof(TrigEvent));
+  numEvents_  = count;
+  nextEvent_  = 0;
+  uint32_t gen(++gen_);
+  stepMicros_ = micros();
+  regVal      = pulse;
+  uint16_t frame(hw_reg.frame(pulse));
+  uint32_t seq(++frameSeq_);
+  portEXIT_CRITICAL(&mux_);
+
+  srBus.post(sr_device::TRIGGERS, frame, seq);
+
+  if (count)
+  {
+    one_shot(events[0].atMs, [this, gen](){ fire(gen); });
+  }
+
+#ifdef RATDEBUG
+  if (++steps_ % 256 == 0)
+  {
+    dbprintf("trig late (us): %lu %lu %lu %lu %lu %lu %lu %lu\n",
+             (unsigned long)maxLate_[0], (unsigned long)maxLate_[1],
+             (unsigned long)maxLate_[2], (unsigned long)maxLate_[3],
+             (unsigned long)maxLate_[4], (unsigned long)maxLate_[5],
+             (unsigned long)maxLate_[6], (unsigned long)maxLate_[7]);
+    memset(maxLate_, 0, sizeof(maxLate_));
+  }
+#endif
+}
+
+
+// Applies the next edge on the list and queues up the one after it
+void Triggers::fire(uint32_t gen)
+{
+  portENTER_CRITICAL(&mux_);
+  if (gen != gen_ || nextEvent_ >= numEvents_)
+  {
+    portEXIT_CRITICAL(&mux_);
+    return;
+  }
+
+  TrigEvent ev(events_[nextEvent_++]);
+  regVal = (regVal & ~ev.off) | ev.on;
+  uint16_t frame(hw_reg.frame(regVal));
+  uint32_t seq(++frameSeq_);
+  uint16_t wait((nextEvent_ < numEvents_) ? events_[nextEvent_].atMs - ev.atMs : 0);
+#ifdef RATDEBUG
+  uint32_t due(stepMicros_ + ev.atMs * 1000UL);
+#endif
+  portEXIT_CRITICAL(&mux_);
+
+  // The frame's numbered from inside the lock, so if the step or a clock
+  // fall gets in between here and the bus, theirs wins and this one's
+  // dropped rather than undoing it
+  srBus.post(sr_device::TRIGGERS, frame, seq);
+
+#ifdef RATDEBUG
+  uint32_t late(micros() - due);
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    if (bitRead(ev.on | ev.off, out) && late > maxLate_[out])
+    {
+      maxLate_[out] = late;
+    }
+  }
+#endif
+
+  if (wait)
+  {
+    one_shot(wait, [this, gen](){ fire(gen); });
+  }
+}
+
+
+void Triggers::clockFell()
+{
+  uint8_t gates(0);
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    if (config_[out].mode == trig_mode::GATE)
+    {
+      gates |= (0x01 << out);
+    }
+  }
+
+  portENTER_CRITICAL(&mux_);
+  bool     changed(regVal & gates);
+  regVal  &= ~gates;
+  uint16_t frame(hw_reg.frame(regVal));
+  uint32_t seq(changed ? ++frameSeq_ : 0);
+  portEXIT_CRITICAL(&mux_);
+
+  if (changed)
+  {
+    srBus.post(sr_device::TRIGGERS, frame, seq);
+  }
 }
 
 ////////////////////////////////////////////////////////////////
@@ -213,60 +422,61 @@ MultiChannelDac output(NUM_DAC_CHANNELS);
 void initOutputDac()
 {
   output.init();
+  dacBatch.begin();
 }
 
 // DAC 0: Faders & register
 // DAC 1: Faders & ~register
 // DAC 2: abs(DAC 1 - DAC 0)
 // DAC 3: DAC 0 if reg & BIT0 else no change from last value
-void expandVoltages(uint8_t shiftReg)
+void expandVoltages(uint8_t shiftReg, const uint16_t* freshVals)
 {
-  uint16_t faderVals[8];
-  uint16_t noteVals[4]{0, 0, 0, 0};
-
-  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  uint8_t  outFlags(alan.activeScene().outFlags);
+  uint16_t faderVals[NUM_FADERS];
+  uint16_t noteVals[NUM_DAC_CHANNELS];
+
+  // Same register, same scene settings, and nobody's touched a fader:
+  // the outputs already have what they need
+  static bool     primed(false);
+  static uint32_t lastVersion(0);
+  static uint8_t  lastReg(0);
+  static uint8_t  lastFlags(0);
+  uint32_t version(0);
+  if (freshVals)
   {
-    faderVals[ch] = faders.read(ch);
-
-    if (bitRead(shiftReg, ch))
-    {
-      // CV A: Faders & register
-      noteVals[0] += faderVals[ch];
-    }
-    else
-    {
-      // CV B: Faders & ~register
-      noteVals[1] += faderVals[ch];
-    }
-  }
-
-  // CV C: abs(CV A - CV B)
-  if (noteVals[0] > noteVals[1])
-  {
-    noteVals[2] = noteVals[0] - noteVals[1];
+    memcpy(faderVals, freshVals, sizeof(faderVals));
   }
   else
   {
-    noteVals[2] = noteVals[1] - noteVals[0];
+    version = faderScan.snapshot(faderVals);
   }
-
-  // CV D: same as CV A, but only changes when BIT 0 is high
-  static uint16_t lastCV_D(noteVals[0]);
-  if (bitRead(shiftReg, 0))
+  if (primed && version == lastVersion && shiftReg == lastReg && outFlags == lastFlags)
   {
-    lastCV_D = noteVals[0];
+    return;
   }
-  noteVals[3] = lastCV_D;
-
-  // Write the output values to the external DACs
-  for (uint8_t ch(0); ch < 4; ++ch)
+  primed      = !freshVals;     // Whatever the scan says next, use it
+  lastVersion = version;
+  lastReg     = shiftReg;
+  lastFlags   = outFlags;
+
+  static CvMixer mixer;
+  mixer.mix(shiftReg, faderVals, outFlags, noteVals);
+
+  // Internal (8 bit) DAC gets the inverse of the pattern register, unless
+  // the scene wants it the right way up
+  uint8_t writeVal_8((outFlags & OUT_INT_DAC_TRUE) ? shiftReg : ~shiftReg);
+
+  // External DACs get their codes via each channel's calibration table
+  // (the nominal scale on a channel that's never been calibrated)
+  uint16_t codes[NUM_DAC_CHANNELS];
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
   {
-    output.setChannelNote(ch, noteVals[ch]);
+    codes[ch] = dacCal.code(ch, noteVals[ch]);
   }
 
-  // Write the inverse of the pattern register to the internal (8 bit) DAC
-  uint8_t writeVal_8(~shiftReg);
-  voltsExp.outputVoltage(writeVal_8);
+  // Anything that isn't gliding goes out right here, all four channels in
+  // one latched batch; the slew task takes the rest from here
+  slew.setTargets(codes, writeVal_8, shiftReg);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -279,13 +489,48 @@ LedController panelLeds;
 //                   ALL THE THINGS
 ////////////////////////////////////////////////////////////////
 
+#ifdef RATDEBUG
+uint32_t inputCycles(0);
+uint32_t inputTicks(0);
+
+void logInputStats()
+{
+  if (!inputTicks)
+  {
+    return;
+  }
+  dbprintf("inputs: %lu cycles/tick\n", (unsigned long)(inputCycles / inputTicks));
+  inputCycles = 0;
+  inputTicks  = 0;
+}
+#endif
+
+
 void serviceIO()
 {
+#ifdef RATDEBUG
+  uint32_t start(ESP.getCycleCount());
+#endif
+
+#ifdef INPUTS_PER_PIN
   mode.service();
   gates.service();
-  faders.service();
+#else
+  // One read of the GPIO registers for everybody
+  inputs.sample();
+  mode.service();
+#endif
   writeLow.service();
   writeHigh.service();
+
+#ifdef RATDEBUG
+  inputCycles += ESP.getCycleCount() - start;
+  ++inputTicks;
+#endif
+
+#ifndef POLLED_INPUTS
+  inputEvents.pollSources();
+#endif
 }
 
 // // TODO: decide what controls I want to use to activate this alternate mode
@@ -349,6 +594,8 @@ void serviceIO()
   // etc.
   // . . . do this for all three LED registers
 
+  // DAC PITCH CALIBRATION: see calibration.h
+
   // SET DAC OUTPUT CHANNEL MAPPING:
   // for output in UserOutputs:
   //   outCh = 0;
@@ -368,51 +615,3 @@ void serviceIO()
   // move fader 0 to max until it lights up,
   // move fader 1 to max,
   // etc.
-
-// // Allows you to fine-tune the output of each individual DAC channel using all eight faders.
-// // Save the values you get and use them to populate the calibration data in TMOC_HW.h
-// void calibrate()
-// {
-//   uint8_t selch(0);
-//   uint8_t selreg(1);
-//   leds.tempWrite(1, 0);
-//   leds.tempWrite(1, 1);
-
-//   uint16_t outval(0);
-//   faderBank[selch]->selectActiveBank(0);
-//   dbprintf("ch: %u\n", selch);
-//   while (true)
-//   {
-//     if (writeHigh.readAndFree())
-//     {
-//       writeRawValToDac(selch, 0);
-//       ++selch;
-
-//       if (selch == 4)
-//       {
-//         selch = 0;
-//       }
-
-//       selreg = 0 | (1 << selch);
-//       faderBank[selch]->selectActiveBank(0);
-//       leds.tempWrite(selreg, 0);
-//       leds.tempWrite(selreg, 1);
-//       dbprintf("ch: %u\n", selch);
-//     }
-
-//     outval = 0;
-//     for (uint8_t bn(0); bn < 8; ++bn)
-//     {
-//       outval += faderBank[sliderMap[bn]]->read() >> (1 + bn);
-//     }
-//     if (outval > 4095)
-//     {
-//       outval = 4095;
-//     }
-//     output.setChannelVal(selch, outval);
-//     if (writeLow.readAndFree())
-//     {
-//       dbprintf("%u\n", outval);
-//     }
-//   }
-// }
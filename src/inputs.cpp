@@ -0,0 +1,207 @@
+#include "inputs.h"
+#include "hal.h"
+
+InputSampler inputs;
+
+// The switches get read from the timer ISR and from tasks
+portMUX_TYPE switchMux(portMUX_INITIALIZER_UNLOCKED);
+
+
+InputSampler::InputSampler():
+  state_(0),
+  cnt0_ (0),
+  cnt1_ (0),
+  rose_ (0),
+  fell_ (0),
+  mux_  (portMUX_INITIALIZER_UNLOCKED)
+{ ; }
+
+
+void InputSampler::begin()
+{
+#ifdef ARDUINO
+  pinMode(CLOCK_IN,    INPUT);
+  pinMode(RESET_IN,    INPUT);
+  pinMode(TOGGLE_UP,   INPUT_PULLUP);
+  pinMode(TOGGLE_DOWN, INPUT_PULLUP);
+  pinMode(ENC_SW,      INPUT);    // No pullup on 34; there's one on the board
+#endif
+
+  state_ = read();
+}
+
+
+// Both input registers, then just the bits we want, active = 1
+uint8_t IRAM_ATTR InputSampler::read() const
+{
+  uint64_t pins(halReadPins());
+
+  uint8_t raw(0);
+  for (uint8_t idx(0); idx < NUM_INPUTS; ++idx)
+  {
+    raw |= ((pins >> INPUT_PIN[idx]) & 0x01) << idx;
+  }
+  return raw ^ INPUTS_ACTIVE_LOW;
+}
+
+
+void IRAM_ATTR InputSampler::sample()
+{
+  uint8_t raw(read());
+
+  // Vertical counter: every bit that disagrees with the debounced state
+  // counts up; anything that agrees starts over. Roll over and it flips.
+  uint8_t delta(raw ^ state_);
+  cnt1_ = (cnt1_ ^ cnt0_) & delta;
+  cnt0_ = ~cnt0_ & delta;
+  uint8_t flips(delta & ~(cnt0_ | cnt1_));
+
+  uint8_t next(((state_ ^ flips) & INPUTS_DEBOUNCED) | (raw & ~INPUTS_DEBOUNCED));
+  uint8_t changed(next ^ state_);
+  state_ = next;
+
+  portENTER_CRITICAL_ISR(&mux_);
+  rose_ |= changed & next;
+  fell_ |= changed & ~next;
+  portEXIT_CRITICAL_ISR(&mux_);
+}
+
+
+uint8_t InputSampler::state() const
+{
+  return state_;
+}
+
+
+bool InputSampler::active(input_bit bit) const
+{
+  return state_ & inputMask(bit);
+}
+
+
+bool InputSampler::takeRise(input_bit bit)
+{
+  uint8_t mask(inputMask(bit));
+  portENTER_CRITICAL_SAFE(&mux_);
+  bool ret(rose_ & mask);
+  rose_ &= ~mask;
+  portEXIT_CRITICAL_SAFE(&mux_);
+  return ret;
+}
+
+
+bool InputSampler::takeFall(input_bit bit)
+{
+  uint8_t mask(inputMask(bit));
+  portENTER_CRITICAL_SAFE(&mux_);
+  bool ret(fell_ & mask);
+  fell_ &= ~mask;
+  portEXIT_CRITICAL_SAFE(&mux_);
+  return ret;
+}
+
+
+SwitchButton::SwitchButton(input_bit bit):
+  bit_         (bit),
+  down_        (false),
+  holdSent_    (false),
+  clickPending_(false),
+  downMs_      (0),
+  upMs_        (0),
+  pending_     (ButtonState::Open)
+{ ; }
+
+
+void SwitchButton::service()
+{
+  bool down(inputs.active(bit_));
+
+  if (down && !down_)
+  {
+    down_     = true;
+    holdSent_ = false;
+    downMs_   = 0;
+    return;
+  }
+
+  if (down)
+  {
+    if (downMs_ < SWITCH_HOLD_MS)
+    {
+      ++downMs_;
+    }
+    if (!holdSent_ && downMs_ >= SWITCH_HOLD_MS)
+    {
+      holdSent_     = true;
+      clickPending_ = false;
+      post(ButtonState::Held);
+    }
+    return;
+  }
+
+  if (down_)
+  {
+    // Just let go
+    down_ = false;
+    upMs_ = 0;
+    if (holdSent_)
+    {
+      return;
+    }
+
+    if (clickPending_)
+    {
+      clickPending_ = false;
+      post(ButtonState::DoubleClicked);
+    }
+    else
+    {
+      clickPending_ = true;
+    }
+    return;
+  }
+
+  if (clickPending_ && ++upMs_ >= SWITCH_DOUBLECLICK_MS)
+  {
+    clickPending_ = false;
+    post(ButtonState::Clicked);
+  }
+}
+
+
+void SwitchButton::post(ButtonState state)
+{
+  portENTER_CRITICAL_SAFE(&switchMux);
+  pending_ = state;
+  portEXIT_CRITICAL_SAFE(&switchMux);
+}
+
+
+ButtonState SwitchButton::readAndFree()
+{
+  portENTER_CRITICAL_SAFE(&switchMux);
+  ButtonState ret(pending_);
+  pending_ = ButtonState::Open;
+  portEXIT_CRITICAL_SAFE(&switchMux);
+  return ret;
+}
+
+
+#ifndef INPUTS_PER_PIN
+bool newReset()
+{
+  return inputs.takeRise(input_bit::RESET);
+}
+
+
+bool newClock()
+{
+  return inputs.takeRise(input_bit::CLOCK);
+}
+
+
+bool clockDown()
+{
+  return inputs.takeFall(input_bit::CLOCK);
+}
+#endif
@@ -0,0 +1,619 @@
+#include "journal.h"
+#include <cstddef>
+#include <cstring>
+
+const uint16_t JOURNAL_MAGIC(0x7A3C);
+const uint16_t JOURNAL_TOTAL_SLOTS(JOURNAL_NUM_SECTORS * JOURNAL_SLOTS_PER_SECTOR);
+
+static_assert(JOURNAL_SLOTS_PER_SECTOR > JOURNAL_MAX_KEYS,
+              "A sector has to be able to take every live record plus one");
+
+
+////////////////////////////////////////////////////////////////
+//                      STORAGE MEDIUM
+////////////////////////////////////////////////////////////////
+#ifdef ARDUINO
+
+#include <Arduino.h>
+#include <esp_partition.h>
+
+// The journal borrows the first few sectors of the (otherwise unused) SPIFFS
+// data partition from the default partition table.
+//
+// NB: flash writes and erases suspend the flash cache on both cores, so
+// anything not in IRAM stalls until they finish. Writing single small slots
+// keeps that to a few tens of microseconds; the occasional sector erase is
+// the expensive bit (see prepareSpare()).
+static const esp_partition_t* journalPartition()
+{
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                  ESP_PARTITION_SUBTYPE_DATA_SPIFFS,
+                                  NULL);
+}
+
+static uint32_t nowMicros()
+{
+  return micros();
+}
+
+
+bool FlashJournal::readSlot(uint16_t slot, uint8_t* buf) const
+{
+  auto part(static_cast<const esp_partition_t*>(partition_));
+  return esp_partition_read(part, slot * JOURNAL_SLOT_SIZE,
+                            buf, JOURNAL_SLOT_SIZE) == ESP_OK;
+}
+
+
+bool FlashJournal::writeSlot(uint16_t slot, const uint8_t* buf)
+{
+  auto part(static_cast<const esp_partition_t*>(partition_));
+  return esp_partition_write(part, slot * JOURNAL_SLOT_SIZE,
+                             buf, JOURNAL_SLOT_SIZE) == ESP_OK;
+}
+
+
+bool FlashJournal::eraseSector(uint8_t sector)
+{
+  auto part(static_cast<const esp_partition_t*>(partition_));
+  return esp_partition_erase_range(part, sector * JOURNAL_SECTOR_SIZE,
+                                   JOURNAL_SECTOR_SIZE) == ESP_OK;
+}
+
+#else // Host build: a file that behaves like NOR flash
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static FILE*    hostFile(nullptr);
+static uint32_t hostCutIn(0);         // Flash operations until the power goes; 0 never
+static uint32_t hostCutSeed(1);
+static bool     hostPowerOff(false);
+static uint32_t hostFailWrites(0);    // Slot writes left to turn down
+
+
+void journalHostCutPower(uint32_t ops, uint32_t seed)
+{
+  hostCutIn   = ops;
+  hostCutSeed = seed;
+}
+
+
+void journalHostFailWrites(uint32_t writes)
+{
+  hostFailWrites = writes;
+}
+
+
+// How much of a [len]-byte flash operation gets done: all of it, none if
+// the power's already gone, or some of it if this is the one it goes in
+// the middle of
+static size_t hostPowerBudget(size_t len)
+{
+  if (hostPowerOff)
+  {
+    return 0;
+  }
+  if (!hostCutIn || --hostCutIn)
+  {
+    return len;
+  }
+
+  hostPowerOff = true;
+  hostCutSeed  = hostCutSeed * 1103515245UL + 12345;
+  return (hostCutSeed >> 8) % len;
+}
+
+
+// Mounting is the power coming (back) on
+static FILE* journalPartition()
+{
+  if (hostFile)
+  {
+    std::fclose(hostFile);
+    hostFile = nullptr;
+  }
+  hostPowerOff = false;
+
+  const char* dir(std::getenv("TMOC_NVS_DIR"));
+  std::string path(dir ? dir : "nvs");
+  path += "/journal.bin";
+
+  FILE* fp(std::fopen(path.c_str(), "r+b"));
+  if (!fp)
+  {
+    // Fresh "chip": everything starts out erased
+    fp = std::fopen(path.c_str(), "w+b");
+    if (!fp)
+    {
+      return nullptr;
+    }
+    uint8_t blank[JOURNAL_SECTOR_SIZE];
+    memset(blank, 0xFF, sizeof(blank));
+    for (uint8_t sec(0); sec < JOURNAL_NUM_SECTORS; ++sec)
+    {
+      std::fwrite(blank, 1, sizeof(blank), fp);
+    }
+    std::fflush(fp);
+  }
+  hostFile = fp;
+  return fp;
+}
+
+static uint32_t nowMicros()
+{
+  using namespace std::chrono;
+  return duration_cast<microseconds>(
+    steady_clock::now().time_since_epoch()).count();
+}
+
+
+bool FlashJournal::readSlot(uint16_t slot, uint8_t* buf) const
+{
+  FILE* fp((FILE*)partition_);
+  return std::fseek(fp, slot * JOURNAL_SLOT_SIZE, SEEK_SET) == 0
+      && std::fread(buf, 1, JOURNAL_SLOT_SIZE, fp) == JOURNAL_SLOT_SIZE;
+}
+
+
+// Like real flash, writing can only clear bits
+bool FlashJournal::writeSlot(uint16_t slot, const uint8_t* buf)
+{
+  uint8_t current[JOURNAL_SLOT_SIZE];
+  if (!readSlot(slot, current))
+  {
+    return false;
+  }
+  if (hostFailWrites)
+  {
+    --hostFailWrites;
+    return false;
+  }
+
+  size_t done(hostPowerBudget(JOURNAL_SLOT_SIZE));
+  for (uint8_t idx(0); idx < done; ++idx)
+  {
+    current[idx] &= buf[idx];
+  }
+
+  FILE* fp((FILE*)partition_);
+  bool ok(std::fseek(fp, slot * JOURNAL_SLOT_SIZE, SEEK_SET) == 0
+       && std::fwrite(current, 1, JOURNAL_SLOT_SIZE, fp) == JOURNAL_SLOT_SIZE);
+  return (std::fflush(fp) == 0) && ok && done == JOURNAL_SLOT_SIZE;
+}
+
+
+bool FlashJournal::eraseSector(uint8_t sector)
+{
+  size_t done(hostPowerBudget(JOURNAL_SECTOR_SIZE));
+  if (!done)
+  {
+    return false;
+  }
+
+  uint8_t blank[JOURNAL_SECTOR_SIZE];
+  memset(blank, 0xFF, sizeof(blank));
+
+  FILE* fp((FILE*)partition_);
+  bool ok(std::fseek(fp, sector * JOURNAL_SECTOR_SIZE, SEEK_SET) == 0
+       && std::fwrite(blank, 1, done, fp) == done);
+  return (std::fflush(fp) == 0) && ok && done == JOURNAL_SECTOR_SIZE;
+}
+
+#endif
+
+
+////////////////////////////////////////////////////////////////
+//                         JOURNAL
+////////////////////////////////////////////////////////////////
+// Plain bitwise CRC-32; we only run it a handful of times per save
+static uint32_t crc32(uint32_t crc, const uint8_t* buf, size_t len)
+{
+  crc = ~crc;
+  while (len--)
+  {
+    crc ^= *buf++;
+    for (uint8_t bit(0); bit < 8; ++bit)
+    {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+
+static uint32_t recordCrc(const uint8_t* slotBuf)
+{
+  const JournalHeader* hdr((const JournalHeader*)slotBuf);
+  uint32_t crc(crc32(0, slotBuf, offsetof(JournalHeader, crc)));
+  return crc32(crc, slotBuf + sizeof(JournalHeader), hdr->len);
+}
+
+
+static bool slotIsErased(const uint8_t* buf)
+{
+  for (uint8_t idx(0); idx < JOURNAL_SLOT_SIZE; ++idx)
+  {
+    if (buf[idx] != 0xFF)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+FlashJournal::FlashJournal():
+  partition_        (nullptr),
+  mounted_          (false),
+  headSector_       (0),
+  headSlot_         (0),
+  nextSeq_          (1),
+  spareReady_       (false),
+  lastCommitMicros_ (0),
+  maxCommitMicros_  (0),
+  lastEraseMicros_  (0)
+{
+  for (auto &entry: index_)
+  {
+    entry.valid = false;
+  }
+}
+
+
+bool FlashJournal::slotIsValid(const uint8_t* buf) const
+{
+  const JournalHeader* hdr((const JournalHeader*)buf);
+  return hdr->magic == JOURNAL_MAGIC
+      && hdr->key   <  JOURNAL_MAX_KEYS
+      && hdr->len   <= JOURNAL_MAX_PAYLOAD
+      && hdr->crc   == recordCrc(buf);
+}
+
+
+bool FlashJournal::sectorIsErased(uint8_t sector) const
+{
+  uint8_t buf[JOURNAL_SLOT_SIZE];
+  for (uint16_t n(0); n < JOURNAL_SLOTS_PER_SECTOR; ++n)
+  {
+    if (!readSlot(sector * JOURNAL_SLOTS_PER_SECTOR + n, buf) || !slotIsErased(buf))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool FlashJournal::mount()
+{
+  partition_ = journalPartition();
+  if (!partition_)
+  {
+    return false;
+  }
+
+  uint8_t  buf[JOURNAL_SLOT_SIZE];
+  bool     anyValid(false);
+  bool     anyDirty(false);
+  uint32_t newest(0);
+
+  for (uint16_t slot(0); slot < JOURNAL_TOTAL_SLOTS; ++slot)
+  {
+    if (!readSlot(slot, buf))
+    {
+      return false;
+    }
+
+    if (slotIsErased(buf))
+    {
+      continue;
+    }
+    anyDirty = true;
+
+    // Torn writes and other garbage just get skipped
+    if (!slotIsValid(buf))
+    {
+      continue;
+    }
+
+    const JournalHeader* hdr((const JournalHeader*)buf);
+    IndexEntry &entry(index_[hdr->key]);
+    if (!entry.valid || hdr->seq > entry.seq)
+    {
+      entry.valid = true;
+      entry.slot  = slot;
+      entry.seq   = hdr->seq;
+    }
+
+    if (!anyValid || hdr->seq > newest)
+    {
+      newest      = hdr->seq;
+      headSector_ = slot / JOURNAL_SLOTS_PER_SECTOR;
+    }
+    anyValid = true;
+  }
+
+  if (!anyValid)
+  {
+    // Blank or foreign data: start over with a clean slate
+    if (anyDirty)
+    {
+      for (uint8_t sec(0); sec < JOURNAL_NUM_SECTORS; ++sec)
+      {
+        eraseSector(sec);
+      }
+    }
+    headSector_ = 0;
+    headSlot_   = 0;
+    nextSeq_    = 1;
+    spareReady_ = sectorIsErased(1 % JOURNAL_NUM_SECTORS);
+    mounted_    = true;
+    return true;
+  }
+
+  // Resume after the last slot anybody touched in the newest sector
+  headSlot_ = 0;
+  uint16_t first(headSector_ * JOURNAL_SLOTS_PER_SECTOR);
+  for (uint16_t n(JOURNAL_SLOTS_PER_SECTOR); n > 0; --n)
+  {
+    readSlot(first + n - 1, buf);
+    if (!slotIsErased(buf))
+    {
+      headSlot_ = n;
+      break;
+    }
+  }
+
+  nextSeq_    = newest + 1;
+  spareReady_ = sectorIsErased((headSector_ + 1) % JOURNAL_NUM_SECTORS);
+  mounted_    = true;
+  return true;
+}
+
+
+bool FlashJournal::read(uint8_t key, void* buf, uint8_t len) const
+{
+  if (!mounted_ || key >= JOURNAL_MAX_KEYS || !index_[key].valid)
+  {
+    return false;
+  }
+
+  uint8_t slotBuf[JOURNAL_SLOT_SIZE];
+  if (!readSlot(index_[key].slot, slotBuf) || !slotIsValid(slotBuf))
+  {
+    return false;
+  }
+
+  const JournalHeader* hdr((const JournalHeader*)slotBuf);
+  if (hdr->len != len)
+  {
+    return false;
+  }
+
+  memcpy(buf, slotBuf + sizeof(JournalHeader), len);
+  return true;
+}
+
+
+// How many keys have their newest record in [sector]
+uint8_t FlashJournal::liveIn(uint8_t sector) const
+{
+  uint8_t count(0);
+  for (auto &entry: index_)
+  {
+    if (entry.valid && entry.slot / JOURNAL_SLOTS_PER_SECTOR == sector)
+    {
+      ++count;
+    }
+  }
+  return count;
+}
+
+
+// Writes a record into the head slot
+bool FlashJournal::writeRecord(uint8_t key, const void* buf, uint8_t len)
+{
+  if (headSlot_ >= JOURNAL_SLOTS_PER_SECTOR)
+  {
+    return false;
+  }
+
+  uint8_t slotBuf[JOURNAL_SLOT_SIZE];
+  memset(slotBuf, 0xFF, sizeof(slotBuf));
+
+  JournalHeader* hdr((JournalHeader*)slotBuf);
+  hdr->seq   = nextSeq_;
+  hdr->magic = JOURNAL_MAGIC;
+  hdr->key   = key;
+  hdr->len   = len;
+  memcpy(slotBuf + sizeof(JournalHeader), buf, len);
+  hdr->crc   = recordCrc(slotBuf);
+
+  uint16_t slot(headSector_ * JOURNAL_SLOTS_PER_SECTOR + headSlot_);
+
+  // Whatever happens, this slot is used up now
+  ++headSlot_;
+  ++nextSeq_;
+
+  if (!writeSlot(slot, slotBuf))
+  {
+    return false;
+  }
+
+  index_[key].valid = true;
+  index_[key].slot  = slot;
+  index_[key].seq   = hdr->seq;
+  return true;
+}
+
+
+// Copies the live records out of [sector] into the head sector so it can
+// be erased later
+void FlashJournal::relocate(uint8_t sector)
+{
+  uint8_t slotBuf[JOURNAL_SLOT_SIZE];
+  for (uint8_t key(0); key < JOURNAL_MAX_KEYS; ++key)
+  {
+    IndexEntry &entry(index_[key]);
+    if (!entry.valid || entry.slot / JOURNAL_SLOTS_PER_SECTOR != sector)
+    {
+      continue;
+    }
+
+    if (readSlot(entry.slot, slotBuf) && slotIsValid(slotBuf))
+    {
+      const JournalHeader* hdr((const JournalHeader*)slotBuf);
+      writeRecord(key, slotBuf + sizeof(JournalHeader), hdr->len);
+    }
+  }
+}
+
+
+// Moves the head to the start of the next sector that holds nothing live,
+// erasing it first unless prepareSpare() already has
+void FlashJournal::advance()
+{
+  uint8_t sector((headSector_ + 1) % JOURNAL_NUM_SECTORS);
+  if (spareReady_)
+  {
+    spareReady_ = false;
+    headSector_ = sector;
+    headSlot_   = 0;
+    return;
+  }
+
+  for (uint8_t tries(1); tries < JOURNAL_NUM_SECTORS; ++tries)
+  {
+    if (liveIn(sector) == 0)
+    {
+      break;
+    }
+    // Shouldn't happen unless a few power cuts ate our safety margin
+    sector = (sector + 1) % JOURNAL_NUM_SECTORS;
+  }
+
+  uint32_t start(nowMicros());
+  eraseSector(sector);
+  lastEraseMicros_ = nowMicros() - start;
+  for (auto &entry: index_)
+  {
+    if (entry.valid && entry.slot / JOURNAL_SLOTS_PER_SECTOR == sector)
+    {
+      entry.valid = false;
+    }
+  }
+
+  headSector_ = sector;
+  headSlot_   = 0;
+}
+
+
+bool FlashJournal::append(uint8_t key, const void* buf, uint8_t len)
+{
+  if (!mounted_ || key >= JOURNAL_MAX_KEYS || len > JOURNAL_MAX_PAYLOAD)
+  {
+    return false;
+  }
+
+  uint32_t start(nowMicros());
+
+  if (headSlot_ >= JOURNAL_SLOTS_PER_SECTOR)
+  {
+    advance();
+  }
+
+  // Make sure the sector we'll erase next is empty of live records by the
+  // time this one fills up
+  uint8_t  next((headSector_ + 1) % JOURNAL_NUM_SECTORS);
+  uint8_t  live(liveIn(next));
+  uint16_t free(JOURNAL_SLOTS_PER_SECTOR - headSlot_);
+  if (live > 0 && free <= live + 1)
+  {
+    relocate(next);
+  }
+
+  if (headSlot_ >= JOURNAL_SLOTS_PER_SECTOR)
+  {
+    advance();
+  }
+
+  bool ok(writeRecord(key, buf, len));
+
+  lastCommitMicros_ = nowMicros() - start;
+  if (lastCommitMicros_ > maxCommitMicros_)
+  {
+    maxCommitMicros_ = lastCommitMicros_;
+  }
+  return ok;
+}
+
+
+bool FlashJournal::prepareSpare()
+{
+  if (!mounted_ || spareReady_)
+  {
+    return spareReady_;
+  }
+
+  // Anything still live in there has to fit in what's left of the head
+  // sector; if not, append() will deal with it as the head fills
+  uint8_t sector((headSector_ + 1) % JOURNAL_NUM_SECTORS);
+  uint8_t live(liveIn(sector));
+  if (live > 0)
+  {
+    if (headSlot_ + live > JOURNAL_SLOTS_PER_SECTOR)
+    {
+      return false;
+    }
+    relocate(sector);
+    if (liveIn(sector) > 0)
+    {
+      return false;
+    }
+  }
+
+  uint32_t start(nowMicros());
+  bool ok(eraseSector(sector));
+  lastEraseMicros_ = nowMicros() - start;
+  if (!ok)
+  {
+    return false;
+  }
+
+  for (auto &entry: index_)
+  {
+    if (entry.valid && entry.slot / JOURNAL_SLOTS_PER_SECTOR == sector)
+    {
+      entry.valid = false;
+    }
+  }
+  spareReady_ = true;
+  return true;
+}
+
+
+bool FlashJournal::spareReady() const
+{
+  return spareReady_;
+}
+
+
+uint32_t FlashJournal::lastCommitMicros() const
+{
+  return lastCommitMicros_;
+}
+
+
+uint32_t FlashJournal::maxCommitMicros() const
+{
+  return maxCommitMicros_;
+}
+
+
+uint32_t FlashJournal::lastEraseMicros() const
+{
+  return lastEraseMicros_;
+}
@@ -5,13 +5,18 @@
 
 
 LedController::LedController():
-  hw_reg(OutputRegister<uint16_t> (SR_CLK,
-                                   SR_DATA,
-                                   LED_SR_CS,
-                                   regMap)),
   resetBlankTime(100),
-  enabled(true)
-{;}
+  enabled(true),
+  dirty_(true),
+  lastFrameMicros_(0)
+#ifdef RATDEBUG
+  , renders_(0)
+  , busyMicros_(0)
+#endif
+{
+  memset(&last_,   0, sizeof(last_));
+  memset(levels_,  0, sizeof(levels_));
+}
 
 
 void LedController::blinkOut()
@@ -22,26 +27,95 @@ void LedController::blinkOut()
 }
 
 
-void LedController::setFaderReg()
+void LedController::setByte(uint8_t idx, uint8_t bits, uint8_t on, uint8_t off)
+{
+  for (uint8_t bit(0); bit < 8; ++bit)
+  {
+    levels_[idx * 8 + bit] = bitRead(bits, bit) ? on : off;
+  }
+}
+
+
+// Only asks for what the current mode actually shows
+void LedController::gather(LedInputs& in) const
+{
+  memset(&in, 0, sizeof(in));
+  in.enabled = enabled;
+  in.mode    = mode.currentMode();
+  if (!in.enabled)
+  {
+    return;
+  }
+
+  // One consistent look at the sequencer, even if it's mid-step somewhere
+  // else
+  SeqSnapshot seq(alan.snapshot());
+  switch(in.mode)
+  {
+    case mode_type::PERFORMANCE_MODE:
+      in.output   = (uint8_t)(seq.reg & 0xFF);
+      in.lockByte = faders.getLockByte();
+      break;
+
+    case mode_type::CHANGE_LENGTH_MODE:
+      in.output   = (uint8_t)(seq.reg & 0xFF);
+      in.lockByte = faders.getLockByte();
+      in.len      = seq.length;
+      break;
+
+    case mode_type::PATTERN_LOAD_MODE:
+    case mode_type::PATTERN_SAVE_MODE:
+      in.slot     = mode.activeSlot();
+      in.scene    = seq.bank;
+      break;
+
+    // Anything else (i.e. on the way back out of a mode) still shows the
+    // register and locks on the fader LEDs
+    default:
+      in.output   = (uint8_t)(seq.reg & 0xFF);
+      in.lockByte = faders.getLockByte();
+      break;
+  }
+}
+
+
+void LedController::setFaderReg(const LedInputs& in)
 {
-  hw_reg.setReg(alan.getOutput() & faders.getLockByte(), 0);
+  // Picking a scene: show which page we're on instead
+  if (in.mode == mode_type::PATTERN_LOAD_MODE
+   || in.mode == mode_type::PATTERN_SAVE_MODE)
+  {
+    setByte(0, 0x01 << (uint8_t)(in.slot / NUM_BANKS));
+    return;
+  }
+
+  // Faders that haven't caught up with their saved value yet are dimmed
+  for (uint8_t bit(0); bit < 8; ++bit)
+  {
+    if (!bitRead(in.output, bit))
+    {
+      levels_[bit] = LED_OFF;
+    }
+    else
+    {
+      levels_[bit] = bitRead(in.lockByte, bit) ? LED_FULL : LED_DIM;
+    }
+  }
 }
 
 
 // Updates main horizontal LED array to display current pattern (in
 // performance mode) or status (in one of the editing modes)
-void LedController::setMainReg()
+void LedController::setMainReg(const LedInputs& in)
 {
-  // Fast blink = LOAD, slower blink = SAVE
-  int8_t  slot       = mode.activeSlot();
-  uint8_t len        = alan.getLength();
-  uint8_t flashTimer = getFlashTimer();
+  uint8_t slot(in.slot % NUM_BANKS);
+  uint8_t len (in.len);
 
-  switch(mode.currentMode())
+  switch(in.mode)
   {
     case mode_type::PERFORMANCE_MODE:
       // Display the current register/pattern value
-      hw_reg.setReg(alan.getOutput(), 1);
+      setByte(1, in.output);
       break;
 
     case mode_type::CHANGE_LENGTH_MODE:
@@ -49,36 +123,29 @@ void LedController::setMainReg()
       // light up all LEDs and dim the active one
       if (len <= 8)
       {
-        hw_reg.setReg(0x01 << (len - 1), 1);
+        setByte(1, 0x01 << (len - 1));
       }
       else
       {
-        hw_reg.setReg(~(0x01 << (len - 9)), 1);
+        setByte(1, ~(0x01 << (len - 9)), LED_FULL, LED_DIM);
       }
       break;
 
     case mode_type::PATTERN_LOAD_MODE:
-      // Flash LED corresponding to selected bank
-      if (flashTimer & BIT0)
-      {
-        hw_reg.setReg(0x01 << (uint8_t)slot, 1);
-      }
-      else
+      // Selected scene bright, the one that's playing dim (if it's on
+      // this page)
+      setByte(1, 0);
+      if (in.scene / NUM_BANKS == in.slot / NUM_BANKS)
       {
-        hw_reg.setReg(0, 1);
+        levels_[8 + in.scene % NUM_BANKS] = LED_DIM;
       }
+      levels_[8 + slot] = LED_FULL;
       break;
 
     case mode_type::PATTERN_SAVE_MODE:
-      // Flash LED corresponding to selected slot
-      if (flashTimer & BIT1)
-      {
-        hw_reg.setReg(0x01 << (uint8_t)slot, 1);
-      }
-      else
-      {
-        hw_reg.setReg(0, 1);
-      }
+      // Selected slot bright against a dim row, so it doesn't look like
+      // load mode
+      setByte(1, 0x01 << slot, LED_FULL, LED_DIM);
       break;
 
     default:
@@ -94,25 +161,94 @@ void LedController::clock(bool reset)
     // Only do this when you get a clock after a reset
     panelLeds.blinkOut();
   }
-  panelLeds.updateAll();
+  panelLeds.render();
 }
 
 
 void LedController::updateAll()
 {
-  if (!enabled)
+#ifndef LED_RENDER_EVERY_LOOP
+  if (micros() - lastFrameMicros_ < 1000000UL / LED_MAX_FPS)
   {
-    hw_reg.setReg(0, 0);
-    hw_reg.setReg(0, 1);
-    hw_reg.clock();
     return;
   }
+#endif
+  render();
+}
+
+
+static bool sameInputs(const LedInputs& a, const LedInputs& b)
+{
+  return a.output   == b.output
+      && a.lockByte == b.lockByte
+      && a.len      == b.len
+      && a.scene    == b.scene
+      && a.slot     == b.slot
+      && a.mode     == b.mode
+      && a.enabled  == b.enabled;
+}
+
+
+void LedController::render()
+{
+  uint32_t start(micros());
+  lastFrameMicros_ = start;
+
+  LedInputs in;
+  gather(in);
+
+  bool changed(dirty_ || !sameInputs(in, last_));
+#ifdef LED_RENDER_EVERY_LOOP
+  changed = true;
+#endif
 
-  setFaderReg();
-  setMainReg();
-  if (!hw_reg.pending())
+  if (changed)
   {
-    return;
+    last_  = in;
+    dirty_ = false;
+
+    if (!in.enabled)
+    {
+      memset(levels_, LED_OFF, sizeof(levels_));
+    }
+    else
+    {
+      setFaderReg(in);
+      setMainReg(in);
+    }
+    bcmLeds.show(levels_);
   }
-  hw_reg.clock();
-}
\ No newline at end of file
+
+#ifdef RATDEBUG
+  renders_    += changed ? 1 : 0;
+  busyMicros_ += micros() - start;
+#endif
+}
+
+
+#ifdef RATDEBUG
+void LedController::takeStats(uint32_t& renders, uint32_t& busyMicros)
+{
+  renders     = renders_;
+  busyMicros  = busyMicros_;
+  renders_    = 0;
+  busyMicros_ = 0;
+}
+#endif
+
+// Writes straight to the hardware; anything that calls updateAll() will
+// stomp on these, so they're only useful when the sequencer isn't running
+void LedController::setMain_all(uint8_t reg)
+{
+  setByte(1, reg);
+  bcmLeds.show(levels_);
+  dirty_ = true;
+}
+
+
+void LedController::setFader_all(uint8_t reg)
+{
+  setByte(0, reg);
+  bcmLeds.show(levels_);
+  dirty_ = true;
+}
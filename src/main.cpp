@@ -16,19 +16,71 @@
 #include <Arduino.h>
 #include "setup.h"
 #include "hwio.h"
+#include <RatFuncs.h>
+#include "events.h"
+#ifdef TMOC_BENCH
+#include "bench.h"
+#endif
 
 
 void setup()
 {
   setThingsUp();
+#ifdef TMOC_BENCH
+  runBenchmarks();
+#endif
 }
 
 
+#ifdef RATDEBUG
+// Once a second: how many times we got around the loop (polled: every
+// spin; otherwise: every event or timeout), and how much of that second
+// went on drawing LEDs
+void loopStats()
+{
+  static uint32_t loops(0);
+  static uint32_t windowStart(micros());
+
+  ++loops;
+  uint32_t now(micros());
+  if (now - windowStart < 1000000UL)
+  {
+    return;
+  }
+
+  uint32_t renders, ledMicros;
+  panelLeds.takeStats(renders, ledMicros);
+  dbprintf("loop: %lu/s, %lu LED renders, LEDs %lu.%lu%% of CPU\n",
+           (unsigned long)loops,
+           (unsigned long)renders,
+           (unsigned long)(ledMicros / 10000),
+           (unsigned long)(ledMicros / 1000 % 10));
+  mode.logStats();
+  logInputStats();
+  loops       = 0;
+  windowStart = now;
+}
+#endif
+
+
 void loop()
 {
+#ifdef POLLED_INPUTS
   handleMode();
   handleToggle();
   handleReset();
   handleClock();
   panelLeds.updateAll();
+#else
+  // Sleeps until the timer ISR has something for us; the timeout is just
+  // so the stats below still get a look-in
+  inputEvents.dispatchNext(pdMS_TO_TICKS(1000));
+#ifdef RATDEBUG
+  inputEvents.logStats();
+#endif
+#endif
+
+#ifdef RATDEBUG
+  loopStats();
+#endif
 }
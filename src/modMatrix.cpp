@@ -0,0 +1,165 @@
+#include "modMatrix.h"
+#include "hal.h"
+
+ModMatrix modMatrix;
+
+
+void modMatrixTask(void *param)
+{
+  ModMatrix* matrix(static_cast<ModMatrix*>(param));
+  TickType_t lastWake(halTicks());
+  while (1)
+  {
+    halDelayUntil(lastWake, 1000 / MOD_SAMPLE_HZ);
+    matrix->sample();
+  }
+}
+
+
+ModMatrix::ModMatrix():
+  numRoutes_  (0),
+  atEdge_     (false),
+  taskHandle_ (NULL),
+  mux_        (portMUX_INITIALIZER_UNLOCKED)
+{
+  memset(routes_, 0, sizeof(routes_));
+  memset(mv_,     0, sizeof(mv_));
+  memset(level_,  0, sizeof(level_));
+  memset(edgeMv_, 0, sizeof(edgeMv_));
+}
+
+
+void ModMatrix::begin()
+{
+  sample();
+
+  // Same neighbourhood as the fader scan
+  halTaskStart
+  (
+    modMatrixTask,
+    "modMatrix Task",
+    2048,
+    this,
+    7,
+    &taskHandle_
+  );
+}
+
+
+void ModMatrix::sample()
+{
+  // Do the slow part before anybody has to wait on the lock
+  uint16_t mv[NUM_MOD_SOURCES];
+  for (uint8_t src(0); src < NUM_MOD_SOURCES; ++src)
+  {
+    mv[src] = halAdcMv(MOD_SRC_PIN[src]);
+  }
+
+  portENTER_CRITICAL(&mux_);
+  for (uint8_t src(0); src < NUM_MOD_SOURCES; ++src)
+  {
+    uint16_t clipped((mv[src] > MOD_FULL_SCALE_MV) ? MOD_FULL_SCALE_MV : mv[src]);
+    mv_   [src] = mv[src];
+    level_[src] = (uint32_t)clipped * MOD_LEVEL_ONE / MOD_FULL_SCALE_MV;
+  }
+  portEXIT_CRITICAL(&mux_);
+}
+
+
+// Only the task that clocks the sequencer calls these (and steps it), so
+// they don't need the lock
+void ModMatrix::sampleEdge()
+{
+  edgeMv_[static_cast<uint8_t>(mod_src::CV_A)] = halAdcMv(CV_IN_A);
+  edgeMv_[static_cast<uint8_t>(mod_src::CV_B)] = halAdcMv(CV_IN_B);
+  atEdge_ = true;
+}
+
+
+void ModMatrix::endEdge()
+{
+  atEdge_ = false;
+}
+
+
+uint16_t ModMatrix::stepMillivolts(mod_src src) const
+{
+  if (atEdge_ && (src == mod_src::CV_A || src == mod_src::CV_B))
+  {
+    return edgeMv_[static_cast<uint8_t>(src)];
+  }
+  return millivolts(src);
+}
+
+
+int8_t ModMatrix::addRoute(const ModRoute& route)
+{
+  if (numRoutes_ == MAX_MOD_ROUTES
+   || route.src  >= mod_src::LOOP
+   || route.dest >= mod_dest::NUM_DESTS)
+  {
+    return -1;
+  }
+
+  portENTER_CRITICAL(&mux_);
+  routes_[numRoutes_] = route;
+  int8_t idx(numRoutes_++);
+  portEXIT_CRITICAL(&mux_);
+  return idx;
+}
+
+
+// Keeps the list packed, so evaluate() never has to skip anything
+void ModMatrix::removeRoute(uint8_t idx)
+{
+  portENTER_CRITICAL(&mux_);
+  if (idx < numRoutes_)
+  {
+    memmove(&routes_[idx], &routes_[idx + 1], (numRoutes_ - idx - 1) * sizeof(ModRoute));
+    --numRoutes_;
+  }
+  portEXIT_CRITICAL(&mux_);
+}
+
+
+void ModMatrix::clearRoutes()
+{
+  portENTER_CRITICAL(&mux_);
+  numRoutes_ = 0;
+  portEXIT_CRITICAL(&mux_);
+}
+
+
+uint8_t ModMatrix::numRoutes() const
+{
+  return numRoutes_;
+}
+
+
+uint16_t ModMatrix::millivolts(mod_src src) const
+{
+  return mv_[static_cast<uint8_t>(src) % NUM_MOD_SOURCES];
+}
+
+
+uint16_t ModMatrix::level(mod_src src) const
+{
+  return level_[static_cast<uint8_t>(src) % NUM_MOD_SOURCES];
+}
+
+
+void ModMatrix::evaluate(ModValues& vals) const
+{
+  memset(&vals, 0, sizeof(vals));
+
+  portENTER_CRITICAL(&mux_);
+  for (uint8_t idx(0); idx < numRoutes_; ++idx)
+  {
+    const ModRoute &route(routes_[idx]);
+    uint8_t dest(static_cast<uint8_t>(route.dest));
+    int32_t amt(((int32_t)level_[static_cast<uint8_t>(route.src)] * route.amount) >> 12);
+    vals.amount[dest] += amt + route.offset;
+    vals.touched      |= (0x01 << dest);
+  }
+  portEXIT_CRITICAL(&mux_);
+}
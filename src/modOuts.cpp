@@ -0,0 +1,88 @@
+#include "modOuts.h"
+#include "slew.h"
+#include <RatFuncs.h>
+
+ModOutputs modOuts;
+
+#ifdef RATDEBUG
+const uint16_t MOD_LOG_INTERVAL(256);   // Steps between stats dumps
+#endif
+
+
+ModOutputs::ModOutputs():
+  phase_    (0),
+  phaseInc_ (0),
+  resync_   (false)
+#ifdef RATDEBUG
+  , steps_      (0)
+  , lastCycles_ (0)
+  , maxCycles_  (0)
+#endif
+{ ; }
+
+
+void ModOutputs::begin()
+{
+  for (uint8_t out(0); out < NUM_MOD_OUTS; ++out)
+  {
+    ledcSetup(MOD_LEDC_CHANNEL + out, MOD_PWM_HZ, MOD_PWM_BITS);
+    ledcAttachPin(PWM_OUT[out], MOD_LEDC_CHANNEL + out);
+    ledcWrite(MOD_LEDC_CHANNEL + out, 0);
+  }
+}
+
+
+void ModOutputs::step(uint16_t reg, int8_t offset, uint8_t length, uint32_t clockMicros)
+{
+#ifdef RATDEBUG
+  uint32_t start(ESP.getCycleCount());
+#endif
+
+  offset = modLoopStep(offset, length);
+
+  ledcWrite(MOD_LEDC_CHANNEL + MOD_DENSITY, modDuty(__builtin_popcount(reg), 16));
+  ledcWrite(MOD_LEDC_CHANNEL + MOD_PHASE,   modDuty(offset, length ? length - 1 : 0));
+  ledcWrite(MOD_LEDC_CHANNEL + MOD_HIGH,    modDuty(reg >> 8, 255));
+
+  // One LFO cycle per loop: 2^32 over (ticks per clock * clocks per loop)
+  uint64_t ticksPerLoop((uint64_t)clockMicros * length * SLEW_RATE_HZ / 1000000UL);
+  phaseInc_ = ticksPerLoop ? (uint32_t)(0x100000000ULL / ticksPerLoop) : 0;
+  if (offset == 0)
+  {
+    resync_ = true;
+  }
+
+#ifdef RATDEBUG
+  lastCycles_ = ESP.getCycleCount() - start;
+  if (lastCycles_ > maxCycles_)
+  {
+    maxCycles_ = lastCycles_;
+  }
+  if (++steps_ % MOD_LOG_INTERVAL == 0)
+  {
+    dbprintf("modOuts: %lu cycles/step (max %lu), clock %lu us\n",
+             (unsigned long)lastCycles_,
+             (unsigned long)maxCycles_,
+             (unsigned long)clockMicros);
+  }
+#endif
+}
+
+
+void ModOutputs::tick()
+{
+  if (resync_)
+  {
+    phase_  = 0;
+    resync_ = false;
+  }
+  else
+  {
+    phase_ = phase_ + phaseInc_;
+  }
+
+  // Triangle: top 13 bits of phase, with the second half folded back down
+  uint16_t ramp(phase_ >> 19);
+  uint16_t tri((ramp <= MOD_DUTY_MAX) ? ramp : (2 * MOD_DUTY_MAX + 1) - ramp);
+  ledcWrite(MOD_LEDC_CHANNEL + MOD_LFO, tri);
+}
@@ -1,5 +1,6 @@
 #include "modeCtrl.h"
-#include "leds.h"
+#include "hal.h"
+#include "inputs.h"
 
 mode_type ModeControl::currentMode()
 {
@@ -30,16 +31,124 @@ int8_t ModeControl::activeSlot()
 }
 
 
+int8_t ModeControl::activePage()
+{
+  int8_t slot(activeSlot());
+  return (slot < 0) ? -1 : slot / NUM_BANKS;
+}
+
+
+void ModeControl::stepSlot(int8_t& slot, int8_t amt)
+{
+  int8_t page(slot / NUM_BANKS);
+  int8_t idx((slot % NUM_BANKS) + amt);
+  while (idx < 0)
+  {
+    idx += NUM_BANKS;
+  }
+  slot = page * NUM_BANKS + idx % NUM_BANKS;
+}
+
+
+void ModeControl::stepPage(int8_t& slot, int8_t amt)
+{
+  slot += amt * NUM_BANKS;
+  while (slot < 0)
+  {
+    slot += NUM_SCENES;
+  }
+  slot %= NUM_SCENES;
+}
+
+
 void ModeControl::cancel()
 {
   currentMode_ = mode_type::CANCEL;
 }
 
+void ModeControl::startCalibration()
+{
+  // The button's still down from power-up. Wait for it to be let go, then
+  // throw away whatever that press turned into: otherwise its Hold is the
+  // "save and get out" long-press, and calibration's over before it starts
+  while (buttonDown())
+  {
+    vTaskDelay(pdMS_TO_TICKS(ENC_SERVICE_MS));
+  }
+  vTaskDelay(pdMS_TO_TICKS(ENC_RELEASE_SETTLE_MS));
+  while (pollEncoder() != encEvnts::NUM_ENC_EVNTS)
+  {
+    ;
+  }
+
+  currentMode_ = mode_type::CALIBRATION_MODE;
+}
+
+
+bool ModeControl::buttonDown() const
+{
+#if defined(ENC_POLLED) || defined(INPUTS_PER_PIN)
+  return digitalRead(ENC_SW) == (ENC_ACTIVE_LOW ? LOW : HIGH);
+#else
+  return inputs.active(input_bit::ENC_SW);
+#endif
+}
+
+
+void ModeControl::begin()
+{
+#ifndef ENC_POLLED
+  encoder_.begin();
+#endif
+}
+
+
 void ModeControl::service()
 {
+#ifdef RATDEBUG
+  uint32_t start(halCycles());
+#endif
+
+#ifdef ENC_POLLED
   encoder_.service();
+#else
+  if (++serviceTicks_ >= ENC_SERVICE_MS)
+  {
+    serviceTicks_ = 0;
+    encoder_.service(buttonDown());
+  }
+#endif
+
+#ifdef RATDEBUG
+  serviceCycles_ += halCycles() - start;
+  ++serviceCalls_;
+#endif
 }
 
+
+#ifdef RATDEBUG
+void ModeControl::logStats()
+{
+  if (!serviceCalls_)
+  {
+    return;
+  }
+  dbprintf("encoder: %lu cycles/tick in the ISR",
+           (unsigned long)(serviceCycles_ / serviceCalls_));
+#ifndef ENC_POLLED
+  const EncoderStats &st(encoder_.stats());
+  dbprintf(", %lu detents, %lu torn, fastest %u per %u ms",
+           (unsigned long)st.detents,
+           (unsigned long)st.torn,
+           st.maxPerService,
+           ENC_SERVICE_MS);
+#endif
+  dbprintf("\n");
+  serviceCycles_ = 0;
+  serviceCalls_  = 0;
+}
+#endif
+
 ModeCommand ModeControl::click()
 {
   switch (currentMode_)
@@ -74,6 +183,10 @@ ModeCommand ModeControl::doubleclick()
       // Command to load the new pattern
       return {command_enum::LOAD, loadSlot_};
 
+    case mode_type::CALIBRATION_MODE:
+      // Move on to the next DAC channel
+      return {command_enum::CAL_CHANNEL, 1};
+
     default:
       return {command_enum::NO_CMD, 0};
   }
@@ -94,6 +207,10 @@ ModeCommand ModeControl::hold()
       currentMode_ =  mode_type::PERFORMANCE_MODE;
       return {command_enum::SAVE, saveSlot_};
 
+    case mode_type::CALIBRATION_MODE:
+      // Save calibration data and get out of here
+      return {command_enum::CAL_DONE, 1};
+
     default:
       return {command_enum::NO_CMD, 0};
   }
@@ -111,15 +228,16 @@ ModeCommand ModeControl::right()
       return {command_enum::LENGTH, 1};
 
     case mode_type::PATTERN_LOAD_MODE:
-      ++loadSlot_;
-      loadSlot_ %= NUM_BANKS;
+      stepSlot(loadSlot_, 1);
       return {command_enum::LEDS, 1};
 
     case mode_type::PATTERN_SAVE_MODE:
-      ++saveSlot_;
-      saveSlot_ %= NUM_BANKS;
+      stepSlot(saveSlot_, 1);
       return {command_enum::LEDS, 1};
 
+    case mode_type::CALIBRATION_MODE:
+      return {command_enum::CAL_TRIM, 1};
+
     default:
       return {command_enum::NO_CMD, 0};
   }
@@ -137,21 +255,16 @@ ModeCommand ModeControl::left()
       return {command_enum::LENGTH, -1};
 
     case mode_type::PATTERN_LOAD_MODE:
-      --loadSlot_;
-      if (loadSlot_ < 0)
-      {
-        loadSlot_ += NUM_BANKS;
-      }
+      stepSlot(loadSlot_, -1);
       return {command_enum::LEDS, 1};
 
     case mode_type::PATTERN_SAVE_MODE:
-      --saveSlot_;
-      if (saveSlot_ < 0)
-      {
-        saveSlot_ += NUM_BANKS;
-      }
+      stepSlot(saveSlot_, -1);
       return {command_enum::LEDS, 1};
 
+    case mode_type::CALIBRATION_MODE:
+      return {command_enum::CAL_TRIM, -1};
+
     default:
       return {command_enum::NO_CMD, 0};
   }
@@ -160,19 +273,64 @@ ModeCommand ModeControl::left()
 
 ModeCommand ModeControl::clickhold()
 {
-  return {command_enum::NO_CMD, 0};
+  switch (currentMode_)
+  {
+    case mode_type::PERFORMANCE_MODE:
+      // Start/stop playing the step history backwards
+      return {command_enum::RETROGRADE, 1};
+
+    default:
+      return {command_enum::NO_CMD, 0};
+  }
 }
 
 
 ModeCommand ModeControl::shiftleft()
 {
-  return {command_enum::NO_CMD, 0};
+  switch (currentMode_)
+  {
+    case mode_type::PERFORMANCE_MODE:
+      // Rewind through the step history
+      return {command_enum::SCRUB, -1};
+
+    case mode_type::PATTERN_LOAD_MODE:
+      stepPage(loadSlot_, -1);
+      return {command_enum::LEDS, 1};
+
+    case mode_type::PATTERN_SAVE_MODE:
+      stepPage(saveSlot_, -1);
+      return {command_enum::LEDS, 1};
+
+    case mode_type::CALIBRATION_MODE:
+      return {command_enum::CAL_COARSE, -1};
+
+    default:
+      return {command_enum::NO_CMD, 0};
+  }
 }
 
 
 ModeCommand ModeControl::shiftright()
 {
-  return {command_enum::NO_CMD, 0};
+  switch (currentMode_)
+  {
+    case mode_type::PERFORMANCE_MODE:
+      return {command_enum::SCRUB, 1};
+
+    case mode_type::PATTERN_LOAD_MODE:
+      stepPage(loadSlot_, 1);
+      return {command_enum::LEDS, 1};
+
+    case mode_type::PATTERN_SAVE_MODE:
+      stepPage(saveSlot_, 1);
+      return {command_enum::LEDS, 1};
+
+    case mode_type::CALIBRATION_MODE:
+      return {command_enum::CAL_COARSE, 1};
+
+    default:
+      return {command_enum::NO_CMD, 0};
+  }
 }
 
 
@@ -183,6 +341,33 @@ ModeCommand ModeControl::press()
 
 
 ModeCommand ModeControl::update()
+{
+  return handle(pollEncoder());
+}
+
+
+encEvnts ModeControl::pollEncoder()
+{
+  // Check for new events from our encoder and clear the "ready" flag if there are
+#ifdef ENC_POLLED
+  return encoderInterface_.getEvent();
+#else
+  return encoder_.getEvent();
+#endif
+}
+
+
+encEvnts ModeControl::peekEncoder()
+{
+#ifdef ENC_POLLED
+  return encEvnts::NUM_ENC_EVNTS;
+#else
+  return encoder_.peekEvent();
+#endif
+}
+
+
+ModeCommand ModeControl::handle(encEvnts evt)
 {
   if (currentMode_ == mode_type::CANCEL)
   {
@@ -190,8 +375,7 @@ ModeCommand ModeControl::update()
     return {command_enum::LEDS, 1};
   }
 
-  // Check for new events from our encoder and clear the "ready" flag if there are
-  switch(encoderInterface_.getEvent())
+  switch(evt)
   {
     case encEvnts::Click:
       return click();
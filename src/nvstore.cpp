@@ -0,0 +1,148 @@
+#include "nvstore.h"
+
+#ifdef ARDUINO
+
+#include <Preferences.h>
+
+
+NvStore::NvStore(const char* nameSpace):
+  namespace_(nameSpace)
+{ ; }
+
+
+bool NvStore::load(const char* key, void* buf, size_t len) const
+{
+  Preferences prefs;
+  if (!prefs.begin(namespace_, true))   // Read-only = true
+  {
+    return false;
+  }
+
+  bool ok(prefs.getBytesLength(key) == len);
+  if (ok)
+  {
+    ok = (prefs.getBytes(key, buf, len) == len);
+  }
+  prefs.end();
+  return ok;
+}
+
+
+bool NvStore::store(const char* key, const void* buf, size_t len)
+{
+  Preferences prefs;
+  if (!prefs.begin(namespace_, false))  // Read-only = false
+  {
+    return false;
+  }
+
+  bool ok(prefs.putBytes(key, buf, len) == len);
+  prefs.end();
+  return ok;
+}
+
+#else // Host build: one file per key
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+
+static std::string nvDir()
+{
+  const char* dir(std::getenv("TMOC_NVS_DIR"));
+  return dir ? dir : "nvs";
+}
+
+
+// mkdir -p: every missing directory along [dir], the way NVS is just
+// there on the board
+static bool makeDir(const std::string& dir)
+{
+  for (size_t sep(dir.find('/', 1)); ; sep = dir.find('/', sep + 1))
+  {
+    std::string part(dir.substr(0, sep));
+    if (mkdir(part.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+      fprintf(stderr, "nvstore: can't create %s: %s\n", part.c_str(), strerror(errno));
+      return false;
+    }
+    if (sep == std::string::npos)
+    {
+      return true;
+    }
+  }
+}
+
+
+static std::string nvPath(const char* nameSpace, const char* key)
+{
+  std::string path(nvDir());
+  path += "/";
+  path += nameSpace;
+  path += ".";
+  path += key;
+  return path;
+}
+
+
+NvStore::NvStore(const char* nameSpace):
+  namespace_(nameSpace)
+{ ; }
+
+
+bool NvStore::load(const char* key, void* buf, size_t len) const
+{
+  FILE* fp(std::fopen(nvPath(namespace_, key).c_str(), "rb"));
+  if (!fp)
+  {
+    return false;
+  }
+
+  // Read into a scratch copy so a short file can't leave [buf] half-written
+  std::string scratch(len + 1, '\0');
+  size_t got(std::fread(&scratch[0], 1, len + 1, fp));
+  std::fclose(fp);
+  if (got != len)
+  {
+    return false;
+  }
+
+  memcpy(buf, scratch.data(), len);
+  return true;
+}
+
+
+bool NvStore::store(const char* key, const void* buf, size_t len)
+{
+  // Write to a temp file and rename it over the old one, which is about as
+  // close to NVS's all-or-nothing commit as a filesystem gets
+  std::string path(nvPath(namespace_, key));
+  std::string tmp(path + ".tmp");
+  if (!makeDir(nvDir()))
+  {
+    return false;
+  }
+
+  FILE* fp(std::fopen(tmp.c_str(), "wb"));
+  if (!fp)
+  {
+    fprintf(stderr, "nvstore: can't write %s: %s\n", tmp.c_str(), strerror(errno));
+    return false;
+  }
+
+  bool ok(std::fwrite(buf, 1, len, fp) == len);
+  ok = (std::fclose(fp) == 0) && ok;
+  if (!ok)
+  {
+    std::remove(tmp.c_str());
+    return false;
+  }
+
+  return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+#endif
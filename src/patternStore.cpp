@@ -0,0 +1,179 @@
+#include "patternStore.h"
+#include "clockRate.h"
+#include "hal.h"
+
+static_assert(NUM_SCENES <= 32, "dirty_/persisted_ only have 32 bits");
+
+PatternStore patternStore;
+
+
+#ifdef ARDUINO
+void patternStoreTask(void *param)
+{
+  PatternStore* store(static_cast<PatternStore*>(param));
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STORE_POLL_MS));
+    store->commitPending();
+    store->prepareSpare();
+  }
+}
+#endif
+
+
+// Whether an erase started now would be over before the next clock edge
+static bool eraseWindowOpen()
+{
+  uint32_t since(halMicros() - lastClockEdgeMicros());
+  if (since >= CLOCK_TIMEOUT_MICROS)
+  {
+    return true;
+  }
+  return since + STORE_ERASE_MICROS < clockPeriodMicros();
+}
+
+
+PatternStore::PatternStore():
+  persisted_  (0),
+  dirty_      (0),
+  taskHandle_ (NULL),
+  mux_        (portMUX_INITIALIZER_UNLOCKED)
+{ ; }
+
+
+void PatternStore::begin()
+{
+  if (!journal_.mount())
+  {
+    dbprintln("pattern journal failed to mount");
+    return;
+  }
+
+  for (uint8_t idx(0); idx < NUM_SCENES; ++idx)
+  {
+    if (journal_.read(idx, &records_[idx], sizeof(SceneRecord)))
+    {
+      persisted_ |= (1UL << idx);
+    }
+  }
+  dbprintf("restored scenes 0x%08lx from flash\n", (unsigned long)persisted_);
+
+#ifdef ARDUINO
+  // Lowest priority there is short of idle, and off on the core that the
+  // sequencer isn't using
+  xTaskCreatePinnedToCore
+  (
+    patternStoreTask,
+    "patternStore Task",
+    4096,
+    this,
+    1,
+    &taskHandle_,
+    0
+  );
+#endif
+}
+
+
+bool PatternStore::restore(uint8_t scene, SceneRecord& rec) const
+{
+  if (scene >= NUM_SCENES || !(persisted_ & (1UL << scene)))
+  {
+    return false;
+  }
+
+  rec = records_[scene];
+  return true;
+}
+
+
+void PatternStore::save(uint8_t scene, const SceneRecord& rec)
+{
+  if (scene >= NUM_SCENES)
+  {
+    return;
+  }
+
+  portENTER_CRITICAL(&mux_);
+  records_[scene] = rec;
+  dirty_     |= (1UL << scene);
+  persisted_ |= (1UL << scene);
+  portEXIT_CRITICAL(&mux_);
+
+#ifdef ARDUINO
+  if (taskHandle_)
+  {
+    xTaskNotifyGive(taskHandle_);
+  }
+#endif
+}
+
+
+void PatternStore::commitPending()
+{
+  while (true)
+  {
+    // Grab one dirty scene's record. If it gets saved again while we're
+    // writing, it'll just get marked dirty again and go around once more.
+    SceneRecord rec;
+    int8_t      scene(-1);
+
+    portENTER_CRITICAL(&mux_);
+    for (uint8_t idx(0); idx < NUM_SCENES; ++idx)
+    {
+      if (dirty_ & (1UL << idx))
+      {
+        scene = idx;
+        rec   = records_[idx];
+        dirty_ &= ~(1UL << idx);
+        break;
+      }
+    }
+    portEXIT_CRITICAL(&mux_);
+
+    if (scene < 0)
+    {
+      return;
+    }
+
+    if (!journal_.append(scene, &rec, sizeof(rec)))
+    {
+      // Still needs writing. Leave the rest until the next wake-up too,
+      // rather than going round and round on flash that won't take it.
+      portENTER_CRITICAL(&mux_);
+      dirty_ |= (1UL << scene);
+      portEXIT_CRITICAL(&mux_);
+      dbprintf("scene %d NOT written to flash; trying again later\n", scene);
+      return;
+    }
+
+    dbprintf("scene %d written to flash in %u us (max %u us)\n",
+             scene, journal_.lastCommitMicros(), journal_.maxCommitMicros());
+  }
+}
+
+
+void PatternStore::prepareSpare()
+{
+  if (journal_.spareReady() || !eraseWindowOpen())
+  {
+    return;
+  }
+
+  if (journal_.prepareSpare())
+  {
+    dbprintf("journal sector erased ahead of time in %u us\n", journal_.lastEraseMicros());
+  }
+}
+
+
+uint32_t PatternStore::lastCommitMicros() const
+{
+  return journal_.lastCommitMicros();
+}
+
+
+uint32_t PatternStore::maxCommitMicros() const
+{
+  return journal_.maxCommitMicros();
+}
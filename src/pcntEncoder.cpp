@@ -0,0 +1,192 @@
+#include "pcntEncoder.h"
+#include "hal.h"
+
+// Knob's counted as at rest after this long without a count
+const uint16_t ENC_IDLE_MS(200);
+
+
+PcntEncoder::PcntEncoder(uint8_t pinA,
+                         uint8_t pinB,
+                         uint8_t countsPerDetent,
+                         uint8_t unit):
+  unit_           (unit),
+  pinA_           (pinA),
+  pinB_           (pinB),
+  countsPerDetent_(countsPerDetent ? countsPerDetent : 1),
+  lastCount_      (0),
+  partial_        (0),
+  idleMs_         (0),
+  down_           (false),
+  turned_         (false),
+  holdSent_       (false),
+  clickPending_   (false),
+  downMs_         (0),
+  upMs_           (0),
+  head_           (0),
+  tail_           (0)
+{
+  memset(&stats_, 0, sizeof(stats_));
+}
+
+
+void PcntEncoder::begin()
+{
+  halPcntBegin(unit_, pinA_, pinB_, ENC_GLITCH_FILTER);
+  lastCount_ = 0;
+}
+
+
+void PcntEncoder::push(encEvnts evt)
+{
+  uint8_t next((head_ + 1) % ENC_EVENT_QUEUE);
+  if (next == tail_)
+  {
+    return;
+  }
+  queue_[head_] = evt;
+  head_ = next;
+}
+
+
+encEvnts PcntEncoder::getEvent()
+{
+  if (tail_ == head_)
+  {
+    return encEvnts::NUM_ENC_EVNTS;
+  }
+  encEvnts evt(queue_[tail_]);
+  tail_ = (tail_ + 1) % ENC_EVENT_QUEUE;
+  return evt;
+}
+
+
+encEvnts PcntEncoder::peekEvent() const
+{
+  return (tail_ == head_) ? encEvnts::NUM_ENC_EVNTS : queue_[tail_];
+}
+
+
+void PcntEncoder::service(bool buttonDown)
+{
+  serviceKnob();
+  serviceButton(buttonDown);
+}
+
+
+void PcntEncoder::serviceKnob()
+{
+  int16_t count(halPcntCount(unit_));
+
+  // At a 5 ms service rate, nobody's spinning this fast enough to wrap
+  int16_t delta(count - lastCount_);
+  lastCount_ = count;
+
+  if (delta == 0)
+  {
+    if (idleMs_ < ENC_IDLE_MS)
+    {
+      idleMs_ += ENC_SERVICE_MS;
+      if (idleMs_ >= ENC_IDLE_MS && partial_ != 0)
+      {
+        // Stopped between detents; the hardware doesn't lose edges, so
+        // that's contact bounce the filter let through, or a dropped one
+        ++stats_.torn;
+        partial_ = 0;
+      }
+    }
+    return;
+  }
+  idleMs_ = 0;
+
+  partial_ += delta;
+  uint16_t steps(0);
+  while (partial_ >= countsPerDetent_ || partial_ <= -countsPerDetent_)
+  {
+    bool right(partial_ > 0);
+    partial_ += right ? -countsPerDetent_ : countsPerDetent_;
+    if (down_)
+    {
+      turned_ = true;
+      push(right ? encEvnts::ShiftRight : encEvnts::ShiftLeft);
+    }
+    else
+    {
+      push(right ? encEvnts::Right : encEvnts::Left);
+    }
+    ++steps;
+  }
+
+  stats_.detents += steps;
+  if (steps > stats_.maxPerService)
+  {
+    stats_.maxPerService = steps;
+  }
+}
+
+
+void PcntEncoder::serviceButton(bool down)
+{
+  if (down && !down_)
+  {
+    down_     = true;
+    turned_   = false;
+    holdSent_ = false;
+    downMs_   = 0;
+    push(encEvnts::Press);
+    return;
+  }
+
+  if (down)
+  {
+    if (downMs_ < ENC_HOLD_MS)
+    {
+      downMs_ += ENC_SERVICE_MS;
+    }
+    if (!holdSent_ && !turned_ && downMs_ >= ENC_HOLD_MS)
+    {
+      holdSent_ = true;
+      push(clickPending_ ? encEvnts::ClickHold : encEvnts::Hold);
+      clickPending_ = false;
+    }
+    return;
+  }
+
+  if (down_)
+  {
+    // Just let go
+    down_ = false;
+    upMs_ = 0;
+    if (turned_ || holdSent_)
+    {
+      clickPending_ = false;
+      return;
+    }
+
+    if (clickPending_)
+    {
+      clickPending_ = false;
+      push(encEvnts::DblClick);
+    }
+    else
+    {
+      clickPending_ = true;
+    }
+    return;
+  }
+
+  if (clickPending_)
+  {
+    upMs_ += ENC_SERVICE_MS;
+    if (upMs_ >= ENC_DOUBLECLICK_MS)
+    {
+      clickPending_ = false;
+      push(encEvnts::Click);
+    }
+  }
+}
+
+
+const EncoderStats& PcntEncoder::stats() const
+{
+  return stats_;
+}
@@ -0,0 +1,311 @@
+#include "seqIO.h"
+#include "hal.h"
+#include "cvMix.h"
+
+////////////////////////////////////////////////////////////////
+//                      ESP32
+////////////////////////////////////////////////////////////////
+#ifdef ARDUINO
+
+#include "hwio.h"
+#include "faderScan.h"
+#include "modOuts.h"
+#include "slew.h"
+
+
+void ioSelectFaderBank(uint8_t bank)
+{
+  faders.selectBank(bank);
+  faderScan.restart();
+}
+
+
+void ioReadFaders(uint16_t vals[NUM_FADERS])
+{
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    vals[ch] = faders.read(ch);
+  }
+}
+
+
+void ioSaveFaderBank(uint8_t bank)
+{
+  faders.saveBank(bank);
+}
+
+
+void ioSetRange(uint8_t octaves)
+{
+  setOctaveRange(octaves);
+}
+
+
+uint8_t ioRange()
+{
+  return octaveRange();
+}
+
+
+void ioSetTrigLength(uint8_t ms)
+{
+  triggers.setLength(ms);
+}
+
+
+uint8_t ioTrigLength()
+{
+  return triggers.length();
+}
+
+
+void ioSetOutputConfig(const TrigConfig trig[NUM_TRIGGERS],
+                       const SlewConfig glide[NUM_DAC_CHANNELS])
+{
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    triggers.configure(out, trig[out]);
+  }
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    slew.configure(ch, glide[ch]);
+  }
+}
+
+
+void ioModulation(ModValues& mods, uint32_t& loopMv, uint32_t& cvMv)
+{
+  // Everything the mod matrix needs was sampled ahead of time (CV A on
+  // the clock edge, if there was one); this is just arithmetic
+  modMatrix.evaluate(mods);
+  loopMv = modMatrix.millivolts(mod_src::LOOP);
+  cvMv   = modMatrix.stepMillivolts(mod_src::CV_A);
+}
+
+
+void ioStep(const StepOutputs& out)
+{
+  expandVoltages((uint8_t)(out.reg & 0xFF), out.freshFaders);
+  modOuts.step(out.reg, out.step, out.length, clockPeriodMicros());
+  triggers.clock();
+  panelLeds.clock(out.reset);
+}
+
+
+void ioClockFell()
+{
+  triggers.clockFell();
+}
+
+
+void ioLedFrame()
+{
+  panelLeds.updateAll();
+}
+
+
+bool ioRestoreScene(uint8_t idx, SceneRecord& rec)
+{
+  return patternStore.restore(idx, rec);
+}
+
+
+void ioSaveScene(uint8_t idx, const SceneRecord& rec)
+{
+  patternStore.save(idx, rec);
+}
+
+
+void ioWarmSync(const WarmSnapshot& snap)
+{
+  warmStart.setReg      (snap.reg);
+  warmStart.setOffset   (snap.offset);
+  warmStart.setLengthIdx(snap.lengthIdx);
+  warmStart.setBank     (snap.bank);
+  warmStart.setNextBank (snap.nextBank);
+  warmStart.setFaderBank(snap.faderBank);
+  warmStart.setFlags    (snap.flags);
+}
+
+
+void ioFirstStep()
+{
+  warmStart.firstStep();
+}
+
+
+#else // Host build
+////////////////////////////////////////////////////////////////
+//                      HOST
+////////////////////////////////////////////////////////////////
+// A board with no surprises: every fader bank remembers its values
+// exactly, CVs are the raw fader sums (no calibration, no slew), and the
+// low byte of the register goes straight out on the trigger chain.
+// Nothing is saved anywhere.
+
+static uint16_t hostFaders[NUM_SCENES][NUM_FADERS];
+static uint8_t  hostFaderBank(0);
+static uint8_t  hostRange(MIN_OCTAVES);
+static uint8_t  hostTrigMs(DEFAULT_TRIGGER_MS);
+static uint16_t hostStepFaders[NUM_FADERS];     // What the last step went out with
+static uint8_t  hostGates(0);                   // Trigger outputs that end on the clock's fall
+static uint8_t  hostSceneGates(0);              // ...and the ones the scene made GATEs
+
+
+void ioSelectFaderBank(uint8_t bank)
+{
+  hostFaderBank = bank % NUM_SCENES;
+}
+
+
+void ioReadFaders(uint16_t vals[NUM_FADERS])
+{
+  memcpy(vals, hostFaders[hostFaderBank], sizeof(hostFaders[0]));
+}
+
+
+void ioSaveFaderBank(uint8_t bank)
+{
+  memcpy(hostFaders[bank % NUM_SCENES], hostFaders[hostFaderBank], sizeof(hostFaders[0]));
+}
+
+
+void ioSetRange(uint8_t octaves)
+{
+  hostRange = constrain(octaves, MIN_OCTAVES, MAX_OCTAVES);
+}
+
+
+uint8_t ioRange()
+{
+  return hostRange;
+}
+
+
+void ioSetTrigLength(uint8_t ms)
+{
+  hostTrigMs = ms;
+}
+
+
+uint8_t ioTrigLength()
+{
+  return hostTrigMs;
+}
+
+
+// Glides don't mean anything here (there's no slew); GATE outputs do
+void ioSetOutputConfig(const TrigConfig trig[NUM_TRIGGERS],
+                       const SlewConfig glide[NUM_DAC_CHANNELS])
+{
+  (void)glide;
+  hostSceneGates = 0;
+  for (uint8_t out(0); out < NUM_TRIGGERS; ++out)
+  {
+    bitWrite(hostSceneGates, out, trig[out].mode == trig_mode::GATE);
+  }
+}
+
+
+void ioModulation(ModValues& mods, uint32_t& loopMv, uint32_t& cvMv)
+{
+  modMatrix.evaluate(mods);
+  loopMv = modMatrix.millivolts(mod_src::LOOP);
+  cvMv   = modMatrix.stepMillivolts(mod_src::CV_A);
+}
+
+
+void ioStep(const StepOutputs& out)
+{
+  uint16_t vals[NUM_FADERS];
+  if (out.freshFaders)
+  {
+    memcpy(vals, out.freshFaders, sizeof(vals));
+  }
+  else
+  {
+    ioReadFaders(vals);
+  }
+
+  memcpy(hostStepFaders, vals, sizeof(hostStepFaders));
+
+  // Same arithmetic as the board's expandVoltages(), with the scene's
+  // output flags left at their defaults
+  static CvMixer mixer;
+  uint16_t cv[NUM_DAC_CHANNELS];
+  mixer.mix((uint8_t)(out.reg & 0xFF), vals, 0, cv);
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    halDacWrite(ch, cv[ch]);
+  }
+  halDacLatch();
+  halDacWrite(HAL_INT_DAC, (uint8_t)~out.reg);
+  halShiftOut(HAL_SR_TRIGGERS, out.reg & 0xFF);
+}
+
+
+void ioClockFell()
+{
+  uint16_t frame(halHostShiftReg(HAL_SR_TRIGGERS));
+  uint8_t  gates(hostGates | hostSceneGates);
+  if (frame & gates)
+  {
+    halShiftOut(HAL_SR_TRIGGERS, frame & ~gates);
+  }
+}
+
+
+void ioLedFrame()
+{
+  ;
+}
+
+
+bool ioRestoreScene(uint8_t idx, SceneRecord& rec)
+{
+  (void)idx;
+  (void)rec;
+  return false;
+}
+
+
+void ioSaveScene(uint8_t idx, const SceneRecord& rec)
+{
+  (void)idx;
+  (void)rec;
+}
+
+
+void ioWarmSync(const WarmSnapshot& snap)
+{
+  (void)snap;
+}
+
+
+void ioFirstStep()
+{
+  ;
+}
+
+
+// For the host harness: what the faders in [bank] are set to
+void ioHostSetFader(uint8_t bank, uint8_t ch, uint16_t val)
+{
+  hostFaders[bank % NUM_SCENES][ch % NUM_FADERS] = val;
+}
+
+
+// ...which fader values the last step's CVs were worked out from
+void ioHostStepFaders(uint16_t vals[NUM_FADERS])
+{
+  memcpy(vals, hostStepFaders, sizeof(hostStepFaders));
+}
+
+
+// ...and which trigger outputs are gates
+void ioHostSetGates(uint8_t mask)
+{
+  hostGates = mask;
+}
+
+#endif
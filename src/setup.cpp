@@ -9,9 +9,18 @@
 #include "OutputDac.h"
 #include <bitHelpers.h>
 #include <ClickEncoder.h>
-#include <OutputRegister.h>
+#include "srBus.h"
+#include "bcm.h"
 #include "ESP32_New_TimerInterrupt.h"
 #include "stoch.h"
+#include "calibration.h"
+#include "patternStore.h"
+#include "warmStart.h"
+#include "slew.h"
+#include "modOuts.h"
+#include "faderScan.h"
+#include "modMatrix.h"
+#include "events.h"
 
 void setupESP32_ADCs()
 {
@@ -19,56 +28,96 @@ void setupESP32_ADCs()
   cvA.attach(CV_IN_A);
   cvB.attach(CV_IN_B);
   cvLOOP.attach(LOOP_CTRL);
+  cvAUX.attach(UNUSED_ANALOG);
 }
 
 // Sequencer state variables
-uint8_t OctaveRange(1);
 ModeControl mode;
 
 // Core Shift Register functionality
-Stochasticizer stoch(cvLOOP, cvA);
+Stochasticizer stoch;
 TuringRegister alan(stoch);
 
 const uint8_t sliderMapping[]{7, 6, 5, 4, 3, 2, 1, 0};
-ControllerBank  faders(NUM_FADERS, NUM_BANKS, sliderMapping);
+ControllerBank  faders(NUM_FADERS, NUM_SCENES, sliderMapping);
 
 
 void setThingsUp()
 {
+  // Did we just trip over something (brownout, watchdog, crash)? If so,
+  // we'll skip anything that would make us lose our place
+  WarmSnapshot snap;
+  bool warm(warmStart.begin(snap));
+
   #ifdef RATDEBUG
     Serial.begin(115200);
-    delay(100);
+    if (!warm)
+    {
+      delay(100);
+    }
   #endif
 
-  // Shift register CS pins
-  pinMode(LED_SR_CS,        OUTPUT);
-  pinMode(TRIG_SR_CS,       OUTPUT);
-
   // PWM outputs
-  for (uint8_t p(0); p < 4; ++p)
-  {
-    pinMode(PWM_OUT[p],     OUTPUT);
-  }
+  modOuts.begin();
 
-  // 74HC595 Latch pins is active low
-  digitalWrite(LED_SR_CS,   HIGH);
-  digitalWrite(TRIG_SR_CS,  HIGH);
+  // Gates & switches, then the encoder's pulse counter
+  inputs.begin();
+  mode.begin();
 
-  // Set up internal ADCs
+  // LED & trigger 74HC595s (this owns their clock, data & latch pins)
+  srBus.begin();
+  bcmLeds.begin();
+
+  // Set up internal ADCs, and start keeping an eye on them
   setupESP32_ADCs();
+  modMatrix.begin();
 
   // Clear trigger output register
   triggers.reset();
 
   // Set up external 8 channel ADC
   faders.init(SPI_DATA_OUT, SPI_DATA_IN, SPI_CLK, ADC0_CS);
+  faderScan.begin();
 
   // Set up DAC
   initOutputDac();
+  dacCal.load();
 
   setupTimers();
-  alan.reset();
+
+  // Bring back whatever patterns were saved before the last power-off
+  patternStore.begin();
+  alan.restoreBanks();
+
+  if (warm)
+  {
+    // Carry on from the snapshot; no calibration, no reset
+    alan.warmRestore(snap);
+  }
+  else
+  {
+    // Hold the encoder button at power-up to calibrate the DAC outputs
+    if (digitalRead(ENC_SW) == (ENC_ACTIVE_LOW ? LOW : HIGH))
+    {
+      calibrate();
+    }
+
+    alan.reset();
+  }
+
+  // Calibration's done with the DACs, so glides can have them
+  slew.begin();
 
   // Set pattern LEDs to display current pattern
   panelLeds.updateAll();
+  warmStart.ready();
+
+  // Calibration's done polling the encoder; from here on, the timer ISR
+  // posts anything that happens
+  inputEvents.begin();
+
+  // Calibration finishes in CANCEL, and nothing would take it back to
+  // performance mode until the knob moved (the polled loop went through
+  // the mode control every pass)
+  onEncoder(encEvnts::NUM_ENC_EVNTS);
 }
\ No newline at end of file
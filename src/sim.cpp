@@ -0,0 +1,855 @@
+// ------------------------------------------------------------------------
+// sim.cpp
+//
+// main() for [env:sim]: a discrete-event simulation of how the firmware's
+// contexts take turns. The 1 kHz timer ISR (onTimer1) samples the inputs,
+// services the switches and posts events; the callbacks task it wakes
+// runs the timed callbacks (trigger pulses ending); loop() works through
+// the event queue. Time is simulated, in microseconds, and nothing here
+// depends on the host's clock or scheduler, so the same arguments always
+// give the same run.
+//
+// What runs for real: InputSampler, SwitchButton and ModeControl's
+// encoder (against simulated pins and pulse counter), EventQueue's polling
+// and dispatching (events.cpp) with the handlers behind it (handlers.cpp,
+// toggle.cpp), and the sequencer core on the stand-in board from seqIO.cpp.
+// What's modelled: where the events wait (an EventStore the same length as
+// the board's queue) and how long everything takes. Those costs are
+// parameters; the "events:" and "inputs:" RATDEBUG logs give you the
+// board's figures. loop() is the lowest priority thing there is, so a
+// handler gets preempted by every tick's ISR and callbacks, plus any
+// background task load you add.
+//
+// Output is CSV. Every input and output edge, in time order:
+//
+//   edge,<us>,in|out,<signal>,<value>
+//
+// and then
+//
+//   summary,<clocks in>,<steps>,<missed>,<dropped>,<max queue>,
+//           <latency min>,<avg>,<max>,<jitter p-p>,<jitter sd>
+//
+// Latency is clock input edge to the CVs changing, in us; jitter is how
+// much that moves around. With -x it looks for the fastest clock that
+// gets one step per pulse, no dropped events and a latency under one
+// period, instead:
+//
+//   maxrate,<period us>,<Hz>
+//
+// Options (ms unless it says us):
+//   -d ms                            how long (default 10000)
+//   -c us[:width us[:jitter us[:end us]]]
+//                                    clock period; jitter is +/-, pseudo-
+//                                    random; [end] ramps the period there
+//                                    over the run. 0 for no clock.
+//   -r ms[:width[:offset]]           reset pulses
+//   -e ms:detents[:gap]              encoder turn (negative: anticlockwise)
+//   -g ms:up|down:click|double|hold  toggle switch
+//   -G mask                          trigger outputs that are gates (high
+//                                    until the clock falls)
+//   -k name=us,...                   costs: isr, cb, and the handlers by
+//                                    their events.cpp names (enc, toggle,
+//                                    clk+, clk-, reset, leds)
+//   -l ms:us                         background task, [us] every [ms]
+//   -s seed
+//   -q                               just the summary
+//   -x                               max clock rate search
+// ------------------------------------------------------------------------
+#ifndef ARDUINO
+
+#include <deque>
+#include <vector>
+#include <random>
+#include <new>
+#include "setup.h"
+#include "handlers.h"
+#include "toggle.h"
+#include "inputs.h"
+#include "events.h"
+#include "seqIO.h"
+#include "hal.h"
+
+Stochasticizer stoch;
+TuringRegister alan(stoch);
+ModeControl    mode;
+
+const uint32_t SIM_TICK_US        (1000);       // Timer 1
+const uint32_t SIM_DRAIN_MS       (250);        // Runs on this long after the inputs stop
+
+// Toggle gestures: how long it's held for, and the gap in a double click
+const uint16_t SIM_CLICK_MS       (60);
+const uint16_t SIM_DOUBLE_GAP_MS  (120);
+const uint16_t SIM_HOLD_MS        (SWITCH_HOLD_MS + 200);
+
+const char* SIM_EVT_NAMES[NUM_EVT_TYPES]{"enc", "toggle", "clk+", "clk-", "reset", "leds"};
+
+struct SimCosts
+{
+  uint32_t  isr   {20};
+  uint32_t  cb    {5};
+  uint32_t  handler[NUM_EVT_TYPES]{120, 40, 150, 10, 60, 300};
+};
+
+struct ClockWave
+{
+  uint32_t  period    {125000};
+  uint32_t  width     {5000};
+  uint32_t  jitter    {0};
+  uint32_t  endPeriod {0};        // 0: no ramp
+};
+
+struct ResetWave
+{
+  uint32_t  periodMs  {0};        // 0: no resets
+  uint32_t  widthMs   {2};
+  uint32_t  offsetMs  {0};
+};
+
+struct EncTurn
+{
+  uint32_t  atMs;
+  int32_t   detents;
+  uint32_t  gapMs;
+};
+
+enum class gesture : uint8_t { CLICK, DOUBLE, HOLD };
+
+struct ToggleGesture
+{
+  uint32_t  atMs;
+  bool      up;
+  gesture   kind;
+};
+
+struct BgTask
+{
+  uint32_t  periodMs;
+  uint32_t  costUs;
+};
+
+struct SimConfig
+{
+  uint32_t                    durationMs{10000};
+  ClockWave                   clock;
+  ResetWave                   reset;
+  std::vector<EncTurn>        turns;
+  std::vector<ToggleGesture>  toggles;
+  std::vector<BgTask>         background;
+  SimCosts                    costs;
+  uint32_t                    seed{1};
+  uint8_t                     gates{0};
+  bool                        edges{true};
+};
+
+struct SimResult
+{
+  uint32_t  clocksIn  {0};
+  uint32_t  steps     {0};
+  uint32_t  dropped   {0};
+  uint32_t  maxQueue  {0};
+  uint32_t  latCount  {0};
+  uint64_t  latMin    {UINT64_MAX};
+  uint64_t  latMax    {0};
+  double    latSum    {0.0};
+  double    latSumSq  {0.0};
+
+  uint32_t  missed() const
+  {
+    return (clocksIn > steps) ? clocksIn - steps : 0;
+  }
+
+  bool keptUp(uint32_t period) const
+  {
+    return clocksIn && !missed() && !dropped && latMax < period;
+  }
+};
+
+
+// Where the events wait: no more of them than the board's queue holds,
+// and each one remembers when the edge that caused it came in
+class SimEventStore : public EventStore
+{
+public:
+  struct Entry
+  {
+    InputEvent  ev;
+    uint64_t    inputUs;
+  };
+
+  uint64_t  lastClockUs {0};
+  uint64_t  lastResetUs {0};
+  uint32_t  dropped     {0};
+  uint32_t  maxQueue    {0};
+
+  bool push(const InputEvent& ev) override
+  {
+    if (queue_.size() >= EVT_QUEUE_LEN)
+    {
+      ++dropped;
+      return false;
+    }
+
+    uint64_t inputUs(ev.micros);
+    if (ev.type == evt_type::CLOCK_RISE)
+    {
+      inputUs = lastClockUs;
+    }
+    else if (ev.type == evt_type::RESET)
+    {
+      inputUs = lastResetUs;
+    }
+    queue_.push_back({ev, inputUs});
+    maxQueue = std::max(maxQueue, (uint32_t)queue_.size());
+    return true;
+  }
+
+  bool pop(InputEvent& ev, TickType_t timeout) override
+  {
+    (void)timeout;
+    if (queue_.empty())
+    {
+      return false;
+    }
+    ev = queue_.front().ev;
+    queue_.pop_front();
+    return true;
+  }
+
+  bool peek(InputEvent& ev) override
+  {
+    if (queue_.empty())
+    {
+      return false;
+    }
+    ev = queue_.front().ev;
+    return true;
+  }
+
+  bool          empty() const { return queue_.empty(); }
+  const Entry&  front() const { return queue_.front(); }
+
+private:
+  std::deque<Entry> queue_;
+};
+
+
+class Simulation
+{
+  struct PinChange
+  {
+    uint64_t  us;
+    uint8_t   pin;
+    bool      active;
+  };
+
+  struct Edge
+  {
+    uint64_t    us;
+    bool        out;
+    const char* signal;
+    int32_t     value;
+  };
+
+  const SimConfig&      cfg_;
+  std::vector<PinChange> pins_;
+  std::vector<std::pair<uint64_t, int8_t>> detents_;
+  std::vector<Edge>     edges_;
+  SimEventStore         store_;
+  SimResult             result_;
+
+  uint64_t  loopFree_;
+
+  // What the outputs were last time we looked
+  uint16_t  cv_[NUM_DAC_CHANNELS];
+  uint16_t  intDac_;
+  uint32_t  trigFrames_;
+  uint8_t   trigHigh_;
+  uint64_t  trigOffTick_[8];
+
+  void addPulse(uint64_t atUs, uint64_t widthUs, uint8_t pin)
+  {
+    pins_.push_back({atUs,           pin, true});
+    pins_.push_back({atUs + widthUs, pin, false});
+  }
+
+  // Every input edge for the whole run, up front
+  void buildInputs()
+  {
+    uint64_t endUs((uint64_t)cfg_.durationMs * 1000);
+    std::minstd_rand jitter(cfg_.seed);
+
+    const ClockWave& clk(cfg_.clock);
+    if (clk.period)
+    {
+      uint64_t at(clk.period);
+      while (at < endUs)
+      {
+        uint32_t period(clk.period);
+        if (clk.endPeriod)
+        {
+          period += (int64_t)((int64_t)clk.endPeriod - clk.period) * (int64_t)at / (int64_t)endUs;
+        }
+        int32_t wobble(clk.jitter ? (int32_t)(jitter() % (2 * clk.jitter + 1)) - (int32_t)clk.jitter : 0);
+        uint32_t width(std::min(clk.width, period / 2));
+        addPulse(at + wobble, width, CLOCK_IN);
+        at += period;
+      }
+    }
+
+    const ResetWave& rst(cfg_.reset);
+    if (rst.periodMs)
+    {
+      for (uint64_t at(rst.offsetMs + rst.periodMs); at < cfg_.durationMs; at += rst.periodMs)
+      {
+        addPulse(at * 1000, rst.widthMs * 1000, RESET_IN);
+      }
+    }
+
+    for (const ToggleGesture& tog : cfg_.toggles)
+    {
+      uint8_t  pin(tog.up ? TOGGLE_UP : TOGGLE_DOWN);
+      uint64_t at ((uint64_t)tog.atMs * 1000);
+      switch (tog.kind)
+      {
+        case gesture::CLICK:
+          addPulse(at, SIM_CLICK_MS * 1000, pin);
+          break;
+
+        case gesture::DOUBLE:
+          addPulse(at, SIM_CLICK_MS * 1000, pin);
+          addPulse(at + (SIM_CLICK_MS + SIM_DOUBLE_GAP_MS) * 1000, SIM_CLICK_MS * 1000, pin);
+          break;
+
+        case gesture::HOLD:
+          addPulse(at, SIM_HOLD_MS * 1000, pin);
+          break;
+      }
+    }
+
+    for (const EncTurn& turn : cfg_.turns)
+    {
+      int8_t dir(turn.detents < 0 ? -1 : 1);
+      for (int32_t det(0); det < abs(turn.detents); ++det)
+      {
+        detents_.push_back({(uint64_t)(turn.atMs + det * turn.gapMs) * 1000, dir});
+      }
+    }
+
+    std::stable_sort(pins_.begin(), pins_.end(),
+                     [](const PinChange& a, const PinChange& b) { return a.us < b.us; });
+    std::stable_sort(detents_.begin(), detents_.end());
+  }
+
+  static const char* pinName(uint8_t pin)
+  {
+    switch (pin)
+    {
+      case CLOCK_IN:    return "clock";
+      case RESET_IN:    return "reset";
+      case TOGGLE_UP:   return "up";
+      case TOGGLE_DOWN: return "down";
+      default:          return "pin";
+    }
+  }
+
+  // What the ISR, the callbacks task and any background tasks take out of
+  // tick [tick]
+  uint64_t tickCost(uint64_t tick) const
+  {
+    uint64_t cost(cfg_.costs.isr + cfg_.costs.cb);
+    for (const BgTask& task : cfg_.background)
+    {
+      if (task.periodMs && tick % task.periodMs == 0)
+      {
+        cost += task.costUs;
+      }
+    }
+    return cost;
+  }
+
+  // When [work] us of loop() started at [start] gets done, with everything
+  // that preempts it along the way
+  uint64_t finishTime(uint64_t start, uint64_t work) const
+  {
+    uint64_t now(start);
+    while (true)
+    {
+      uint64_t nextTick((now / SIM_TICK_US + 1) * SIM_TICK_US);
+      if (now + work <= nextTick)
+      {
+        return now + work;
+      }
+      work -= nextTick - now;
+      now   = nextTick + tickCost(nextTick / SIM_TICK_US);
+    }
+  }
+
+  // onTimer1(): serviceIO(), which ends with EventQueue::pollSources()
+  void isr(uint64_t tick)
+  {
+    halHostSetMicros((uint32_t)(tick * SIM_TICK_US));
+    inputs.sample();
+    mode.service();
+    writeLow.service();
+    writeHigh.service();
+    inputEvents.pollSources();
+  }
+
+  // serviceRunList(): trigger pulses that are up this tick
+  void callbacks(uint64_t tick)
+  {
+    uint64_t at(tick * SIM_TICK_US + cfg_.costs.isr + cfg_.costs.cb);
+    for (uint8_t bit(0); bit < 8; ++bit)
+    {
+      if (bitRead(trigHigh_, bit) && trigOffTick_[bit] == tick)
+      {
+        bitClear(trigHigh_, bit);
+        edges_.push_back({at, true, TRIG_NAMES[bit], 0});
+      }
+    }
+  }
+
+  // loop()'s EventQueue::dispatchNext(), starting at [start]; returns when
+  // it's done
+  uint64_t dispatch(uint64_t start)
+  {
+    SimEventStore::Entry next(store_.front());
+    halHostSetMicros((uint32_t)start);
+    inputEvents.dispatchNext(0);
+    if (next.ev.type == evt_type::CLOCK_RISE)
+    {
+      ++result_.steps;
+    }
+
+    uint32_t work(cfg_.costs.handler[static_cast<uint8_t>(next.ev.type)]);
+    uint64_t done(finishTime(start, work));
+    bool     moved(collectOutputs(done, next.ev.type));
+    if (next.ev.type == evt_type::CLOCK_RISE && moved)
+    {
+      uint64_t late(done - next.inputUs);
+      ++result_.latCount;
+      result_.latMin    = std::min(result_.latMin, late);
+      result_.latMax    = std::max(result_.latMax, late);
+      result_.latSum   += late;
+      result_.latSumSq += (double)late * late;
+    }
+    return done;
+  }
+
+  // Whatever the handler for a [type] event changed goes out when it's
+  // finished. Returns true if there was a new step.
+  bool collectOutputs(uint64_t at, evt_type type)
+  {
+    static const char* CV_NAMES[NUM_DAC_CHANNELS]{"cvA", "cvB", "cvC", "cvD"};
+    for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+    {
+      uint16_t val(halHostDac(ch));
+      if (val != cv_[ch])
+      {
+        cv_[ch] = val;
+        edges_.push_back({at, true, CV_NAMES[ch], val});
+      }
+    }
+
+    uint16_t intDac(halHostDac(HAL_INT_DAC));
+    if (intDac != intDac_)
+    {
+      intDac_ = intDac;
+      edges_.push_back({at, true, "intDac", intDac});
+    }
+
+    uint32_t frames(halHostShiftCount(HAL_SR_TRIGGERS));
+    if (frames == trigFrames_)
+    {
+      return false;
+    }
+    trigFrames_ = frames;
+    uint8_t frame(halHostShiftReg(HAL_SR_TRIGGERS) & 0xFF);
+
+    // The clock fell: that frame just takes the gates down
+    if (type == evt_type::CLOCK_FALL)
+    {
+      for (uint8_t bit(0); bit < 8; ++bit)
+      {
+        if (bitRead(trigHigh_, bit) && !bitRead(frame, bit))
+        {
+          bitClear(trigHigh_, bit);
+          edges_.push_back({at, true, TRIG_NAMES[bit], 0});
+        }
+      }
+      return false;
+    }
+
+    // Every output that's on this step fires, and ends when its timed
+    // callback comes round (first tick after the trigger length is up),
+    // or for a gate, when the clock falls
+    uint64_t offTick((at + (uint64_t)ioTrigLength() * 1000 + SIM_TICK_US - 1) / SIM_TICK_US);
+    for (uint8_t bit(0); bit < 8; ++bit)
+    {
+      if (!bitRead(frame, bit))
+      {
+        continue;
+      }
+      if (!bitRead(trigHigh_, bit))
+      {
+        bitSet(trigHigh_, bit);
+        edges_.push_back({at, true, TRIG_NAMES[bit], 1});
+      }
+      trigOffTick_[bit] = bitRead(cfg_.gates, bit) ? UINT64_MAX : offTick;
+    }
+    return true;
+  }
+
+  static const char* TRIG_NAMES[8];
+
+public:
+  Simulation(const SimConfig& cfg):
+    cfg_        (cfg),
+    loopFree_   (0),
+    trigHigh_   (0)
+  {
+    memset(trigOffTick_, 0, sizeof(trigOffTick_));
+  }
+
+  const SimResult& run()
+  {
+    randomSeed(cfg_.seed);
+    halHostSetMicros(0);
+
+    // Everything idle (the inputs are all active low), then the same
+    // first reading begin() takes on the board
+    for (uint8_t pin : INPUT_PIN)
+    {
+      halHostSetPin(pin, true);
+    }
+    inputs = InputSampler();
+    inputs.begin();
+    writeLow  = SwitchButton(input_bit::TOGGLE_DOWN);
+    writeHigh = SwitchButton(input_bit::TOGGLE_UP);
+
+    // A fresh sequencer for every run (findMaxRate() does a lot of them),
+    // in performance mode the way setup leaves it
+    alan.~TuringRegister();
+    new (&alan) TuringRegister(stoch);
+    alan.restoreBanks();
+    ioHostSetGates(cfg_.gates);
+
+    mode.begin();
+    mode.cancel();
+    onEncoder(encEvnts::NUM_ENC_EVNTS);
+
+    inputEvents = EventQueue();
+    inputEvents.begin(&store_);
+
+    for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+    {
+      cv_[ch] = halHostDac(ch);
+    }
+    intDac_     = halHostDac(HAL_INT_DAC);
+    trigFrames_ = halHostShiftCount(HAL_SR_TRIGGERS);
+
+    buildInputs();
+
+    uint64_t ticks((uint64_t)cfg_.durationMs + SIM_DRAIN_MS);
+    size_t   nextPin(0);
+    size_t   nextDetent(0);
+    for (uint64_t tick(0); tick < ticks; ++tick)
+    {
+      uint64_t now(tick * SIM_TICK_US);
+
+      // The pins as they are at the tick
+      for (; nextPin < pins_.size() && pins_[nextPin].us <= now; ++nextPin)
+      {
+        const PinChange& chg(pins_[nextPin]);
+        halHostSetPin(chg.pin, !chg.active);
+        edges_.push_back({chg.us, false, pinName(chg.pin), chg.active});
+        if (chg.active && chg.pin == CLOCK_IN)
+        {
+          ++result_.clocksIn;
+          store_.lastClockUs = chg.us;
+        }
+        if (chg.active && chg.pin == RESET_IN)
+        {
+          store_.lastResetUs = chg.us;
+        }
+      }
+
+      // A detent's worth of counts on the pulse counter
+      for (; nextDetent < detents_.size() && detents_[nextDetent].first <= now; ++nextDetent)
+      {
+        halHostTurnPcnt(0, detents_[nextDetent].second * ENC_STEPS_PER_NOTCH);
+        edges_.push_back({detents_[nextDetent].first, false, "enc", detents_[nextDetent].second});
+      }
+
+      isr(tick);
+      callbacks(tick);
+
+      // loop() gets whatever's left of the tick (and carries on into the
+      // next one if it has to)
+      loopFree_ = std::max(loopFree_, now + tickCost(tick));
+      while (!store_.empty() && loopFree_ < now + SIM_TICK_US)
+      {
+        loopFree_ = dispatch(loopFree_);
+      }
+    }
+
+    result_.dropped  = store_.dropped;
+    result_.maxQueue = store_.maxQueue;
+    return result_;
+  }
+
+  void printEdges()
+  {
+    std::stable_sort(edges_.begin(), edges_.end(),
+                     [](const Edge& a, const Edge& b) { return a.us < b.us; });
+    for (const Edge& edge : edges_)
+    {
+      printf("edge,%llu,%s,%s,%d\n",
+             (unsigned long long)edge.us,
+             edge.out ? "out" : "in",
+             edge.signal,
+             edge.value);
+    }
+  }
+};
+
+const char* Simulation::TRIG_NAMES[8]{"trig0", "trig1", "trig2", "trig3",
+                                      "trig4", "trig5", "trig6", "trig7"};
+
+
+static void printSummary(const SimResult& res)
+{
+  uint32_t handled(res.latCount);
+  double   avg    (handled ? res.latSum / handled : 0.0);
+  double   sd     (handled ? sqrt(std::max(0.0, res.latSumSq / handled - avg * avg)) : 0.0);
+  printf("summary,%lu,%lu,%lu,%lu,%lu,%llu,%.0f,%llu,%llu,%.1f\n",
+         (unsigned long)res.clocksIn,
+         (unsigned long)res.steps,
+         (unsigned long)res.missed(),
+         (unsigned long)res.dropped,
+         (unsigned long)res.maxQueue,
+         (unsigned long long)(handled ? res.latMin : 0),
+         avg,
+         (unsigned long long)res.latMax,
+         (unsigned long long)(handled ? res.latMax - res.latMin : 0),
+         sd);
+}
+
+
+// Fastest clock (shortest period) it keeps up with, by bisection. Assumes
+// that if it copes with a period it copes with anything longer.
+static uint32_t findMaxRate(SimConfig cfg)
+{
+  cfg.edges           = false;
+  cfg.clock.endPeriod = 0;
+
+  auto keepsUp = [&cfg](uint32_t period)
+  {
+    cfg.clock.period = period;
+    Simulation sim(cfg);
+    return sim.run().keptUp(period);
+  };
+
+  uint32_t slow(cfg.clock.period);
+  uint32_t fast(SIM_TICK_US / 4);
+  if (!keepsUp(slow))
+  {
+    return 0;
+  }
+  while (slow - fast > 10)
+  {
+    uint32_t mid((slow + fast) / 2);
+    if (keepsUp(mid))
+    {
+      slow = mid;
+    }
+    else
+    {
+      fast = mid;
+    }
+  }
+  return slow;
+}
+
+
+static bool parseCosts(char* arg, SimCosts& costs)
+{
+  for (char* item(strtok(arg, ",")); item; item = strtok(nullptr, ","))
+  {
+    char     name[16];
+    unsigned us;
+    if (sscanf(item, "%15[^=]=%u", name, &us) != 2)
+    {
+      return false;
+    }
+
+    if (!strcmp(name, "isr"))
+    {
+      costs.isr = us;
+      continue;
+    }
+    if (!strcmp(name, "cb"))
+    {
+      costs.cb = us;
+      continue;
+    }
+
+    uint8_t type(0);
+    while (type < NUM_EVT_TYPES && strcmp(name, SIM_EVT_NAMES[type]))
+    {
+      ++type;
+    }
+    if (type == NUM_EVT_TYPES)
+    {
+      return false;
+    }
+    costs.handler[type] = us;
+  }
+  return true;
+}
+
+
+static bool parseArgs(int argc, char** argv, SimConfig& cfg, bool& search)
+{
+  for (int arg(1); arg < argc; ++arg)
+  {
+    const char* opt(argv[arg]);
+    if (!strcmp(opt, "-q"))
+    {
+      cfg.edges = false;
+      continue;
+    }
+    if (!strcmp(opt, "-x"))
+    {
+      search = true;
+      continue;
+    }
+    if (arg + 1 >= argc)
+    {
+      return false;
+    }
+
+    char* val(argv[++arg]);
+    if (!strcmp(opt, "-d"))
+    {
+      cfg.durationMs = strtoul(val, nullptr, 0);
+    }
+    else if (!strcmp(opt, "-s"))
+    {
+      cfg.seed = strtoul(val, nullptr, 0);
+    }
+    else if (!strcmp(opt, "-c"))
+    {
+      ClockWave& clk(cfg.clock);
+      if (sscanf(val, "%u:%u:%u:%u", &clk.period, &clk.width, &clk.jitter, &clk.endPeriod) < 1)
+      {
+        return false;
+      }
+    }
+    else if (!strcmp(opt, "-r"))
+    {
+      ResetWave& rst(cfg.reset);
+      if (sscanf(val, "%u:%u:%u", &rst.periodMs, &rst.widthMs, &rst.offsetMs) < 1)
+      {
+        return false;
+      }
+    }
+    else if (!strcmp(opt, "-e"))
+    {
+      EncTurn turn{0, 0, 20};
+      if (sscanf(val, "%u:%d:%u", &turn.atMs, &turn.detents, &turn.gapMs) < 2)
+      {
+        return false;
+      }
+      cfg.turns.push_back(turn);
+    }
+    else if (!strcmp(opt, "-g"))
+    {
+      ToggleGesture tog{0, true, gesture::CLICK};
+      char which[8], kind[8];
+      if (sscanf(val, "%u:%7[a-z]:%7[a-z]", &tog.atMs, which, kind) != 3)
+      {
+        return false;
+      }
+      tog.up = !strcmp(which, "up");
+      if (!strcmp(kind, "double"))
+      {
+        tog.kind = gesture::DOUBLE;
+      }
+      else if (!strcmp(kind, "hold"))
+      {
+        tog.kind = gesture::HOLD;
+      }
+      cfg.toggles.push_back(tog);
+    }
+    else if (!strcmp(opt, "-G"))
+    {
+      cfg.gates = strtoul(val, nullptr, 0);
+    }
+    else if (!strcmp(opt, "-k"))
+    {
+      if (!parseCosts(val, cfg.costs))
+      {
+        return false;
+      }
+    }
+    else if (!strcmp(opt, "-l"))
+    {
+      BgTask task{0, 0};
+      if (sscanf(val, "%u:%u", &task.periodMs, &task.costUs) != 2)
+      {
+        return false;
+      }
+      cfg.background.push_back(task);
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+int main(int argc, char** argv)
+{
+  SimConfig cfg;
+  bool      search(false);
+  if (!parseArgs(argc, argv, cfg, search))
+  {
+    fprintf(stderr, "usage: %s [-d ms] [-c us[:width[:jitter[:end]]]] [-r ms[:width[:offset]]]\n"
+                    "          [-e ms:detents[:gap]] [-g ms:up|down:click|double|hold] [-G mask]\n"
+                    "          [-k name=us,...] [-l ms:us] [-s seed] [-q] [-x]\n", argv[0]);
+    return 2;
+  }
+
+  // Mid-scale faders, and one look at the CV inputs: nothing's going to
+  // move them
+  for (uint8_t bank(0); bank < NUM_SCENES; ++bank)
+  {
+    for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+    {
+      ioHostSetFader(bank, ch, 100 * (ch + 1));
+    }
+  }
+  halHostSetAdcMv(LOOP_CTRL, 1600);
+  modMatrix.sample();
+
+  if (search)
+  {
+    uint32_t period(findMaxRate(cfg));
+    printf("maxrate,%lu,%.1f\n", (unsigned long)period, period ? 1e6 / period : 0.0);
+    return period ? 0 : 1;
+  }
+
+  Simulation sim(cfg);
+  const SimResult& res(sim.run());
+  if (cfg.edges)
+  {
+    sim.printEdges();
+  }
+  printSummary(res);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,263 @@
+#include "slew.h"
+#include "hwio.h"
+#include "dacBatch.h"
+#include "modOuts.h"
+#include <RatFuncs.h>
+#include <math.h>
+
+SlewEngine slew;
+
+// Exponential glides cover this many time constants in glideMs (so they
+// finish within 1%)
+const float SLEW_EXP_TAUS(5.0f);
+
+
+void IRAM_ATTR onSlewTimer()
+{
+  BaseType_t woken(pdFALSE);
+  vTaskNotifyGiveFromISR(slew.task(), &woken);
+  if (woken)
+  {
+    portYIELD_FROM_ISR();
+  }
+}
+
+
+void slewTask(void *param)
+{
+  SlewEngine* engine(static_cast<SlewEngine*>(param));
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    engine->tick();
+  }
+}
+
+
+static int32_t glideTicks(uint16_t glideMs)
+{
+  int32_t ticks((int32_t)glideMs * SLEW_RATE_HZ / 1000);
+  return (ticks < 1) ? 1 : ticks;
+}
+
+
+SlewEngine::SlewEngine():
+  moving_     (false),
+  lastIntDac_ (-1),
+  timer_      (nullptr),
+  taskHandle_ (NULL),
+  writeLock_  (NULL),
+  mux_        (portMUX_INITIALIZER_UNLOCKED)
+#ifdef RATDEBUG
+  , ticks_      (0)
+  , busyCycles_ (0)
+  , maxCycles_  (0)
+#endif
+{
+  memset(ch_,  0, sizeof(ch_));
+  memset(out_, 0, sizeof(out_));
+  for (uint8_t ch(0); ch < NUM_SLEW_CHANNELS; ++ch)
+  {
+    configure(ch, DEFAULT_SLEW_CONFIG);
+  }
+}
+
+
+void SlewEngine::begin()
+{
+  writeLock_ = xSemaphoreCreateMutex();
+
+  // Above loop(), below the shift register bus and timer callbacks
+  xTaskCreate
+  (
+    slewTask,
+    "slew Task",
+    2048,
+    this,
+    5,
+    &taskHandle_
+  );
+
+  // 1 MHz ticks
+  timer_ = timerBegin(SLEW_TIMER, 80, true);
+  timerAttachInterrupt(timer_, &onSlewTimer, true);
+  timerAlarmWrite(timer_, 1000000UL / SLEW_RATE_HZ, true);
+  timerAlarmEnable(timer_);
+}
+
+
+TaskHandle_t SlewEngine::task() const
+{
+  return taskHandle_;
+}
+
+
+void SlewEngine::configure(uint8_t ch, const SlewConfig& cfg)
+{
+  if (ch >= NUM_SLEW_CHANNELS)
+  {
+    return;
+  }
+
+  // Every scene switch lands here, on the downbeat; the coefficient only
+  // needs working out again if the glide time changed
+  int32_t coeff(ch_[ch].coeff);
+  if (!coeff || cfg.glideMs != ch_[ch].cfg.glideMs)
+  {
+    // Floating point is fine here; it's only the per-tick stuff that has
+    // to be quick
+    coeff = 65536.0f * (1.0f - expf(-SLEW_EXP_TAUS / glideTicks(cfg.glideMs)));
+  }
+
+  portENTER_CRITICAL(&mux_);
+  ch_[ch].cfg   = cfg;
+  ch_[ch].coeff = (coeff < 1) ? 1 : coeff;
+  portEXIT_CRITICAL(&mux_);
+}
+
+
+void SlewEngine::setTargets(const uint16_t codes[NUM_DAC_CHANNELS],
+                            uint8_t        intDac,
+                            uint8_t        shiftReg)
+{
+  bool jumped(false);
+  portENTER_CRITICAL(&mux_);
+  for (uint8_t idx(0); idx < NUM_SLEW_CHANNELS; ++idx)
+  {
+    Channel &ch(ch_[idx]);
+    ch.target = (int32_t)((idx == SLEW_INT_DAC) ? intDac : codes[idx]) << 16;
+
+    bool glide(ch.cfg.mode == glide_mode::ALWAYS
+           || (ch.cfg.mode == glide_mode::REGISTER && bitRead(shiftReg, ch.cfg.bit)));
+    if (!glide || ch.cfg.glideMs == 0 || !taskHandle_)
+    {
+      // Straight there, on this step, not the next tick
+      jumped     = true;
+      ch.pos     = ch.target;
+      ch.step    = 0;
+      out_[idx]  = ch.target >> 16;
+      continue;
+    }
+
+    ch.step = (ch.target - ch.pos) / glideTicks(ch.cfg.glideMs);
+    if (ch.step == 0 && ch.target != ch.pos)
+    {
+      ch.step = (ch.target > ch.pos) ? 1 : -1;
+    }
+    moving_ = true;
+  }
+  portEXIT_CRITICAL(&mux_);
+
+  // The gliding ones go out at wherever they've got to; the slew task
+  // takes them from here
+  if (jumped)
+  {
+    write();
+  }
+}
+
+
+void SlewEngine::tick()
+{
+#ifdef RATDEBUG
+  uint32_t start(ESP.getCycleCount());
+#endif
+
+  bool changed(false);
+  portENTER_CRITICAL(&mux_);
+  bool stillMoving(false);
+  for (uint8_t idx(0); idx < NUM_SLEW_CHANNELS; ++idx)
+  {
+    Channel &ch(ch_[idx]);
+    if (ch.pos != ch.target)
+    {
+      if (ch.cfg.curve == slew_curve::LINEAR)
+      {
+        ch.pos += ch.step;
+        if ((ch.step >= 0 && ch.pos >= ch.target)
+         || (ch.step <= 0 && ch.pos <= ch.target))
+        {
+          ch.pos = ch.target;
+        }
+      }
+      else
+      {
+        int32_t delta(((int64_t)(ch.target - ch.pos) * ch.coeff) >> 16);
+        ch.pos = (delta == 0) ? ch.target : ch.pos + delta;
+      }
+    }
+
+    out_[idx]    = (ch.pos + 0x8000) >> 16;
+    stillMoving |= (ch.pos != ch.target);
+  }
+
+  // One more write after everything lands
+  changed = moving_;
+  moving_ = stillMoving;
+  portEXIT_CRITICAL(&mux_);
+
+  if (changed)
+  {
+    write();
+  }
+
+  // The LFO runs at control rate too
+  modOuts.tick();
+
+#ifdef RATDEBUG
+  uint32_t cycles(ESP.getCycleCount() - start);
+  busyCycles_ += cycles;
+  if (cycles > maxCycles_)
+  {
+    maxCycles_ = cycles;
+  }
+
+  if (++ticks_ == SLEW_RATE_HZ)
+  {
+    uint32_t mhz(getCpuFrequencyMhz());
+    dbprintf("slew: %u ticks/s, %lu.%lu%% of a core, max %lu cycles/tick\n",
+             SLEW_RATE_HZ,
+             (unsigned long)(busyCycles_ / (mhz * 10000)),
+             (unsigned long)(busyCycles_ / (mhz * 1000) % 10),
+             (unsigned long)maxCycles_);
+    ticks_      = 0;
+    busyCycles_ = 0;
+    maxCycles_  = 0;
+  }
+#endif
+}
+
+
+// Called from the step (callbacks task) and the slew task both, so the
+// I2C transaction's done under the lock; whichever's in there, the other
+// waits (and lends it its priority). The outputs are read inside it, so
+// whoever writes last writes the latest.
+void SlewEngine::write()
+{
+  if (writeLock_)
+  {
+    xSemaphoreTake(writeLock_, portMAX_DELAY);
+  }
+
+  uint16_t out[NUM_SLEW_CHANNELS];
+  portENTER_CRITICAL(&mux_);
+  memcpy(out, out_, sizeof(out));
+  portEXIT_CRITICAL(&mux_);
+
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    dacBatch.stage(ch, out[ch]);
+  }
+  dacBatch.commit();
+
+  if (out[SLEW_INT_DAC] != lastIntDac_)
+  {
+    voltsExp.outputVoltage((uint8_t)out[SLEW_INT_DAC]);
+    lastIntDac_ = out[SLEW_INT_DAC];
+  }
+
+  if (writeLock_)
+  {
+    xSemaphoreGive(writeLock_);
+  }
+}
@@ -0,0 +1,330 @@
+#include "srBus.h"
+#include <RatFuncs.h>
+
+ShiftRegisterBus srBus;
+
+// Frame length in bits and latch pin for each device
+const uint8_t SR_FRAME_BITS[NUM_SR_DEVICES]{16, 8};
+const uint8_t SR_LATCH_PIN [NUM_SR_DEVICES]{LED_SR_CS, TRIG_SR_CS};
+
+#ifdef RATDEBUG
+const uint16_t SR_LOG_INTERVAL(4096);   // LED frames between stats dumps
+#endif
+
+
+void srBusTask(void *param)
+{
+  ShiftRegisterBus* bus(static_cast<ShiftRegisterBus*>(param));
+  while (1)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    bus->drain();
+  }
+}
+
+
+ShiftRegisterBus::ShiftRegisterBus():
+  trigMail_   {0, 0},
+  trigFull_   (false),
+  trigMux_    (portMUX_INITIALIZER_UNLOCKED),
+  ledMailbox_ (NULL),
+  taskHandle_ (NULL),
+  lastTrigSeq_(0)
+{
+  memset(devices_, 0, sizeof(devices_));
+  memset(stats_,   0, sizeof(stats_));
+}
+
+
+// How long a frame takes the old way, for comparison. The old way ended
+// with the latch going LOW then HIGH, and that rising edge on RCLK would
+// put whatever got shifted in out on the outputs. So the latch gets
+// written HIGH twice instead: the same two writes, at the same cost, with
+// no edge. The registers' outputs never change.
+void ShiftRegisterBus::measureBitBang()
+{
+  pinMode(SR_CLK,  OUTPUT);
+  pinMode(SR_DATA, OUTPUT);
+  for (uint8_t dev(0); dev < NUM_SR_DEVICES; ++dev)
+  {
+    pinMode(SR_LATCH_PIN[dev], OUTPUT);
+    digitalWrite(SR_LATCH_PIN[dev], HIGH);
+  }
+
+  for (uint8_t dev(0); dev < NUM_SR_DEVICES; ++dev)
+  {
+    uint32_t start(ESP.getCycleCount());
+    for (uint8_t byteIdx(0); byteIdx < SR_FRAME_BITS[dev] / 8; ++byteIdx)
+    {
+      shiftOut(SR_DATA, SR_CLK, MSBFIRST, 0);
+    }
+    digitalWrite(SR_LATCH_PIN[dev], HIGH);
+    digitalWrite(SR_LATCH_PIN[dev], HIGH);
+    stats_[dev].bitBangCycles = ESP.getCycleCount() - start;
+  }
+}
+
+
+// Per-bit loop vs. table lookups, over every possible LED frame
+void ShiftRegisterBus::benchRemap()
+{
+#ifdef RATDEBUG
+  volatile uint16_t sink(0);
+
+  uint32_t start(ESP.getCycleCount());
+  for (uint32_t reg(0); reg < 0x10000; ++reg)
+  {
+    sink = permuteBits<2>(reg, regMap);
+  }
+  uint32_t loopCycles(ESP.getCycleCount() - start);
+
+  start = ESP.getCycleCount();
+  for (uint32_t reg(0); reg < 0x10000; ++reg)
+  {
+    sink = LED_PERM[0][reg & 0xFF] | LED_PERM[1][reg >> 8];
+  }
+  uint32_t lutCycles(ESP.getCycleCount() - start);
+
+  (void)sink;
+  dbprintf("srBus remap: %lu cycles/frame per-bit, %lu cycles/frame table\n",
+           (unsigned long)(loopCycles >> 16),
+           (unsigned long)(lutCycles >> 16));
+#endif
+}
+
+
+void ShiftRegisterBus::begin()
+{
+  measureBitBang();
+  benchRemap();
+
+  spi_bus_config_t busCfg;
+  memset(&busCfg, 0, sizeof(busCfg));
+  busCfg.mosi_io_num     = SR_DATA;
+  busCfg.miso_io_num     = -1;
+  busCfg.sclk_io_num     = SR_CLK;
+  busCfg.quadwp_io_num   = -1;
+  busCfg.quadhd_io_num   = -1;
+  busCfg.max_transfer_sz = 4;
+
+  if (spi_bus_initialize(SPI3_HOST, &busCfg, SPI_DMA_CH_AUTO) != ESP_OK)
+  {
+    dbprintln("shift register bus failed to initialize");
+    return;
+  }
+
+  // The 595s latch on the rising edge of their CS line, which is exactly
+  // what the peripheral does at the end of a transaction
+  for (uint8_t dev(0); dev < NUM_SR_DEVICES; ++dev)
+  {
+    spi_device_interface_config_t devCfg;
+    memset(&devCfg, 0, sizeof(devCfg));
+    devCfg.mode           = 0;
+    devCfg.clock_speed_hz = SR_BUS_HZ;
+    devCfg.spics_io_num   = SR_LATCH_PIN[dev];
+    devCfg.queue_size     = 1;
+    spi_bus_add_device(SPI3_HOST, &devCfg, &devices_[dev]);
+  }
+
+  ledMailbox_ = xQueueCreate(1, sizeof(uint16_t));
+
+  // Above the callbacks task, so a trigger-off gets out as soon as it's posted
+  xTaskCreate
+  (
+    srBusTask,
+    "srBus Task",
+    2048,
+    this,
+    12,
+    &taskHandle_
+  );
+}
+
+
+void ShiftRegisterBus::post(sr_device device, uint16_t frame, uint32_t seq)
+{
+  if (!taskHandle_)
+  {
+    return;
+  }
+
+  uint32_t start(ESP.getCycleCount());
+  if (device == sr_device::TRIGGERS)
+  {
+    putTrigger({frame, seq});
+  }
+  else
+  {
+    if (uxQueueMessagesWaiting(ledMailbox_))
+    {
+      ++stats_[static_cast<uint8_t>(device)].dropped;
+    }
+    xQueueOverwrite(ledMailbox_, &frame);
+  }
+  xTaskNotifyGive(taskHandle_);
+  stats_[static_cast<uint8_t>(device)].postCycles = ESP.getCycleCount() - start;
+}
+
+
+void IRAM_ATTR ShiftRegisterBus::postFromISR(sr_device device, uint16_t frame)
+{
+  if (!taskHandle_)
+  {
+    return;
+  }
+
+  BaseType_t woken(pdFALSE);
+  if (device == sr_device::TRIGGERS)
+  {
+    putTrigger({frame, 0});
+  }
+  else
+  {
+    // Still there from last time: the bus didn't get to it in time
+    if (uxQueueMessagesWaitingFromISR(ledMailbox_))
+    {
+      ++stats_[static_cast<uint8_t>(device)].dropped;
+    }
+    xQueueOverwriteFromISR(ledMailbox_, &frame, &woken);
+  }
+  vTaskNotifyGiveFromISR(taskHandle_, &woken);
+  if (woken)
+  {
+    portYIELD_FROM_ISR();
+  }
+}
+
+
+// Latest wins, except that a sequenced frame never replaces a newer one
+// (two tasks can race to get here)
+void IRAM_ATTR ShiftRegisterBus::putTrigger(const SrFrame& trig)
+{
+  SrBusStats& st(stats_[static_cast<uint8_t>(sr_device::TRIGGERS)]);
+  portENTER_CRITICAL_SAFE(&trigMux_);
+  if (trigFull_ && trig.seq && trigMail_.seq && (int32_t)(trig.seq - trigMail_.seq) < 0)
+  {
+    ++st.stale;
+  }
+  else
+  {
+    if (trigFull_)
+    {
+      ++st.dropped;
+    }
+    trigMail_ = trig;
+    trigFull_ = true;
+  }
+  portEXIT_CRITICAL_SAFE(&trigMux_);
+}
+
+
+bool ShiftRegisterBus::takeTrigger(SrFrame& trig)
+{
+  portENTER_CRITICAL(&trigMux_);
+  bool full(trigFull_);
+  trig      = trigMail_;
+  trigFull_ = false;
+  portEXIT_CRITICAL(&trigMux_);
+  return full;
+}
+
+
+// Sends everything that's waiting, triggers first. If a trigger frame
+// shows up while an LED frame is going out, it's next.
+void ShiftRegisterBus::drain()
+{
+  SrFrame  trig;
+  uint16_t frame;
+  while (true)
+  {
+    if (takeTrigger(trig))
+    {
+      // Whoever posted this got overtaken by someone with a newer frame;
+      // sending it now would undo theirs
+      if (trig.seq && (int32_t)(trig.seq - lastTrigSeq_) <= 0)
+      {
+        ++stats_[static_cast<uint8_t>(sr_device::TRIGGERS)].stale;
+        continue;
+      }
+      if (trig.seq)
+      {
+        lastTrigSeq_ = trig.seq;
+      }
+      send(sr_device::TRIGGERS, trig.bits);
+      continue;
+    }
+
+    if (xQueueReceive(ledMailbox_, &frame, 0) == pdTRUE)
+    {
+      send(sr_device::LEDS, frame);
+      continue;
+    }
+
+    return;
+  }
+}
+
+
+void ShiftRegisterBus::send(sr_device device, uint16_t frame)
+{
+  uint8_t dev(static_cast<uint8_t>(device));
+
+  spi_transaction_t trans;
+  memset(&trans, 0, sizeof(trans));
+  trans.flags  = SPI_TRANS_USE_TXDATA;
+  trans.length = SR_FRAME_BITS[dev];
+  if (SR_FRAME_BITS[dev] > 8)
+  {
+    trans.tx_data[0] = frame >> 8;
+    trans.tx_data[1] = frame & 0xFF;
+  }
+  else
+  {
+    trans.tx_data[0] = frame & 0xFF;
+  }
+
+  // Blocks this task (not the CPU) until the transfer is done
+  uint32_t start(micros());
+  spi_device_transmit(devices_[dev], &trans);
+
+  SrBusStats &st(stats_[dev]);
+  st.lastBusMicros = micros() - start;
+  if (st.lastBusMicros > st.maxBusMicros)
+  {
+    st.maxBusMicros = st.lastBusMicros;
+  }
+  ++st.frames;
+
+#ifdef RATDEBUG
+  if (device == sr_device::LEDS && st.frames % SR_LOG_INTERVAL == 0)
+  {
+    logStats();
+  }
+#endif
+}
+
+
+const SrBusStats& ShiftRegisterBus::stats(sr_device device) const
+{
+  return stats_[static_cast<uint8_t>(device)];
+}
+
+
+void ShiftRegisterBus::logStats() const
+{
+  const char* names[NUM_SR_DEVICES]{"leds", "trig"};
+  for (uint8_t dev(0); dev < NUM_SR_DEVICES; ++dev)
+  {
+    const SrBusStats &st(stats_[dev]);
+    dbprintf("srBus %s: %lu frames (%lu dropped, %lu stale), bus %lu us (max %lu), "
+             "caller %lu cycles vs %lu bit-banged\n",
+             names[dev],
+             (unsigned long)st.frames,
+             (unsigned long)st.dropped,
+             (unsigned long)st.stale,
+             (unsigned long)st.lastBusMicros,
+             (unsigned long)st.maxBusMicros,
+             (unsigned long)st.postCycles,
+             (unsigned long)st.bitBangCycles);
+  }
+}
@@ -0,0 +1,201 @@
+#include "stepHistory.h"
+#include "TransportParams.h"
+
+// Nibble layout
+const uint8_t HIST_KIND_MASK (0x03);
+const uint8_t HIST_FORWARD   (0x04);
+const uint8_t HIST_BIT       (0x08);
+
+
+StepHistory::StepHistory():
+  head_     (0),
+  keyCount_ (0),
+  headHigh_ (0),
+  keyHigh_  (0),
+  last_     ({0, 0, DEFAULT_LENGTH_IDX, 0})
+{
+  memset(steps_, 0, sizeof(steps_));
+  begin(last_);
+}
+
+
+void StepHistory::begin(const HistState& state)
+{
+  head_     = 0;
+  keyCount_ = 0;
+  headHigh_ = 0;
+  keyHigh_  = 0;
+  last_     = state;
+  checkpoints_[0].state  = state;
+  checkpoints_[0].keyIdx = 0;
+}
+
+
+void StepHistory::push(uint8_t nibble)
+{
+  uint16_t idx(head_ % HIST_STEPS);
+  uint8_t &cell(steps_[idx >> 1]);
+  if (idx & 1)
+  {
+    cell = (cell & 0x0F) | (nibble << 4);
+  }
+  else
+  {
+    cell = (cell & 0xF0) | nibble;
+  }
+
+  ++head_;
+  if (head_ > headHigh_)
+  {
+    headHigh_ = head_;
+  }
+
+  if (head_ % HIST_CHECKPOINT_INTERVAL == 0)
+  {
+    Checkpoint &cp(checkpoints_[(head_ / HIST_CHECKPOINT_INTERVAL) % HIST_NUM_CHECKPOINTS]);
+    cp.state  = last_;
+    cp.keyIdx = keyCount_;
+  }
+}
+
+
+void StepHistory::record(uint8_t kind, bool forward, bool bit, const HistState& after)
+{
+  last_ = after;
+  push(kind | (forward ? HIST_FORWARD : 0) | (bit ? HIST_BIT : 0));
+}
+
+
+void StepHistory::recordKey(const HistState& after)
+{
+  keyframes_[keyCount_ % HIST_NUM_KEYFRAMES] = after;
+  ++keyCount_;
+  if (keyCount_ > keyHigh_)
+  {
+    keyHigh_ = keyCount_;
+  }
+  last_ = after;
+  push(HIST_KEY);
+}
+
+
+// Same shift TransportParams::iterate() does, minus the coin toss (we
+// already know which way it landed)
+void StepHistory::replay(HistState& state, uint8_t nibble, uint32_t& keyIdx) const
+{
+  uint8_t kind(nibble & HIST_KIND_MASK);
+  if (kind == HIST_KEY)
+  {
+    state = keyframes_[keyIdx % HIST_NUM_KEYFRAMES];
+    ++keyIdx;
+    return;
+  }
+
+  uint8_t len(STEP_LENGTH_VALS[state.lengthIdx]);
+  uint8_t writeIdx;
+  if (nibble & HIST_FORWARD)
+  {
+    state.reg    = (state.reg << 1) | (state.reg >> 15);
+    state.offset = (state.offset + 1) % len;
+    writeIdx     = 0;
+  }
+  else
+  {
+    state.reg    = (state.reg << 15) | (state.reg >> 1);
+    state.offset = (state.offset - 1) % len;
+    writeIdx     = 7;
+  }
+
+  if (kind == HIST_WRITE)
+  {
+    bitWrite(state.reg, writeIdx, (nibble & HIST_BIT) != 0);
+  }
+}
+
+
+uint32_t StepHistory::head() const
+{
+  return head_;
+}
+
+
+// Earliest step we can still get back to. That's limited by the step
+// buffer wrapping around, and by keyframes getting overwritten (including
+// by ones that truncate() has since thrown away).
+uint32_t StepHistory::oldest() const
+{
+  uint32_t cp(0);
+  if (headHigh_ > HIST_STEPS)
+  {
+    cp = (headHigh_ - HIST_STEPS + HIST_CHECKPOINT_INTERVAL - 1) / HIST_CHECKPOINT_INTERVAL;
+  }
+
+  uint32_t lastCp(head_ / HIST_CHECKPOINT_INTERVAL);
+  while (cp < lastCp
+      && keyHigh_ - checkpoints_[cp % HIST_NUM_CHECKPOINTS].keyIdx > HIST_NUM_KEYFRAMES)
+  {
+    ++cp;
+  }
+  return cp * HIST_CHECKPOINT_INTERVAL;
+}
+
+
+bool StepHistory::seek(uint32_t idx, HistState& state) const
+{
+  if (idx > head_ || idx < oldest())
+  {
+    return false;
+  }
+
+  if (idx == head_)
+  {
+    state = last_;
+    return true;
+  }
+
+  const Checkpoint &cp(checkpoints_[(idx / HIST_CHECKPOINT_INTERVAL) % HIST_NUM_CHECKPOINTS]);
+  state = cp.state;
+  uint32_t keyIdx(cp.keyIdx);
+
+  for (uint32_t step(idx - idx % HIST_CHECKPOINT_INTERVAL); step < idx; ++step)
+  {
+    uint16_t pos(step % HIST_STEPS);
+    uint8_t  cell(steps_[pos >> 1]);
+    replay(state, (pos & 1) ? (cell >> 4) : (cell & 0x0F), keyIdx);
+  }
+  return true;
+}
+
+
+void StepHistory::truncate(uint32_t idx)
+{
+  if (idx >= head_)
+  {
+    return;
+  }
+
+  HistState state;
+  if (!seek(idx, state))
+  {
+    begin(last_);
+    return;
+  }
+
+  // Count keyframes up to [idx] so new ones go in the right place
+  const Checkpoint &cp(checkpoints_[(idx / HIST_CHECKPOINT_INTERVAL) % HIST_NUM_CHECKPOINTS]);
+  uint32_t keyIdx(cp.keyIdx);
+  for (uint32_t step(idx - idx % HIST_CHECKPOINT_INTERVAL); step < idx; ++step)
+  {
+    uint16_t pos(step % HIST_STEPS);
+    uint8_t  cell(steps_[pos >> 1]);
+    uint8_t  nibble((pos & 1) ? (cell >> 4) : (cell & 0x0F));
+    if ((nibble & HIST_KIND_MASK) == HIST_KEY)
+    {
+      ++keyIdx;
+    }
+  }
+
+  head_     = idx;
+  keyCount_ = keyIdx;
+  last_     = state;
+}
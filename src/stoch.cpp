@@ -1,39 +1,30 @@
 #include "stoch.h"
-#include <RatFuncs.h>
 
 
-Stochasticizer::Stochasticizer(ESP32AnalogRead& extLoop,
-                               ESP32AnalogRead& extCv):
-    bitSetPending_(0),
-    bitClearPending_(0),
+Stochasticizer::Stochasticizer():
     THRESH_LOW(265.0),
     THRESH_HIGH(3125.0),
-    loop(extLoop),
-    cv(extCv)
+    loopMv_(0),
+    cvMv_(0)
 { ; }
 
 
+void Stochasticizer::latch(uint32_t loopMv, uint32_t cvMv, int32_t bias)
+{
+  int32_t prob((int32_t)loopMv + bias);
+  loopMv_ = (prob < 0) ? 0 : prob;
+  cvMv_   = cvMv;
+}
+
+
 // Coin-toss algorithm; uses knob position to determine likelihood of flipping a
 // bit or leaving it untouched
 bool Stochasticizer::stochasticize(const bool startVal) const
 {
-  if (bitSetPending_)
-  {
-    bitSetPending_ = 0;
-    return 1;
-  }
-
-  if (bitClearPending_)
-  {
-    bitClearPending_ = 0;
-    return 0;
-  }
-
-  uint32_t prob(loop.readMiliVolts());
-  uint32_t cvval(cv.readMiliVolts());
+  uint32_t prob(loopMv_);
   if (prob > THRESH_HIGH)
   {
-    if (cv.readMiliVolts() > 500)
+    if (cvMv_ > 500)
     {
       return !startVal;
     }
@@ -42,7 +33,7 @@ bool Stochasticizer::stochasticize(const bool startVal) const
 
   if (prob < THRESH_LOW)
   {
-    if (cv.readMiliVolts() > 500)
+    if (cvMv_ > 500)
     {
       return startVal;
     }
@@ -1,19 +1,27 @@
 #include "setup.h"
 #include "toggle.h"
 #include "hw_constants.h"
+#include "seqIO.h"
 
 // Bit 0 set/clear
+#ifdef INPUTS_PER_PIN
 MagicButton writeHigh(TOGGLE_UP, 1, 1);
 MagicButton writeLow(TOGGLE_DOWN, 1, 1);
+#else
+SwitchButton writeHigh(input_bit::TOGGLE_UP);
+SwitchButton writeLow(input_bit::TOGGLE_DOWN);
+#endif
 
 toggle_cmd updateToggle()
+{
+  return toggleCommand(writeLow.readAndFree(), writeHigh.readAndFree());
+}
+
+
+toggle_cmd toggleCommand(ButtonState low, ButtonState high)
 {
   // Double-click to change fader octave range (1 to 3 octaves)
-  ButtonState clickies[]
-  {
-    writeLow.readAndFree(),
-    writeHigh.readAndFree()
-  };
+  ButtonState clickies[]{low, high};
 
   if (clickies[0] == ButtonState::DoubleClicked)
   {
@@ -45,3 +53,40 @@ toggle_cmd updateToggle()
 
   return toggle_cmd::NO;
 }
+
+
+void onToggle(ButtonState low, ButtonState high)
+{
+  onToggleCommand(toggleCommand(low, high));
+}
+
+
+void onToggleCommand(toggle_cmd cmd)
+{
+  switch(cmd)
+  {
+    case toggle_cmd::LESS_OCTAVES:
+      ioSetRange(ioRange() - 1);
+      break;
+
+    case toggle_cmd::MORE_OCTAVES:
+      ioSetRange(ioRange() + 1);
+      break;
+
+    case toggle_cmd::CLEAR_BIT:
+      alan.clearBit();
+      break;
+
+    case toggle_cmd::SET_BIT:
+      alan.setBit();
+      break;
+
+    case toggle_cmd::EXIT:
+      mode.cancel();
+      break;
+
+    case toggle_cmd::NO:
+    default:
+      break;
+  }
+}
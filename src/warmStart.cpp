@@ -0,0 +1,201 @@
+#include "warmStart.h"
+#include <RatFuncs.h>
+#include <esp_system.h>
+
+const uint32_t WARM_MAGIC(0x54AC0DE5);
+
+// One odd weight per field, so swapped or shifted values don't cancel out
+const uint32_t W_REG      (0x9E3779B1);
+const uint32_t W_OFFSET   (0x85EBCA77);
+const uint32_t W_LENGTH   (0xC2B2AE3D);
+const uint32_t W_BANK     (0x27D4EB2F);
+const uint32_t W_NEXT     (0x165667B1);
+const uint32_t W_FADERS   (0xD3A2646D);
+const uint32_t W_FLAGS    (0xFD7046C5);
+
+// Not touched by the startup code, so whatever was here before the reset
+// is still here after it
+RTC_NOINIT_ATTR WarmSnapshot rtcSnap;
+
+WarmStart warmStart;
+
+
+static uint32_t checksumOf(const WarmSnapshot& snap)
+{
+  return WARM_MAGIC
+       + W_REG    * snap.reg
+       + W_OFFSET * (uint8_t)snap.offset
+       + W_LENGTH * snap.lengthIdx
+       + W_BANK   * snap.bank
+       + W_NEXT   * snap.nextBank
+       + W_FADERS * snap.faderBank
+       + W_FLAGS  * snap.flags;
+}
+
+
+WarmStart::WarmStart():
+  warm_           (false),
+  firstStepLogged_(false),
+  bootMicros_     (0)
+{ ; }
+
+
+bool WarmStart::begin(WarmSnapshot& snap)
+{
+  bootMicros_ = micros();
+
+  // Only things that weren't the user's idea count as a reason to resume.
+  // ESP_RST_SW is esp_restart(), i.e. somebody meant it: start fresh.
+  switch (esp_reset_reason())
+  {
+    case ESP_RST_BROWNOUT:
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+      warm_ = (rtcSnap.magic == WARM_MAGIC)
+           && (rtcSnap.check == checksumOf(rtcSnap));
+      break;
+
+    default:
+      warm_ = false;
+      break;
+  }
+
+  if (warm_)
+  {
+    snap = rtcSnap;
+    dbprintf("warm start: bank %u step %d\n", snap.bank, snap.offset);
+    return true;
+  }
+
+  rtcSnap.magic     = WARM_MAGIC;
+  rtcSnap.reg       = 0;
+  rtcSnap.offset    = 0;
+  rtcSnap.lengthIdx = 0;
+  rtcSnap.bank      = 0;
+  rtcSnap.nextBank  = 0;
+  rtcSnap.faderBank = 0;
+  rtcSnap.flags     = 0;
+  rtcSnap.check     = checksumOf(rtcSnap);
+  return false;
+}
+
+
+bool WarmStart::isWarm() const
+{
+  return warm_;
+}
+
+
+// Field has already been written; fix up the checksum to match
+void WarmStart::patch(uint32_t weight, uint32_t oldVal, uint32_t newVal)
+{
+  rtcSnap.check += weight * (newVal - oldVal);
+}
+
+
+void WarmStart::setReg(uint16_t reg)
+{
+  uint16_t old(rtcSnap.reg);
+  if (old == reg)
+  {
+    return;
+  }
+  rtcSnap.reg = reg;
+  patch(W_REG, old, reg);
+}
+
+
+void WarmStart::setOffset(int8_t offset)
+{
+  int8_t old(rtcSnap.offset);
+  if (old == offset)
+  {
+    return;
+  }
+  rtcSnap.offset = offset;
+  patch(W_OFFSET, (uint8_t)old, (uint8_t)offset);
+}
+
+
+void WarmStart::setLengthIdx(uint8_t idx)
+{
+  uint8_t old(rtcSnap.lengthIdx);
+  if (old == idx)
+  {
+    return;
+  }
+  rtcSnap.lengthIdx = idx;
+  patch(W_LENGTH, old, idx);
+}
+
+
+void WarmStart::setBank(uint8_t bank)
+{
+  uint8_t old(rtcSnap.bank);
+  if (old == bank)
+  {
+    return;
+  }
+  rtcSnap.bank = bank;
+  patch(W_BANK, old, bank);
+}
+
+
+void WarmStart::setNextBank(uint8_t bank)
+{
+  uint8_t old(rtcSnap.nextBank);
+  if (old == bank)
+  {
+    return;
+  }
+  rtcSnap.nextBank = bank;
+  patch(W_NEXT, old, bank);
+}
+
+
+void WarmStart::setFaderBank(uint8_t bank)
+{
+  uint8_t old(rtcSnap.faderBank);
+  if (old == bank)
+  {
+    return;
+  }
+  rtcSnap.faderBank = bank;
+  patch(W_FADERS, old, bank);
+}
+
+
+void WarmStart::setFlags(uint8_t flags)
+{
+  uint8_t old(rtcSnap.flags);
+  if (old == flags)
+  {
+    return;
+  }
+  rtcSnap.flags = flags;
+  patch(W_FLAGS, old, flags);
+}
+
+
+void WarmStart::ready()
+{
+  dbprintf("%s start: ready %lu us after boot (setup took %lu us)\n",
+           warm_ ? "warm" : "cold",
+           (unsigned long)micros(),
+           (unsigned long)(micros() - bootMicros_));
+}
+
+
+void WarmStart::firstStep()
+{
+  if (firstStepLogged_)
+  {
+    return;
+  }
+  firstStepLogged_ = true;
+  dbprintf("%s start: first step %lu us after boot\n",
+           warm_ ? "warm" : "cold",
+           (unsigned long)micros());
+}
@@ -0,0 +1,165 @@
+// ------------------------------------------------------------------------
+// test_calibration
+//
+// The DAC calibration tables, built from no measured points (the nominal
+// scale), one (offset), two (offset and gain) and several (piecewise),
+// and the points making it through save() and load() on the host's
+// file-backed NVS, into a directory that isn't there yet.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include <filesystem>
+#include <string>
+#include <unistd.h>
+#include "calibration.h"
+
+static std::string dir;
+static char        where[64];
+
+
+void setUp()
+{
+  char tmpl[] = "/tmp/tmoc_cal_XXXXXX";
+  dir = mkdtemp(tmpl);
+  setenv("TMOC_NVS_DIR", (dir + "/not/there/yet").c_str(), 1);
+}
+
+
+void tearDown()
+{
+  std::filesystem::remove_all(dir);
+}
+
+
+// Code for [volts] whole volts on channel [ch]
+static uint16_t codeAt(const DacCalibration& cal, uint8_t ch, uint8_t volts)
+{
+  return cal.code(ch, volts * CAL_NOTES_PER_POINT);
+}
+
+
+void test_no_points_is_nominal()
+{
+  DacCalibration cal;
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    TEST_ASSERT_EQUAL_UINT8(0, cal.validMask(ch));
+    TEST_ASSERT_EQUAL_UINT16(0,                                codeAt(cal, ch, 0));
+    TEST_ASSERT_EQUAL_UINT16(DAC_NOMINAL_CODES_PER_OCTAVE,     codeAt(cal, ch, 1));
+    TEST_ASSERT_EQUAL_UINT16(3 * DAC_NOMINAL_CODES_PER_OCTAVE, codeAt(cal, ch, 3));
+    TEST_ASSERT_EQUAL_UINT16(DAC_MAX_CODE,                     cal.code(ch, CAL_NUM_NOTES - 1));
+    TEST_ASSERT_EQUAL_UINT16(DAC_MAX_CODE,                     cal.code(ch, 1000));
+  }
+}
+
+
+// One point: that offset, nominal gain either side of it
+void test_one_point()
+{
+  DacCalibration cal;
+  cal.setPoint(1, 1, 900);
+  cal.rebuild(1);
+  TEST_ASSERT_EQUAL_UINT16(900 - DAC_NOMINAL_CODES_PER_OCTAVE, codeAt(cal, 1, 0));
+  TEST_ASSERT_EQUAL_UINT16(900,                                codeAt(cal, 1, 1));
+  TEST_ASSERT_EQUAL_UINT16(900 + DAC_NOMINAL_CODES_PER_OCTAVE, codeAt(cal, 1, 2));
+
+  // ...and nobody else's table moved
+  TEST_ASSERT_EQUAL_UINT16(DAC_NOMINAL_CODES_PER_OCTAVE, codeAt(cal, 0, 1));
+}
+
+
+// Two points: a straight line through them, carried on past both ends,
+// rounded to the nearest code in between
+void test_two_points()
+{
+  DacCalibration cal;
+  cal.setPoint(2, 0, 100);
+  cal.setPoint(2, 2, 1800);
+  cal.rebuild(2);
+  TEST_ASSERT_EQUAL_UINT16(100,  codeAt(cal, 2, 0));
+  TEST_ASSERT_EQUAL_UINT16(950,  codeAt(cal, 2, 1));
+  TEST_ASSERT_EQUAL_UINT16(1800, codeAt(cal, 2, 2));
+  TEST_ASSERT_EQUAL_UINT16(2650, codeAt(cal, 2, 3));
+  TEST_ASSERT_EQUAL_UINT16(171,  cal.code(2, 1));     // 100 + 70.8
+}
+
+
+// More than two: piecewise, each octave on its own segment, the last one
+// carried on to the top
+void test_many_points()
+{
+  DacCalibration cal;
+  const uint16_t codes[]{0, 800, 1700, 2500};
+  for (uint8_t pt(0); pt < 4; ++pt)
+  {
+    cal.setPoint(3, pt, codes[pt]);
+  }
+  cal.rebuild(3);
+
+  for (uint8_t pt(0); pt < 4; ++pt)
+  {
+    snprintf(where, sizeof(where), "point %u", pt);
+    TEST_ASSERT_EQUAL_UINT16_MESSAGE(codes[pt], codeAt(cal, 3, pt), where);
+  }
+  TEST_ASSERT_EQUAL_UINT16(400,  cal.code(3, 6));
+  TEST_ASSERT_EQUAL_UINT16(1250, cal.code(3, 18));
+  TEST_ASSERT_EQUAL_UINT16(2100, cal.code(3, 30));
+  TEST_ASSERT_EQUAL_UINT16(3300, codeAt(cal, 3, 4));
+
+  // Forgetting one joins up its neighbours
+  cal.clearPoint(3, 1);
+  cal.rebuild(3);
+  TEST_ASSERT_EQUAL_UINT16(850, codeAt(cal, 3, 1));
+}
+
+
+void test_save_and_load()
+{
+  DacCalibration saved;
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    for (uint8_t pt(0); pt <= ch; ++pt)
+    {
+      saved.setPoint(ch, pt * 2, 50 * ch + 1600 * pt);
+    }
+    saved.rebuild(ch);
+  }
+  TEST_ASSERT_TRUE_MESSAGE(saved.save(), "save() failed");
+
+  DacCalibration loaded;
+  loaded.load();
+  for (uint8_t ch(0); ch < NUM_DAC_CHANNELS; ++ch)
+  {
+    snprintf(where, sizeof(where), "channel %u", ch);
+    TEST_ASSERT_EQUAL_HEX8_MESSAGE(saved.validMask(ch), loaded.validMask(ch), where);
+    for (uint8_t note(0); note < CAL_NUM_NOTES; ++note)
+    {
+      snprintf(where, sizeof(where), "channel %u, note %u", ch, note);
+      TEST_ASSERT_EQUAL_UINT16_MESSAGE(saved.code(ch, note), loaded.code(ch, note), where);
+    }
+  }
+}
+
+
+// Nothing saved yet: loading leaves the nominal tables alone
+void test_load_nothing()
+{
+  DacCalibration loaded;
+  loaded.load();
+  TEST_ASSERT_EQUAL_UINT8(0, loaded.validMask(0));
+  TEST_ASSERT_EQUAL_UINT16(DAC_NOMINAL_CODES_PER_OCTAVE, codeAt(loaded, 0, 1));
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_no_points_is_nominal);
+  RUN_TEST(test_one_point);
+  RUN_TEST(test_two_points);
+  RUN_TEST(test_many_points);
+  RUN_TEST(test_save_and_load);
+  RUN_TEST(test_load_nothing);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+// ------------------------------------------------------------------------
+// test_history
+//
+// Plays a few hundred clocks with CV A routed to the loop length, so the
+// mod matrix keeps changing it under the sequencer, then scrubs back
+// through the whole lot a step at a time. Every step the history rebuilds
+// has to match what was live on that step: register, step and length.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include "TuringRegister.h"
+#include "seqIO.h"
+#include "hal.h"
+
+const uint16_t NUM_CLOCKS    (300);
+const uint8_t  CV_HOLD_STEPS (23);     // Steps between CV A changes; no multiple of any length
+
+static Stochasticizer stoch;
+static TuringRegister alan(stoch);
+static SeqSnapshot    live[NUM_CLOCKS + 1];
+static char           where[64];
+
+
+void setUp()
+{
+  // LOOP halfway: a real coin toss, so plenty of bits get written
+  randomSeed(1);
+  halHostSetAdcMv(LOOP_CTRL, 1600);
+  halHostSetAdcMv(CV_IN_A, 0);
+  modMatrix.sample();
+}
+
+
+void tearDown()
+{
+  modMatrix.clearRoutes();
+}
+
+
+static void assertSameStep(const SeqSnapshot& expect, const SeqSnapshot& got)
+{
+  TEST_ASSERT_EQUAL_HEX16_MESSAGE(expect.reg,    got.reg,    where);
+  TEST_ASSERT_EQUAL_INT8_MESSAGE (expect.step,   got.step,   where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(expect.length, got.length, where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(expect.bank,   got.bank,   where);
+}
+
+
+void test_scrub_back_across_modulated_lengths()
+{
+  alan.restoreBanks();
+
+  // All the way down to all the way up, whatever the scene's length is
+  int16_t span(NUM_STEP_LENGTHS - 1);
+  TEST_ASSERT_EQUAL_INT8(0, modMatrix.addRoute({mod_src::CV_A, mod_dest::LOOP_LENGTH, (int16_t)(2 * span), (int16_t)-span}));
+
+  const uint16_t cvMv[]{0, 3300, 1200, 2500, 600, 1900};
+  uint8_t        lengthChanges(0);
+
+  live[0] = alan.snapshot();
+  for (uint16_t clock(1); clock <= NUM_CLOCKS; ++clock)
+  {
+    if (clock % CV_HOLD_STEPS == 0)
+    {
+      halHostSetAdcMv(CV_IN_A, cvMv[(clock / CV_HOLD_STEPS) % (sizeof(cvMv) / sizeof(cvMv[0]))]);
+      modMatrix.sample();
+    }
+    alan.iterate(1);
+    live[clock] = alan.snapshot();
+    lengthChanges += (live[clock].length != live[clock - 1].length);
+  }
+  TEST_ASSERT_TRUE_MESSAGE(lengthChanges > 4, "the route hardly changed the length");
+
+  for (uint16_t clock(NUM_CLOCKS); clock > 0; --clock)
+  {
+    alan.scrub(-1);
+    snprintf(where, sizeof(where), "scrubbed back to clock %u", clock - 1);
+    assertSameStep(live[clock - 1], alan.snapshot());
+  }
+
+  // ...and forward again to where it left off
+  for (uint16_t clock(1); clock <= NUM_CLOCKS; ++clock)
+  {
+    alan.scrub(1);
+    snprintf(where, sizeof(where), "scrubbed forward to clock %u", clock);
+    assertSameStep(live[clock], alan.snapshot());
+  }
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_scrub_back_across_modulated_lengths);
+  return UNITY_END();
+}
@@ -0,0 +1,234 @@
+// ------------------------------------------------------------------------
+// test_journal
+//
+// Power-cut fuzzing for the flash journal, on the host's file-backed
+// "flash". Over and over: mount, check that everything that was written
+// is still there, then write a random run of records (with the odd early
+// sector erase thrown in) until the power gets cut at a random point,
+// partway through a slot write or a sector erase.
+//
+// A record append() said was written has to survive every cut after it.
+// The one that was being written when the power went comes back as
+// either its old or its new value, never anything else. Everything
+// that was never written stays unwritten.
+//
+// Also, a scene save whose write fails has to stay queued for the pattern
+// store's next go, not get dropped.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include "journal.h"
+#include "patternStore.h"
+
+const uint8_t  FUZZ_KEYS        (40);
+const uint8_t  FUZZ_LEN         (24);
+const uint16_t FUZZ_POWER_CUTS  (3000);
+const uint16_t FUZZ_MAX_OPS     (300);    // Longest run between power cuts
+const uint8_t  FUZZ_HOT_KEYS    (4);      // Most writes go to these...
+const uint8_t  FUZZ_COLD_PCT    (5);      // ...and the rest sit in old sectors
+
+static std::string dir;
+static uint32_t    rng(1);
+
+
+static uint32_t nextRandom()
+{
+  rng = rng * 1664525UL + 1013904223UL;
+  return rng >> 8;
+}
+
+
+// Like saving scenes: a few get saved over and over, most hardly ever, so
+// their records have to keep getting moved out of the way of the erases
+static uint8_t pickKey()
+{
+  if (nextRandom() % 100 < FUZZ_COLD_PCT)
+  {
+    return nextRandom() % FUZZ_KEYS;
+  }
+  return nextRandom() % FUZZ_HOT_KEYS;
+}
+
+
+// What [key] holds after its [version]th write (0: never written)
+static void fill(uint8_t key, uint32_t version, uint8_t buf[FUZZ_LEN])
+{
+  for (uint8_t idx(0); idx < FUZZ_LEN; ++idx)
+  {
+    buf[idx] = (uint8_t)(key * 37 + version * 11 + idx * 3);
+  }
+  memcpy(buf, &version, sizeof(version));
+  buf[sizeof(version)] = key;
+}
+
+
+void setUp()
+{
+  char tmpl[] = "/tmp/tmoc_journal_XXXXXX";
+  dir = mkdtemp(tmpl);
+  setenv("TMOC_NVS_DIR", dir.c_str(), 1);
+  rng = 1;
+  journalHostCutPower(0, 1);
+}
+
+
+void tearDown()
+{
+  unlink((dir + "/journal.bin").c_str());
+  rmdir(dir.c_str());
+}
+
+
+// Everything in [versions] is what's in the journal. [inFlight] (if it's
+// a key) might have made it to [inFlightVersion] instead; whichever it
+// did, [versions] gets updated to match.
+static void checkAll(FlashJournal& journal, uint32_t versions[FUZZ_KEYS],
+                     int16_t inFlight, uint32_t inFlightVersion, uint16_t cut)
+{
+  char where[64];
+  for (uint8_t key(0); key < FUZZ_KEYS; ++key)
+  {
+    uint8_t buf[FUZZ_LEN];
+    uint8_t expect[FUZZ_LEN];
+    bool    found(journal.read(key, buf, FUZZ_LEN));
+    snprintf(where, sizeof(where), "power cut %u, key %u", cut, key);
+
+    if (key == inFlight)
+    {
+      uint32_t version(0);
+      if (found)
+      {
+        memcpy(&version, buf, sizeof(version));
+      }
+      TEST_ASSERT_TRUE_MESSAGE(version == versions[key] || version == inFlightVersion, where);
+      versions[key] = version;
+    }
+
+    if (!versions[key])
+    {
+      TEST_ASSERT_FALSE_MESSAGE(found, where);
+      continue;
+    }
+
+    TEST_ASSERT_TRUE_MESSAGE(found, where);
+    fill(key, versions[key], expect);
+    TEST_ASSERT_TRUE_MESSAGE(!memcmp(buf, expect, FUZZ_LEN), where);
+  }
+}
+
+
+void test_power_cuts()
+{
+  uint32_t versions[FUZZ_KEYS]{};
+  uint32_t nextVersion(1);
+  int16_t  inFlight(-1);
+  uint32_t inFlightVersion(0);
+  uint32_t appends(0);
+
+  for (uint16_t cut(0); cut < FUZZ_POWER_CUTS; ++cut)
+  {
+    FlashJournal journal;
+    TEST_ASSERT_TRUE_MESSAGE(journal.mount(), "mount failed");
+    checkAll(journal, versions, inFlight, inFlightVersion, cut);
+
+    journalHostCutPower(1 + nextRandom() % FUZZ_MAX_OPS, nextRandom());
+    inFlight = -1;
+    while (true)
+    {
+      if (nextRandom() % 16 == 0)
+      {
+        journal.prepareSpare();
+      }
+
+      uint8_t key(pickKey());
+      uint8_t buf[FUZZ_LEN];
+      fill(key, nextVersion, buf);
+      if (!journal.append(key, buf, FUZZ_LEN))
+      {
+        // That's the power gone
+        inFlight        = key;
+        inFlightVersion = nextVersion++;
+        break;
+      }
+      versions[key] = nextVersion++;
+      ++appends;
+    }
+  }
+
+  // Make sure that actually went round the journal plenty of times
+  TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(20 * JOURNAL_NUM_SECTORS * JOURNAL_SLOTS_PER_SECTOR,
+                                          appends, "not enough writes to wrap the journal");
+}
+
+
+// No power cuts: whatever was written last comes back after a remount,
+// with or without sectors being erased ahead of time
+void test_remount()
+{
+  for (uint8_t early(0); early < 2; ++early)
+  {
+    uint32_t versions[FUZZ_KEYS]{};
+    {
+      FlashJournal journal;
+      TEST_ASSERT_TRUE(journal.mount());
+      for (uint32_t version(1); version < 5000; ++version)
+      {
+        uint8_t key(pickKey());
+        uint8_t buf[FUZZ_LEN];
+        fill(key, version, buf);
+        TEST_ASSERT_TRUE(journal.append(key, buf, FUZZ_LEN));
+        versions[key] = version;
+        if (early)
+        {
+          journal.prepareSpare();
+        }
+      }
+    }
+
+    FlashJournal journal;
+    TEST_ASSERT_TRUE(journal.mount());
+    checkAll(journal, versions, -1, 0, 0);
+    unlink((dir + "/journal.bin").c_str());
+  }
+}
+
+
+// Two scenes saved, and the first write turned down. Both have to make it
+// to flash by the time the store's had another go.
+void test_failed_save_retried()
+{
+  PatternStore store;
+  store.begin();
+
+  SceneRecord one{}, three{};
+  one.scene.reg   = 0x1111;
+  three.scene.reg = 0x3333;
+
+  journalHostFailWrites(1);
+  store.save(1, one);
+  store.save(3, three);
+  store.commitPending();
+  store.commitPending();
+
+  FlashJournal journal;
+  TEST_ASSERT_TRUE(journal.mount());
+  SceneRecord rec;
+  TEST_ASSERT_TRUE_MESSAGE(journal.read(1, &rec, sizeof(rec)), "scene 1 never written");
+  TEST_ASSERT_EQUAL_HEX16(one.scene.reg, rec.scene.reg);
+  TEST_ASSERT_TRUE_MESSAGE(journal.read(3, &rec, sizeof(rec)), "scene 3 never written");
+  TEST_ASSERT_EQUAL_HEX16(three.scene.reg, rec.scene.reg);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_remount);
+  RUN_TEST(test_power_cuts);
+  RUN_TEST(test_failed_save_retried);
+  return UNITY_END();
+}
@@ -0,0 +1,126 @@
+// ------------------------------------------------------------------------
+// test_modectrl
+//
+// The encoder end to end on the host: counts on the (stand-in) pulse
+// counter and the button pin through InputSampler, PcntEncoder and
+// ModeControl, one millisecond tick at a time the way the timer ISR
+// drives them on the board.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include "modeCtrl.h"
+#include "inputs.h"
+#include "hal.h"
+
+// At file scope, so it starts out zeroed like the board's
+static ModeControl ctl;
+
+
+// [ms] timer ticks: sample the pins, then service the encoder
+static void tick(uint16_t ms)
+{
+  for (uint16_t n(0); n < ms; ++n)
+  {
+    halHostAdvance(1000);
+    inputs.sample();
+    ctl.service();
+  }
+}
+
+
+static void setButton(bool down)
+{
+  halHostSetPin(ENC_SW, ENC_ACTIVE_LOW ? !down : down);
+}
+
+
+void setUp()
+{
+  for (uint8_t pin : INPUT_PIN)
+  {
+    halHostSetPin(pin, true);
+  }
+  inputs = InputSampler();
+  inputs.begin();
+  ctl.begin();
+
+  // Nothing left over from the last test
+  tick(ENC_DOUBLECLICK_MS + ENC_SERVICE_MS);
+  while (ctl.pollEncoder() != encEvnts::NUM_ENC_EVNTS)
+  {
+    ;
+  }
+  ctl.cancel();
+  ctl.handle(encEvnts::NUM_ENC_EVNTS);
+}
+
+
+void tearDown()
+{ ; }
+
+
+void test_turns()
+{
+  halHostTurnPcnt(0, 3 * ENC_STEPS_PER_NOTCH);
+  tick(ENC_SERVICE_MS);
+  for (uint8_t detent(0); detent < 3; ++detent)
+  {
+    encEvnts evt(ctl.pollEncoder());
+    TEST_ASSERT_TRUE(evt == encEvnts::Right);
+    ModeCommand cmd(ctl.handle(evt));
+    TEST_ASSERT_TRUE(cmd.cmd == command_enum::STEP);
+    TEST_ASSERT_EQUAL_INT(1, cmd.val);
+  }
+  TEST_ASSERT_TRUE(ctl.pollEncoder() == encEvnts::NUM_ENC_EVNTS);
+
+  halHostTurnPcnt(0, -ENC_STEPS_PER_NOTCH);
+  tick(ENC_SERVICE_MS);
+  TEST_ASSERT_TRUE(ctl.pollEncoder() == encEvnts::Left);
+}
+
+
+void test_hold_and_click()
+{
+  // Hold: into the save slot picker...
+  setButton(true);
+  tick(ENC_HOLD_MS + 2 * ENC_SERVICE_MS + INPUT_DEBOUNCE_TICKS);
+  TEST_ASSERT_TRUE(ctl.pollEncoder() == encEvnts::Press);
+  encEvnts evt(ctl.pollEncoder());
+  TEST_ASSERT_TRUE(evt == encEvnts::Hold);
+  TEST_ASSERT_TRUE(ctl.handle(evt).cmd == command_enum::CHANGEMODE);
+  TEST_ASSERT_TRUE(ctl.currentMode() == mode_type::PATTERN_SAVE_MODE);
+  setButton(false);
+  tick(ENC_DOUBLECLICK_MS + 2 * ENC_SERVICE_MS + INPUT_DEBOUNCE_TICKS);
+  TEST_ASSERT_TRUE(ctl.pollEncoder() == encEvnts::NUM_ENC_EVNTS);
+
+  // ...and holding again saves to the slot it's on
+  setButton(true);
+  tick(ENC_HOLD_MS + 2 * ENC_SERVICE_MS + INPUT_DEBOUNCE_TICKS);
+  ctl.pollEncoder();
+  ModeCommand cmd(ctl.handle(ctl.pollEncoder()));
+  TEST_ASSERT_TRUE(cmd.cmd == command_enum::SAVE);
+  TEST_ASSERT_TRUE(ctl.performing());
+  setButton(false);
+  tick(ENC_DOUBLECLICK_MS + 2 * ENC_SERVICE_MS + INPUT_DEBOUNCE_TICKS);
+
+  // A short press is a Click once the double-click window's up
+  setButton(true);
+  tick(50);
+  setButton(false);
+  tick(ENC_DOUBLECLICK_MS + 2 * ENC_SERVICE_MS + INPUT_DEBOUNCE_TICKS);
+  TEST_ASSERT_TRUE(ctl.pollEncoder() == encEvnts::Press);
+  evt = ctl.pollEncoder();
+  TEST_ASSERT_TRUE(evt == encEvnts::Click);
+  ctl.handle(evt);
+  TEST_ASSERT_TRUE(ctl.currentMode() == mode_type::CHANGE_LENGTH_MODE);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_turns);
+  RUN_TEST(test_hold_and_click);
+  return UNITY_END();
+}
@@ -0,0 +1,97 @@
+// ------------------------------------------------------------------------
+// test_modouts
+//
+// The PWM mod outputs' arithmetic (modDuty.h): values to duty cycles,
+// rounded to nearest and clamped at full scale, and the step brought
+// round to a position in the loop, backwards steps included.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include "modDuty.h"
+#include "seqState.h"
+
+static char where[64];
+
+
+void setUp()
+{ ; }
+
+
+void tearDown()
+{ ; }
+
+
+// Every value of the scales the outputs actually use (bit count, byte,
+// loop position) comes out within half a step of the exact duty
+void test_duty_rounds_to_nearest()
+{
+  const uint32_t scales[]{1, 3, 15, 16, 255};
+  for (uint32_t fullScale: scales)
+  {
+    for (uint32_t val(0); val <= fullScale; ++val)
+    {
+      double   exact((double)val * MOD_DUTY_MAX / fullScale);
+      uint16_t duty (modDuty(val, fullScale));
+      snprintf(where, sizeof(where), "%lu of %lu", (unsigned long)val, (unsigned long)fullScale);
+      TEST_ASSERT_TRUE_MESSAGE(duty >= exact - 0.5 && duty <= exact + 0.5, where);
+    }
+  }
+
+  TEST_ASSERT_EQUAL_UINT16(0,    modDuty(0, 16));
+  TEST_ASSERT_EQUAL_UINT16(2048, modDuty(8, 16));
+  TEST_ASSERT_EQUAL_UINT16(256,  modDuty(1, 16));     // 255.9: up, not truncated
+  TEST_ASSERT_EQUAL_UINT16(16,   modDuty(1, 255));    // 16.06
+}
+
+
+void test_duty_clamps()
+{
+  TEST_ASSERT_EQUAL_UINT16(MOD_DUTY_MAX, modDuty(16, 16));
+  TEST_ASSERT_EQUAL_UINT16(MOD_DUTY_MAX, modDuty(99, 16));
+  TEST_ASSERT_EQUAL_UINT16(MOD_DUTY_MAX, modDuty(255, 255));
+  TEST_ASSERT_EQUAL_UINT16(MOD_DUTY_MAX, modDuty(UINT32_MAX, 255));
+}
+
+
+// Nothing to scale against: off, whatever the value
+void test_duty_zero_length()
+{
+  TEST_ASSERT_EQUAL_UINT16(0, modDuty(0, 0));
+  TEST_ASSERT_EQUAL_UINT16(0, modDuty(1, 0));
+  TEST_ASSERT_EQUAL_UINT16(0, modDuty(UINT32_MAX, 0));
+  TEST_ASSERT_EQUAL_INT8(-3, modLoopStep(-3, 0));
+  TEST_ASSERT_EQUAL_INT8(5,  modLoopStep(5, 0));
+}
+
+
+// -1 is the last step, -length the first, for every loop length; steps
+// that are already in range stay put
+void test_loop_step_wraps()
+{
+  for (uint8_t idx(0); idx < NUM_STEP_LENGTHS; ++idx)
+  {
+    int8_t len(STEP_LENGTH_VALS[idx]);
+    for (int8_t back(1); back <= len; ++back)
+    {
+      snprintf(where, sizeof(where), "length %d, step %d", len, -back);
+      TEST_ASSERT_EQUAL_INT8_MESSAGE(len - back, modLoopStep(-back, len), where);
+    }
+    for (int8_t step(0); step < len; ++step)
+    {
+      snprintf(where, sizeof(where), "length %d, step %d", len, step);
+      TEST_ASSERT_EQUAL_INT8_MESSAGE(step, modLoopStep(step, len), where);
+    }
+  }
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_duty_rounds_to_nearest);
+  RUN_TEST(test_duty_clamps);
+  RUN_TEST(test_duty_zero_length);
+  RUN_TEST(test_loop_step_wraps);
+  return UNITY_END();
+}
@@ -0,0 +1,185 @@
+// ------------------------------------------------------------------------
+// test_scenes
+//
+// Queues up every scene in turn and checks the step it comes in on, both
+// on the downbeat and on a reset, plus every step either side. Whatever
+// goes out on a step (register, length, bank, and the fader values the
+// CVs were worked out from) has to all belong to the same scene: never
+// the new register with the old faders, or the old length with the new
+// bank.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include "TuringRegister.h"
+#include "seqIO.h"
+#include "hal.h"
+
+const uint8_t MAX_STEPS_TO_LOAD(2 * 16 + 2);  // Two of the longest loop, and then some
+
+struct Expected
+{
+  uint16_t  reg;
+  uint8_t   length;
+};
+
+static Stochasticizer stoch;
+static TuringRegister alan(stoch);
+static Expected       expected[NUM_SCENES];
+static char           where[64];
+
+
+// Different in every bank and every channel
+static uint16_t faderVal(uint8_t bank, uint8_t ch)
+{
+  return 100 * (ch + 1) + bank;
+}
+
+
+void setUp()
+{
+  // LOOP halfway: a real coin toss, so the registers wander
+  randomSeed(1);
+  halHostSetAdcMv(LOOP_CTRL, 1600);
+  modMatrix.sample();
+}
+
+
+void tearDown()
+{ ; }
+
+
+// Every scene gets its own register and (as far as they go round) its
+// own length; every fader bank its own values
+static void saveScenes()
+{
+  alan.restoreBanks();
+  for (uint8_t idx(0); idx < NUM_SCENES; ++idx)
+  {
+    for (uint8_t n(0); n < NUM_STEP_LENGTHS; ++n)
+    {
+      alan.changeLen(-1);
+    }
+    for (uint8_t n(0); n < idx % NUM_STEP_LENGTHS; ++n)
+    {
+      alan.changeLen(1);
+    }
+    for (uint8_t n(0); n < 3; ++n)
+    {
+      alan.iterate(1);
+    }
+
+    alan.savePattern(idx);
+    expected[idx] = Expected{alan.getReg(idx), alan.getLength()};
+  }
+
+  for (uint8_t bank(0); bank < NUM_SCENES; ++bank)
+  {
+    for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+    {
+      ioHostSetFader(bank, ch, faderVal(bank, ch));
+    }
+  }
+}
+
+
+// What the step that just went out says, against scene [bank]
+static void checkStep(uint8_t bank)
+{
+  SeqSnapshot snap(alan.snapshot());
+  uint16_t    vals[NUM_FADERS];
+  ioHostStepFaders(vals);
+
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(bank,                  snap.bank,      where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(bank,                  snap.faderBank, where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(expected[bank].length, snap.length,    where);
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    TEST_ASSERT_EQUAL_UINT16_MESSAGE(faderVal(bank, ch), vals[ch], where);
+  }
+}
+
+
+// Queues [next] up, resets straight away if [reset], and clocks until it
+// comes in. Every step before has to be all [playing]; the one it comes
+// in on has the scene's own register, and it and the next few are all
+// [next].
+static void switchTo(uint8_t playing, uint8_t next, bool reset)
+{
+  alan.setNextPattern(next);
+  if (reset)
+  {
+    alan.reset();
+  }
+
+  uint8_t steps(0);
+  while (true)
+  {
+    alan.iterate(1);
+    snprintf(where, sizeof(where), "%u -> %u%s, step %u",
+             playing, next, reset ? " on reset" : "", steps);
+    if (alan.snapshot().bank == next)
+    {
+      break;
+    }
+
+    TEST_ASSERT_FALSE_MESSAGE(reset, "didn't come in on the reset");
+    TEST_ASSERT_TRUE_MESSAGE(++steps < MAX_STEPS_TO_LOAD, "never came in");
+    checkStep(playing);
+  }
+
+  TEST_ASSERT_EQUAL_HEX16_MESSAGE(expected[next].reg, alan.snapshot().reg, where);
+  checkStep(next);
+  for (uint8_t n(0); n < 3; ++n)
+  {
+    alan.iterate(1);
+    snprintf(where, sizeof(where), "%u -> %u%s, %u after", playing, next, reset ? " on reset" : "", n);
+    checkStep(next);
+  }
+}
+
+
+static void everyScene(bool reset)
+{
+  saveScenes();
+
+  // Start from a scene, not whatever the saving left behind
+  alan.setNextPattern(0);
+  alan.reset();
+  alan.iterate(1);
+
+  uint8_t playing(0);
+  for (uint8_t n(0); n < NUM_SCENES; ++n)
+  {
+    // Every scene, in a jumbled order, queued at different points in the
+    // loop
+    uint8_t next((n * 5 + 1) % NUM_SCENES);
+    for (uint8_t step(0); step < n % 5; ++step)
+    {
+      alan.iterate(1);
+    }
+    switchTo(playing, next, reset);
+    playing = next;
+  }
+}
+
+
+void test_every_scene_on_the_downbeat()
+{
+  everyScene(false);
+}
+
+
+void test_every_scene_on_reset()
+{
+  everyScene(true);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_every_scene_on_the_downbeat);
+  RUN_TEST(test_every_scene_on_reset);
+  return UNITY_END();
+}
@@ -0,0 +1,188 @@
+// ------------------------------------------------------------------------
+// test_seqlock
+//
+// Hammers Seqlock with one writer thread and SEQLOCK_READERS reader
+// threads, for both of the payloads that go through one on the board
+// (the sequencer's SeqSnapshot and the fader scan's FaderFrame).
+//
+// Every field the writer stores is worked out from one counter, so a
+// reader can tell from the copy alone whether it all came from the same
+// store(). One that doesn't add up is a torn read. Readers also check
+// that what they see never goes backwards.
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include <thread>
+#include <vector>
+#include "seqlock.h"
+#include "seqState.h"
+#include "faderScan.h"
+
+const uint8_t  SEQLOCK_READERS(4);
+const uint32_t SEQLOCK_STORES (2000000);
+
+struct ReaderStats
+{
+  uint32_t  loads;
+  uint32_t  distinct;     // Different stores seen
+  uint32_t  torn;
+  uint32_t  backwards;
+};
+
+
+void setUp()
+{ ; }
+
+
+void tearDown()
+{ ; }
+
+
+// SeqSnapshot: everything follows from the 16-bit counter in reg
+static SeqSnapshot makeSnapshot(uint32_t n)
+{
+  uint16_t reg(n & 0xFFFF);
+  return SeqSnapshot{reg,
+                     (int8_t)(reg * 7),
+                     (uint8_t)(reg >> 3),
+                     (uint8_t)(reg ^ 0x5A),
+                     (uint8_t)(reg + 1),
+                     (uint8_t)~reg,
+                     (bool)(reg & 0x02),
+                     (bool)(reg & 0x01)};
+}
+
+
+static bool consistent(const SeqSnapshot& snap)
+{
+  SeqSnapshot expect(makeSnapshot(snap.reg));
+  return snap.step        == expect.step
+      && snap.length      == expect.length
+      && snap.bank        == expect.bank
+      && snap.nextBank    == expect.nextBank
+      && snap.faderBank   == expect.faderBank
+      && snap.loadPending == expect.loadPending
+      && snap.retrograde  == expect.retrograde;
+}
+
+
+static uint32_t sequenceOf(const SeqSnapshot& snap, uint32_t last)
+{
+  // reg wraps every 65536 stores; carry on counting from [last]
+  return last + (uint16_t)(snap.reg - (uint16_t)last);
+}
+
+
+// FaderFrame: everything follows from the version
+static FaderFrame makeFrame(uint32_t n)
+{
+  FaderFrame frame;
+  frame.version = n;
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    frame.values[ch]    = (uint16_t)(n * (ch + 1));
+    frame.changedAt[ch] = n - ch;
+  }
+  return frame;
+}
+
+
+static bool consistent(const FaderFrame& frame)
+{
+  FaderFrame expect(makeFrame(frame.version));
+  for (uint8_t ch(0); ch < NUM_FADERS; ++ch)
+  {
+    if (frame.values[ch]    != expect.values[ch]
+     || frame.changedAt[ch] != expect.changedAt[ch])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+static uint32_t sequenceOf(const FaderFrame& frame, uint32_t last)
+{
+  (void)last;
+  return frame.version;
+}
+
+
+template <typename T, typename Make>
+static void hammer(Make make)
+{
+  Seqlock<T>                lock;
+  std::atomic<bool>         done(false);
+  std::vector<ReaderStats>  stats(SEQLOCK_READERS, ReaderStats{0, 0, 0, 0});
+  std::vector<std::thread>  readers;
+
+  lock.store(make(0));
+  for (uint8_t idx(0); idx < SEQLOCK_READERS; ++idx)
+  {
+    readers.emplace_back([&, idx]()
+    {
+      ReaderStats& mine(stats[idx]);
+      uint32_t     last(0);
+      while (!done.load(std::memory_order_acquire))
+      {
+        T        val(lock.load());
+        uint32_t seq(sequenceOf(val, last));
+        ++mine.loads;
+        mine.torn      += !consistent(val);
+        mine.backwards += (seq < last);
+        mine.distinct  += (seq != last);
+        last = seq;
+      }
+    });
+  }
+
+  std::thread writer([&]()
+  {
+    for (uint32_t n(1); n <= SEQLOCK_STORES; ++n)
+    {
+      lock.store(make(n));
+    }
+    done.store(true, std::memory_order_release);
+  });
+
+  writer.join();
+  for (std::thread& reader : readers)
+  {
+    reader.join();
+  }
+
+  TEST_ASSERT_EQUAL_UINT32(2 * SEQLOCK_STORES + 2, lock.sequence());
+  uint32_t distinct(0);
+  for (const ReaderStats& mine : stats)
+  {
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, mine.torn,      "torn read");
+    TEST_ASSERT_EQUAL_UINT32_MESSAGE(0, mine.backwards, "went backwards");
+    distinct += mine.distinct;
+  }
+
+  // Make sure they actually ran alongside the writer
+  TEST_ASSERT_GREATER_THAN_UINT32_MESSAGE(SEQLOCK_READERS, distinct, "readers never overlapped the writer");
+}
+
+
+void test_seq_snapshot()
+{
+  hammer<SeqSnapshot>(makeSnapshot);
+}
+
+
+void test_fader_frame()
+{
+  hammer<FaderFrame>(makeFrame);
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_seq_snapshot);
+  RUN_TEST(test_fader_frame);
+  return UNITY_END();
+}
@@ -0,0 +1,191 @@
+// ------------------------------------------------------------------------
+// test_transport
+//
+// A burst of encoder detents gets handled as one N-step move
+// (TransportParams::moveInPlace()) instead of N single in-place steps.
+// These check that the two leave the sequencer in exactly the same state,
+// shift and all, and that every clocked step after that plays out the
+// same too (in particular, a scene queued up afterwards loads on the same
+// downbeat).
+//
+//   pio test -e native
+// ------------------------------------------------------------------------
+#include <unity.h>
+#include "TuringRegister.h"
+#include "TransportParams.h"
+#include "seqIO.h"
+#include "hal.h"
+
+const int8_t  MAX_BURST(40);
+const uint8_t QUEUED_SCENE(2);
+
+static char   where[96];
+
+
+void setUp()
+{
+  // LOOP all the way up and nothing at CV A: the coin toss never flips,
+  // so both sides get the same bits written
+  halHostSetAdcMv(LOOP_CTRL, 3300);
+  modMatrix.sample();
+}
+
+
+void tearDown()
+{ ; }
+
+
+static void assertSameState(const SeqState& single, const SeqState& burst)
+{
+  TEST_ASSERT_EQUAL_HEX16_MESSAGE(single.reg,        burst.reg,        where);
+  TEST_ASSERT_EQUAL_INT8_MESSAGE (single.offset,     burst.offset,     where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.lengthIdx,  burst.lengthIdx,  where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.bank,       burst.bank,       where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.nextBank,   burst.nextBank,   where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.faderBank,  burst.faderBank,  where);
+  TEST_ASSERT_EQUAL_INT8_MESSAGE (single.drunkStep,  burst.drunkStep,  where);
+  TEST_ASSERT_EQUAL_HEX8_MESSAGE (single.flags,      burst.flags,      where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.modTouched, burst.modTouched, where);
+  TEST_ASSERT_EQUAL_UINT32_MESSAGE(single.cursor,    burst.cursor,     where);
+
+  TEST_ASSERT_EQUAL_INT8_MESSAGE (single.shift.next(),      burst.shift.next(),      where);
+  TEST_ASSERT_EQUAL_INT8_MESSAGE (single.shift.readIdx(),   burst.shift.readIdx(),   where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.shift.writeIdx(),  burst.shift.writeIdx(),  where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.shift.leftAmt(),   burst.shift.leftAmt(),   where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.shift.rightAmt(),  burst.shift.rightAmt(),  where);
+  TEST_ASSERT_EQUAL_UINT8_MESSAGE(single.shift.immutable(), burst.shift.immutable(), where);
+}
+
+
+// One clocked step, the way TuringRegister::iterate() does it
+static void clock(TransportParams& transport, const Scene& scene, const Stochasticizer& coin)
+{
+  transport.pre_iterate(1, false);
+  if (transport.readyToLoad())
+  {
+    transport.loadPattern(scene);
+  }
+  transport.iterate(coin);
+}
+
+
+// Every length, every starting step, bursts of up to MAX_BURST detents
+// either way, with and without a scene queued up beforehand; then a scene
+// queued after the burst and two loops' worth of clocks
+void test_burst_matches_single_steps()
+{
+  Stochasticizer coin;
+  coin.latch(3300, 0);
+
+  Scene scene{};
+  scene.reg       = 0x3C0F;
+  scene.lengthIdx = 3;
+
+  for (uint8_t lengthIdx(0); lengthIdx < NUM_STEP_LENGTHS; ++lengthIdx)
+  {
+    int8_t len(STEP_LENGTH_VALS[lengthIdx]);
+    for (int8_t start(1 - len); start < len; ++start)
+    {
+      for (int8_t steps(-MAX_BURST); steps <= MAX_BURST; ++steps)
+      {
+        if (steps >= -1 && steps <= 1)
+        {
+          continue;
+        }
+
+        for (uint8_t queuedFirst(0); queuedFirst < 2; ++queuedFirst)
+        {
+          SeqState seed;
+          seed.reg       = 0xA5C3;
+          seed.lengthIdx = lengthIdx;
+          seed.offset    = start;
+          if (queuedFirst)
+          {
+            seed.setFlag(SEQ_LOAD_PENDING);
+            seed.nextBank = QUEUED_SCENE;
+          }
+
+          SeqState single(seed), burst(seed);
+          TransportParams singleT(single), burstT(burst);
+
+          int8_t dir(steps < 0 ? -1 : 1);
+          for (int8_t step(0); step != steps; step += dir)
+          {
+            singleT.pre_iterate(dir, true);
+            singleT.iterate(coin);
+          }
+          burstT.moveInPlace(steps);
+
+          snprintf(where, sizeof(where), "len %d, from %d, %d steps, queued %u: after the move",
+                   len, start, steps, queuedFirst);
+          assertSameState(single, burst);
+
+          if (!queuedFirst)
+          {
+            singleT.setNextPattern(QUEUED_SCENE);
+            burstT.setNextPattern(QUEUED_SCENE);
+          }
+
+          for (uint8_t tick(0); tick < 2 * len; ++tick)
+          {
+            clock(singleT, scene, coin);
+            clock(burstT,  scene, coin);
+            snprintf(where, sizeof(where), "len %d, from %d, %d steps, queued %u: clock %u",
+                     len, start, steps, queuedFirst, tick);
+            assertSameState(single, burst);
+          }
+        }
+      }
+    }
+  }
+}
+
+
+// The same thing through the whole sequencer: three detents in one go
+// from the downbeat, then a scene queued up. It has to load on the same
+// clock it would have after three single detents, not a step early.
+void test_queued_scene_loads_on_downbeat_after_burst()
+{
+  Stochasticizer singleCoin, burstCoin;
+  TuringRegister single(singleCoin), burst(burstCoin);
+  single.restoreBanks();
+  burst.restoreBanks();
+
+  for (uint8_t detent(0); detent < 3; ++detent)
+  {
+    single.iterate(1, true);
+  }
+  burst.iterate(3, true);
+
+  single.setNextPattern(QUEUED_SCENE);
+  burst.setNextPattern(QUEUED_SCENE);
+
+  uint8_t len(single.getLength());
+  bool    loaded(false);
+  for (uint8_t tick(0); tick < 2 * len; ++tick)
+  {
+    single.iterate(1);
+    burst.iterate(1);
+
+    SeqSnapshot a(single.snapshot()), b(burst.snapshot());
+    snprintf(where, sizeof(where), "clock %u", tick);
+    TEST_ASSERT_EQUAL_HEX16_MESSAGE(a.reg,       b.reg,       where);
+    TEST_ASSERT_EQUAL_INT8_MESSAGE (a.step,      b.step,      where);
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(a.length,    b.length,    where);
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(a.bank,      b.bank,      where);
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(a.faderBank, b.faderBank, where);
+    TEST_ASSERT_EQUAL_UINT8_MESSAGE(a.loadPending, b.loadPending, where);
+
+    loaded |= (b.bank == QUEUED_SCENE);
+  }
+  TEST_ASSERT_TRUE_MESSAGE(loaded, "queued scene never loaded");
+}
+
+
+int main()
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_burst_matches_single_steps);
+  RUN_TEST(test_queued_scene_loads_on_downbeat_after_burst);
+  return UNITY_END();
+}